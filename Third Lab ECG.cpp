@@ -1,21 +1,62 @@
 ﻿// Подключаем необходимые библиотеки
 #include <math.h>
+#include <stddef.h>
+#include <thread>
+#include <vector>
 #include <GL/glew.h>
 #include <GL/freeglut.h>
 
 
 // Подключаем модули нашего проекта
 #include "pipeline.h"
+#include "render_state.h"
 #include "camera.h"
+#include "mesh.h"
+#include "vertex_format.h"
+#include "mesh_file.h"
+#include "normal_generator.h"
+#include "render_queue.h"
+#include "cull_technique.h"
+#include "static_scene.h"
+#include "scene_bvh.h"
 #include "texture.h"
+#include "texture_loader.h"
+#include "texture_manager.h"
+#include "texture_array.h"
+#include "sampler.h"
+#include "technique_registry.h"
 #include "lighting_technique.h"
+#include "clustered_lighting.h"
+#include "deferred_renderer.h"
 #include "glut_backend.h"
 
 
 // Подключаем реализации модулей нашего проекта
 #include "pipeline.cpp"
+#include "render_state.cpp"
 #include "camera.cpp"\n#include "texture.cpp"
+#include "mesh.cpp"
+#include "vertex_format.cpp"
+#include "mesh_file.cpp"
+#include "normal_generator.cpp"
+#include "render_queue.cpp"
+#include "cull_technique.cpp"
+#include "static_scene.cpp"
+#include "scene_bvh.cpp"
+#include "texture_loader.cpp"
+#include "texture_manager.cpp"
+#include "texture_array.cpp"
+#include "sampler.cpp"
+#include "texture_file.cpp"
+#include "mapped_file.cpp"
+#include "technique_registry.cpp"
 #include "lighting_technique.cpp"
+#include "clustered_lighting.cpp"
+#include "gbuffer.cpp"
+#include "null_technique.cpp"
+#include "ds_geom_pass_tech.cpp"
+#include "ds_light_pass_tech.cpp"
+#include "deferred_renderer.cpp"
 #include "glut_backend.cpp"
 #include "util.h"
 
@@ -24,21 +65,36 @@
 #define WINDOW_WIDTH 1280
 #define WINDOW_HEIGHT 1024
 
-// Создаем структуру Vertex, описывающую вершину меша
-struct Vertex
-{
-    Vector3f m_pos;
-    Vector2f m_tex;
-    Vector3f m_normal;
+// Размер сетки копий пола, рисуемых одним вызовом в режиме инстансинга
+#define INSTANCE_GRID_SIZE 32
 
-    Vertex() {}
+// Размер сетки точечных источников света в режиме кластерного освещения
+#define CLUSTERED_LIGHTS_GRID_SIZE 16
 
-    Vertex(Vector3f pos, Vector2f tex)
-    {
-        m_pos = pos;
-        m_tex = tex;
-        m_normal = Vector3f(0.0f, 0.0f, 0.0f);
-    }
+// Сколько байт текстур можно загрузить в видеопамять за один кадр
+#define TEXTURE_UPLOAD_BUDGET (4 * 1024 * 1024)
+
+// Сколько байт видеопамяти могут занимать текстуры
+#define TEXTURE_MEMORY_BUDGET (256 * 1024 * 1024)
+
+// Степень анизотропной фильтрации текстур пола
+#define FLOOR_MAX_ANISOTROPY 16.0f
+
+// Наибольший размер узора, помещаемого в массив текстур
+#define PATTERN_MAX_SIZE 256
+
+// Узоры из папки Content, собираемые в один массив текстур
+static const char* PatternFiles[] = {
+    "bricks.png", "checkerboard.png", "circles.png", "crosshatch.png", "crosshatch30.png",
+    "crosshatch45.png", "fishscales.png", "gray0.png", "gray10.png", "gray100.png", "gray15.png",
+    "gray20.png", "gray25.png", "gray30.png", "gray35.png", "gray40.png", "gray45.png", "gray5.png",
+    "gray50.png", "gray55.png", "gray60.png", "gray65.png", "gray70.png", "gray75.png",
+    "gray80.png", "gray85.png", "gray90.png", "gray95.png", "hexagons.png", "horizontal.png",
+    "horizontal2.png", "horizontal3.png", "horizontalsaw.png", "hs_bdiagonal.png", "hs_cross.png",
+    "hs_diagcross.png", "hs_fdiagonal.png", "hs_horizontal.png", "hs_vertical.png", "left30.png",
+    "left45.png", "leftshingle.png", "octagons.png", "right30.png", "right45.png",
+    "rightshingle.png", "smallfishscales.png", "vertical.png", "vertical2.png", "vertical3.png",
+    "verticalbricks.png", "verticalleftshingle.png", "verticalrightshingle.png", "verticalsaw.png"
 };
 
 // Определяем класс нашего приложения Main, наследующий интерфейс ICallbacks для работы с GLUT
@@ -50,8 +106,30 @@ public:
     Main()
     {
         m_pGameCamera = NULL;
-        m_pTexture = NULL;
-        m_pEffect = NULL;
+        m_pFloor = NULL;
+        m_pPackedFloor = NULL;
+        m_pTextureLoader = NULL;
+        m_pTextureManager = NULL;
+        m_pLightingParams = NULL;
+        m_pLightClusters = NULL;
+        m_pDeferredRenderer = NULL;
+        m_pPatterns = NULL;
+        m_pFloorSampler = NULL;
+        m_pEffects = NULL;
+        m_pTechniques = NULL;
+        m_pRenderQueue = NULL;
+        m_pStaticScene = NULL;
+        m_pSceneBVH = NULL;
+        m_floorSceneMesh = 0;
+        m_instanced = false;
+        m_multiDraw = false;
+        m_culling = CULLING_GPU;
+        m_clustered = false;
+        m_deferred = false;
+        m_patterns = false;
+        m_packedVertices = false;
+        m_floorPattern = 0;
+        m_numInstances = 0;
         m_scale = 0.0f;
         m_directionalLight.Color = Vector3f(1.0f, 1.0f, 1.0f);
         m_directionalLight.AmbientIntensity = 0.0f;
@@ -62,44 +140,143 @@ public:
     // Деструктор класса Main
     ~Main()
     {
-        delete m_pEffect;
+        delete m_pRenderQueue;
+        delete m_pEffects;
+        delete m_pTechniques;
+        delete m_pLightingParams;
+        delete m_pLightClusters;
+        delete m_pDeferredRenderer;
+        delete m_pPatterns;
+        delete m_pFloorSampler;
         delete m_pGameCamera;
-        delete m_pTexture;
+        delete m_pFloor;
+        delete m_pPackedFloor;
+        delete m_pStaticScene;
+        delete m_pSceneBVH;
+        // Загрузчик останавливается первым: его потоки ссылаются на текстуры менеджера
+        m_texture.Reset();
+        delete m_pTextureLoader;
+        delete m_pTextureManager;
     }
 
     // Функция инициализации приложения
     bool Init()
     {
+        // Собранные шейдерные программы сохраняются на диск, и следующий
+        // запуск загружает их без компиляции
+        Technique::EnableBinaryCache("./ShaderCache");
+
         Vector3f Pos(-10.0f, 0.0f, -10.0f);
         Vector3f Target(1.0f, 0.0f, 1.0f);
         Vector3f Up(0.0, 1.0f, 0.0f);
         m_pGameCamera = new Camera(WINDOW_WIDTH, WINDOW_HEIGHT, Pos, Target, Up);
 
+        // Положение пола и проекция не меняются от кадра к кадру, поэтому
+        // задаем их один раз - Pipeline пересчитывает только изменившиеся матрицы
+        m_pipeline.Rotate(0.0f, 0.0f, 0.0f);
+        m_pipeline.WorldPos(0.0f, 0.0f, 1.0f);
+        m_pipeline.SetPerspectiveProj(60.0f, WINDOW_WIDTH, WINDOW_HEIGHT, 0.1f, 100.0f);
+
         unsigned int Indices[] = { 0, 2, 1,
                                    0, 3, 2 };
 
-        CreateIndexBuffer(Indices, sizeof(Indices));
+        // Неподвижные копии пола собираются в общие буферы и рисуются
+        // одним вызовом glMultiDrawElementsIndirect
+        m_pStaticScene = new StaticScene();
 
-        CreateVertexBuffer(Indices, ARRAY_SIZE_IN_ELEMENTS(Indices));
+        if (!CreateFloorMesh(Indices, ARRAY_SIZE_IN_ELEMENTS(Indices))) {
+            return false;
+        }
 
-        m_pEffect = new LightingTechnique();
+        // Параметры освещения хранятся в общих uniform-буферах и
+        // используются обеими шейдерными программами
+        m_pLightingParams = new LightingParams();
 
-        if (!m_pEffect->Init())
+        if (!m_pLightingParams->Init())
+        {
+            printf("Error initializing the lighting uniform buffers\n");
+            return false;
+        }
+
+        m_pLightingParams->SetMatSpecularIntensity(1.0f);
+        m_pLightingParams->SetMatSpecularPower(32);
+
+        // Шейдерные программы собираются через реестр: все отправляются на
+        // компиляцию сразу, и драйвер собирает их параллельно
+        m_pTechniques = new TechniqueRegistry();
+
+        // Варианты LightingTechnique собираются по требованию под текущее
+        // состояние: число источников, узоры, блики и т.д.
+        m_pEffects = new LightingVariants();
+        m_pEffects->SetRegistry(m_pTechniques);
+        m_pEffects->SetTextureUnit(0);
+        m_pEffects->SetClusterTextureUnits(1, 2, 3);
+
+        // Вызовы отрисовки кадра собираются в очередь и выполняются
+        // в порядке, при котором меньше всего переключений состояния
+        m_pRenderQueue = new RenderQueue();
+
+        // Заранее отправляем на сборку варианты для всех сочетаний режимов
+        // при двух прожекторах сцены; ждать их нужно только при первом
+        // использовании. Варианты для glMultiDrawElementsIndirect
+        // собираются в InitStaticScene, если режим доступен
+        const unsigned int GeometryModes[4] = { 0, LightingTechnique::INSTANCED, LightingTechnique::PACKED_VERTICES,
+                                                LightingTechnique::PACKED_VERTICES | LightingTechnique::INSTANCED };
+
+        for (unsigned int i = 0 ; i < ARRAY_SIZE_IN_ELEMENTS(GeometryModes) ; i++) {
+            PrewarmLighting(GeometryModes[i]);
+        }
+
+        // Общий вариант с числом источников из uniform-буфера сразу
+        // проверяет, что исходники шейдеров собираются
+        if (!m_pEffects->Get(0, LightingTechnique::DYNAMIC_LIGHT_COUNT, LightingTechnique::DYNAMIC_LIGHT_COUNT))
         {
             printf("Error initializing the lighting technique\n");
             return false;
         }
 
-        m_pEffect->Enable();
+        if (!InitLightClusters()) {
+            return false;
+        }
 
-        m_pEffect->SetTextureUnit(0);
+        CreateInstanceBuffer();
 
-        m_pTexture = new Texture(GL_TEXTURE_2D, "./x64/test.png");
+        if (!InitPatterns()) {
+            return false;
+        }
+
+        InitStaticScene();
+
+        m_pDeferredRenderer = new DeferredRenderer();
+
+        if (!m_pDeferredRenderer->Init(WINDOW_WIDTH, WINDOW_HEIGHT, 0.1f, 100.0f, m_pTechniques)) {
+            printf("Error initializing the deferred renderer\n");
+            return false;
+        }
+
+        // Текстуры декодируются в фоновых потоках, а до окончания загрузки
+        // вместо них используется серая заглушка
+        m_pTextureLoader = new TextureLoader();
+
+        if (!m_pTextureLoader->Init(std::thread::hardware_concurrency(), TEXTURE_UPLOAD_BUDGET)) {
+            return false;
+        }
+
+        // Менеджер загружает каждый файл один раз и делит его между всеми пользователями
+        m_pTextureManager = new TextureManager(m_pTextureLoader, TEXTURE_MEMORY_BUDGET);
+        m_texture = m_pTextureManager->Get("./x64/test.png");
 
-        if (!m_pTexture->Load()) {
+        // Пол виден под острыми углами, поэтому читается с трилинейной
+        // и анизотропной фильтрацией
+        m_pFloorSampler = new Sampler();
+
+        if (!m_pFloorSampler->Init(Sampler::FILTER_TRILINEAR, FLOOR_MAX_ANISOTROPY)) {
             return false;
         }
 
+        m_texture.SetSampler(m_pFloorSampler);
+        m_pPatterns->SetSampler(m_pFloorSampler);
+
         return true;
     }
 
@@ -114,6 +291,11 @@ public:
     {
         m_pGameCamera->OnRender();
 
+        // Загрузка в видеопамять готовых текстур в пределах бюджета кадра
+        m_pTextureLoader->Update();
+        m_pTextureManager->BeginFrame();
+        m_pTechniques->Update();
+
         glClear(GL_COLOR_BUFFER_BIT);
 
         m_scale += 0.01f;
@@ -139,37 +321,34 @@ public:
         sl[1].Cutoff = 10.0f;
 
 
-        // Привязка источников света к шейдерной программе
-        m_pEffect->SetSpotLights(2, sl);
-
-
-        Pipeline p;
-        p.Rotate(0.0f, 0.0f, 0.0f);
-        p.WorldPos(0.0f, 0.0f, 1.0f);
-        p.SetCamera(m_pGameCamera->GetPos(), m_pGameCamera->GetTarget(), m_pGameCamera->GetUp());
-        p.SetPerspectiveProj(60.0f, WINDOW_WIDTH, WINDOW_HEIGHT, 0.1f, 100.0f);
-        m_pEffect->SetWVP(p.GetWVPTrans());
-        const Matrix4f& WorldTransformation = p.GetWorldTrans();
-        m_pEffect->SetWorldMatrix(WorldTransformation);
-        m_pEffect->SetDirectionalLight(m_directionalLight);
-        m_pEffect->SetEyeWorldPos(m_pGameCamera->GetPos());
-        m_pEffect->SetMatSpecularIntensity(1.0f);
-        m_pEffect->SetMatSpecularPower(32);
-
-        glEnableVertexAttribArray(0);
-        glEnableVertexAttribArray(1);
-        glEnableVertexAttribArray(2);
-        glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*)12);
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*)20);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IBO);
-        m_pTexture->Bind(GL_TEXTURE0);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
-        glDisableVertexAttribArray(2);
+        // Запись источников света в общий uniform-буфер
+        m_pLightingParams->SetSpotLights(2, sl);
+        m_pLightingParams->SetDirectionalLight(m_directionalLight);
+        m_pLightingParams->SetEyeWorldPos(m_pGameCamera->GetPos());
+        m_pLightingParams->Update();
+
+
+        m_pipeline.SetCamera(m_pGameCamera->GetPos(), m_pGameCamera->GetTarget(), m_pGameCamera->GetUp());
+
+        m_pRenderQueue->Clear();
+
+        if (m_deferred) {
+            // Пол записывается в G-буфер, освещение считается после него
+            DSGeomPassTech* pGeomPass = m_pDeferredRenderer->BeginGeometryPass();
+            AddFloorDraw(pGeomPass, &m_texture, m_pFloor, 0);
+            m_pRenderQueue->Submit();
+            m_pDeferredRenderer->EndGeometryPass();
+        }
+        else {
+            RenderForward(sl);
+        }
+
+        if (m_deferred) {
+            // Каждый источник света освещает только свою область экрана
+            m_pDeferredRenderer->RenderLights(m_pipeline.GetVPTrans(), m_pGameCamera->GetPos(),
+                                              m_gridPointLights.size(), &m_gridPointLights[0], 2, sl);
+            m_pDeferredRenderer->Present();
+        }
 
         glutSwapBuffers();
     }
@@ -204,6 +383,39 @@ public:
         case 'x': // Если нажата клавиша x
             m_directionalLight.DiffuseIntensity -= 0.05f; // Уменьшить интенсивность рассеянного света на 0.05
             break;
+        case 'i': // Если нажата клавиша i
+            m_instanced = !m_instanced; // Переключить отрисовку сетки копий пола одним вызовом
+            break;
+        case 'm': // Если нажата клавиша m
+            m_multiDraw = !m_multiDraw; // Переключить отрисовку копий пола через glMultiDrawElementsIndirect
+            break;
+        case 'g': // Если нажата клавиша g
+            m_culling = (m_culling + 1) % NUM_CULLING_MODES; // Отсечение копий пола по пирамиде видимости: нет, на GPU, на CPU
+            break;
+        case 'c': // Если нажата клавиша c
+            m_clustered = !m_clustered; // Переключить кластерное освещение с сеткой точечных источников
+            break;
+        case 'p': // Если нажата клавиша p
+            m_patterns = !m_patterns; // Переключить окраску пола узорами из массива текстур
+            break;
+        case 'n': // Если нажата клавиша n
+            m_floorPattern = (m_floorPattern + 1) % m_pPatterns->GetNumRegions(); // Следующий узор пола
+            break;
+        case 'f': // Если нажата клавиша f
+            CycleFloorFilter(); // Переключить фильтрацию текстур пола
+            break;
+        case 'd': // Если нажата клавиша d
+            m_deferred = !m_deferred; // Переключить отложенное освещение пола сеткой точечных источников
+            break;
+        case 'h': // Если нажата клавиша h
+            ToggleSpecular(); // Включить или выключить блики материала
+            break;
+        case 'v': // Если нажата клавиша v
+            m_packedVertices = !m_packedVertices; // Переключить пол на сжатые 16-байтные вершины
+            break;
+        case 'r': // Если нажата клавиша r
+            PrintStateStats(); // Вывести, сколько вызовов GL отброшено как лишние
+            break;
     }
 }
 
@@ -214,29 +426,110 @@ public:
 
 private:
 
-    void CalcNormals(const unsigned int* pIndices, unsigned int IndexCount,
-        Vertex* pVertices, unsigned int VertexCount) {
-        for (unsigned int i = 0; i < IndexCount; i += 3) {
-            unsigned int Index0 = pIndices[i];
-            unsigned int Index1 = pIndices[i + 1];
-            unsigned int Index2 = pIndices[i + 2];
-            Vector3f v1 = pVertices[Index1].m_pos - pVertices[Index0].m_pos;
-            Vector3f v2 = pVertices[Index2].m_pos - pVertices[Index0].m_pos;
-            Vector3f Normal = v1.Cross(v2);
-            Normal.Normalize();
-
-            pVertices[Index0].m_normal += Normal;
-            pVertices[Index1].m_normal += Normal;
-            pVertices[Index2].m_normal += Normal;
+    // Способы отсечения копий пола в режиме glMultiDrawElementsIndirect
+    enum { CULLING_NONE, CULLING_GPU, CULLING_CPU, NUM_CULLING_MODES };
+
+    // Прямое освещение: каждый фрагмент пола перебирает все источники света
+    void RenderForward(const SpotLight* pSpotLights)
+    {
+        // В режиме инстансинга мировые матрицы берутся из буфера экземпляров,
+        // в кластерном режиме источники света - из текстурных буферов,
+        // в режиме узоров цвет - из массива текстур, сжатые вершины
+        // распаковываются в вершинном шейдере
+        const bool MultiDraw = m_multiDraw && m_pStaticScene;
+        const bool Packed = m_packedVertices && !MultiDraw;
+        unsigned int Flags = (MultiDraw ? LightingTechnique::INDIRECT :
+                              m_instanced ? LightingTechnique::INSTANCED : 0) |
+                             (m_clustered ? LightingTechnique::CLUSTERED : 0) |
+                             (m_patterns ? LightingTechnique::PATTERNS : 0) |
+                             (Packed ? LightingTechnique::PACKED_VERTICES : 0);
+
+        // Вариант с точным числом источников из m_pLightingParams
+        LightingTechnique* pEffect = m_pEffects->Get(Flags, *m_pLightingParams);
+
+        if (!pEffect) {
+            return;
+        }
+
+        pEffect->Enable();
+
+        if (m_clustered) {
+            // Распределение источников света по кластерам пирамиды видимости
+            m_pLightClusters->SetSpotLights(2, pSpotLights);
+            m_pLightClusters->Update(m_pipeline.GetViewTrans(), std::thread::hardware_concurrency());
+            m_pLightClusters->Bind(GL_TEXTURE1, GL_TEXTURE2, GL_TEXTURE3);
+            pEffect->SetLightClusters(*m_pLightClusters, m_pGameCamera->GetTarget());
         }
 
-        for (unsigned int i = 0; i < VertexCount; i++) {
-            pVertices[i].m_normal.Normalize();
+        // Матрицы и узоры копий берутся из буфера объектов по номеру вызова
+        if (MultiDraw) {
+            // Видимые копии отбираются на GPU, процессор не читает результат
+            if (m_culling == CULLING_GPU) {
+                m_pStaticScene->Cull(m_pipeline.GetVPTrans());
+                pEffect->Enable();
+            }
+
+            (m_patterns ? (IBindableTexture*)m_pPatterns : &m_texture)->Bind(GL_TEXTURE0);
+            pEffect->SetVP(m_pipeline.GetVPTrans());
+            if (m_culling == CULLING_GPU) {
+                m_pStaticScene->RenderVisible();
+            }
+            else if (m_culling == CULLING_CPU) {
+                // Дерево ограничивающих объемов отбрасывает невидимые группы копий целиком
+                Frustum ViewFrustum;
+                ViewFrustum.Init(m_pipeline.GetVPTrans());
+                m_pSceneBVH->Refit();
+                m_pSceneBVH->Cull(ViewFrustum, m_visibleObjects);
+
+                if (!m_visibleObjects.empty()) {
+                    m_pStaticScene->RenderList(&m_visibleObjects[0], m_visibleObjects.size());
+                }
+            }
+            else {
+                m_pStaticScene->Render();
+            }
+
+            return;
         }
+
+        // Атрибуты копий записаны в VAO пола, и все копии рисуются одним вызовом
+        IBindableTexture* pTexture = m_patterns ? (IBindableTexture*)m_pPatterns : &m_texture;
+        AddFloorDraw(pEffect, pTexture, Packed ? m_pPackedFloor : m_pFloor, m_instanced ? m_numInstances : 0);
+        m_pRenderQueue->Submit();
+    }
+
+    // Добавить пол в очередь отрисовки с матрицами текущего кадра
+    void AddFloorDraw(Technique* pTechnique, IBindableTexture* pTexture, Mesh* pMesh, unsigned int NumInstances)
+    {
+        DrawParams Params;
+
+        // При инстансинге мировые матрицы берутся из буфера экземпляров
+        Params.WVP = NumInstances > 0 ? m_pipeline.GetVPTrans() : m_pipeline.GetWVPTrans();
+        Params.World = m_pipeline.GetWorldTrans();
+
+        const TextureRegion& Region = m_pPatterns->GetRegion(m_floorPattern);
+        Params.PatternRect = Region.Rect;
+        Params.PatternLayer = Region.Layer;
+        Params.Quantization = pMesh->GetQuantization();
+
+        // Расстояние от камеры до начала координат пола
+        const Vector3f& Eye = m_pGameCamera->GetPos();
+        const float dx = Params.World.m[0][3] - Eye.x;
+        const float dy = Params.World.m[1][3] - Eye.y;
+        const float dz = Params.World.m[2][3] - Eye.z;
+
+        m_pRenderQueue->Add(pTechnique, pTexture, pMesh, NumInstances, Params, sqrtf(dx * dx + dy * dy + dz * dz));
     }
 
-    // Создать буффер вершин
-    void CreateVertexBuffer(const unsigned int* pIndices, unsigned int IndexCount)
+    // Большие меши обрабатываются в нескольких потоках
+    void CalcNormals(const unsigned int* pIndices, unsigned int IndexCount,
+        Vertex* pVertices, unsigned int VertexCount) {
+        NormalGenerator Generator;
+        Generator.Run(pIndices, IndexCount, pVertices, VertexCount, std::thread::hardware_concurrency());
+    }
+
+    // Создать меш пола
+    bool CreateFloorMesh(const unsigned int* pIndices, unsigned int IndexCount)
     {
         Vertex Vertices[4] = { Vertex(Vector3f(-10.0f, -2.0f, -10.0f), Vector2f(0.0f, 0.0f)),
                                Vertex(Vector3f(10.0f, -2.0f, -10.0f), Vector2f(1.0f, 0.0f)),
@@ -247,25 +540,241 @@ private:
 
         CalcNormals(pIndices, IndexCount, Vertices, VertexCount);
 
-        glGenBuffers(1, &m_VBO);
-        glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(Vertices), Vertices, GL_STATIC_DRAW);
+        for (unsigned int i = 0 ; i < VertexCount ; i++) {
+            m_floorBox.Expand(Vertices[i].m_pos);
+        }
+
+        m_floorSceneMesh = m_pStaticScene->AddMesh(Vertices, VertexCount, pIndices, IndexCount);
+
+        m_pFloor = new Mesh();
+
+        if (!m_pFloor->Init(Vertices, VertexCount, pIndices, IndexCount)) {
+            return false;
+        }
+
+        // Та же геометрия в 16-байтных вершинах вместо 32-байтных
+        m_pPackedFloor = new Mesh();
+
+        return m_pPackedFloor->Init(Vertices, VertexCount, pIndices, IndexCount, VERTEX_FORMAT_PACKED);
     }
 
-    // Создать буффер индексов
-    void CreateIndexBuffer(const unsigned int* pIndices, unsigned int SizeInBytes)
+    // Создать буффер мировых матриц для копий пола. Копии неподвижны,
+    // поэтому буффер заполняется один раз, а в кадре меняется только VP
+    void CreateInstanceBuffer()
     {
-        glGenBuffers(1, &m_IBO);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, SizeInBytes, pIndices, GL_STATIC_DRAW);
+        const unsigned int NumInstances = INSTANCE_GRID_SIZE * INSTANCE_GRID_SIZE;
+        std::vector<Matrix4f>& WorldMatrices = m_instanceWorlds;
+        WorldMatrices.resize(NumInstances);
+
+        std::vector<Vector3f> Scales(NumInstances, Vector3f(0.25f, 0.25f, 0.25f));
+        std::vector<Vector3f> Positions(NumInstances);
+        const float Spacing = 6.0f;
+        const float Offset = -0.5f * Spacing * (INSTANCE_GRID_SIZE - 1);
+
+        for (unsigned int z = 0 ; z < INSTANCE_GRID_SIZE ; z++) {
+            for (unsigned int x = 0 ; x < INSTANCE_GRID_SIZE ; x++) {
+                // Пол лежит на высоте -2, после масштабирования поднимаем копии обратно
+                Positions[z * INSTANCE_GRID_SIZE + x] = Vector3f(Offset + x * Spacing, -1.5f, Offset + z * Spacing);
+            }
+        }
+
+        // Нужны только мировые матрицы, WVP считает шейдер
+        m_pipeline.GetTransBatch(NumInstances, &Scales[0], NULL, &Positions[0], &WorldMatrices[0], NULL,
+                                 std::thread::hardware_concurrency());
+
+        m_numInstances = WorldMatrices.size();
+
+        glGenBuffers(1, &m_instanceVBO);
+        RenderState::BindBuffer(GL_ARRAY_BUFFER, m_instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(Matrix4f) * m_numInstances, &WorldMatrices[0], GL_STATIC_DRAW);
+
+        // Каждая строка мировой матрицы - отдельный атрибут vec4,
+        // который меняется один раз на экземпляр
+        Mesh* pFloors[2] = { m_pFloor, m_pPackedFloor };
+
+        for (unsigned int f = 0 ; f < 2 ; f++) {
+            GLuint Binding = pFloors[f]->AddInstanceBuffer(m_instanceVBO, sizeof(Matrix4f));
+
+            for (unsigned int i = 0 ; i < 4 ; i++) {
+                pFloors[f]->AddInstanceAttribute(Binding, LightingTechnique::INSTANCE_WORLD_LOCATION + i, 4, sizeof(float) * 4 * i);
+            }
+        }
+    }
+
+    // Билинейная -> трилинейная -> трилинейная с анизотропией -> билинейная
+    void CycleFloorFilter()
+    {
+        if (m_pFloorSampler->GetFilter() == Sampler::FILTER_BILINEAR) {
+            m_pFloorSampler->SetFilter(Sampler::FILTER_TRILINEAR);
+        }
+        else if (m_pFloorSampler->GetAnisotropy() == 1.0f && Sampler::GetMaxSupportedAnisotropy() > 1.0f) {
+            m_pFloorSampler->SetFilter(Sampler::FILTER_TRILINEAR, FLOOR_MAX_ANISOTROPY);
+        }
+        else {
+            m_pFloorSampler->SetFilter(Sampler::FILTER_BILINEAR);
+        }
+    }
+
+    // Счетчики считаются с прошлого вывода
+    void PrintStateStats()
+    {
+        const unsigned int Issued = RenderState::GetNumIssued();
+        const unsigned int Filtered = RenderState::GetNumFiltered();
+        printf("GL state calls: %u issued, %u filtered (%.1f%%)\n", Issued, Filtered,
+               100.0f * Filtered / (Issued + Filtered > 0 ? Issued + Filtered : 1));
+        printf("Render queue: %u draws, %u program and texture binds\n",
+               m_pRenderQueue->GetNumDraws(), m_pRenderQueue->GetNumStateChanges());
+        RenderState::ResetCounters();
+    }
+
+    // Без бликов выбирается вариант шейдера, в котором они не вычисляются
+    void ToggleSpecular()
+    {
+        const bool Specular = m_pLightingParams->GetMatSpecularIntensity() > 0.0f;
+        m_pLightingParams->SetMatSpecularIntensity(Specular ? 0.0f : 1.0f);
+    }
+
+    // Собрать узоры в массив текстур и назначить копиям пола разные узоры
+    bool InitPatterns()
+    {
+        std::vector<std::string> FileNames;
+
+        for (unsigned int i = 0 ; i < ARRAY_SIZE_IN_ELEMENTS(PatternFiles) ; i++) {
+            FileNames.push_back(std::string("./Content/") + PatternFiles[i]);
+        }
+
+        m_pPatterns = new TextureArray();
+
+        if (!m_pPatterns->Load(FileNames, PATTERN_MAX_SIZE)) {
+            return false;
+        }
+
+        std::vector<TextureRegion> Regions(m_numInstances);
+
+        for (unsigned int i = 0 ; i < m_numInstances ; i++) {
+            Regions[i] = m_pPatterns->GetRegion(i % m_pPatterns->GetNumRegions());
+        }
+
+        glGenBuffers(1, &m_patternVBO);
+        RenderState::BindBuffer(GL_ARRAY_BUFFER, m_patternVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(TextureRegion) * Regions.size(), &Regions[0], GL_STATIC_DRAW);
+
+        // Каждая копия получает свой узор
+        Mesh* pFloors[2] = { m_pFloor, m_pPackedFloor };
+
+        for (unsigned int f = 0 ; f < 2 ; f++) {
+            GLuint Binding = pFloors[f]->AddInstanceBuffer(m_patternVBO, sizeof(TextureRegion));
+            pFloors[f]->AddInstanceAttribute(Binding, LightingTechnique::PATTERN_RECT_LOCATION, 4, offsetof(TextureRegion, Rect));
+            pFloors[f]->AddInstanceAttribute(Binding, LightingTechnique::PATTERN_LAYER_LOCATION, 1, offsetof(TextureRegion, Layer));
+        }
+
+        return true;
+    }
+
+    // Копии пола со своими матрицами и узорами становятся отдельными вызовами
+    // одного glMultiDrawElementsIndirect. Без GL 4.3 режим недоступен.
+    void InitStaticScene()
+    {
+        m_pSceneBVH = new SceneBVH();
+
+        // Номера объектов в дереве совпадают с номерами в StaticScene
+        for (unsigned int i = 0 ; i < m_instanceWorlds.size() ; i++) {
+            const TextureRegion& Region = m_pPatterns->GetRegion(i % m_pPatterns->GetNumRegions());
+            m_pStaticScene->AddObject(m_floorSceneMesh, m_instanceWorlds[i], Region.Rect, Region.Layer);
+            m_pSceneBVH->AddObject(m_floorBox, m_instanceWorlds[i]);
+        }
+
+        m_pSceneBVH->Build();
+
+        if (!m_pStaticScene->Finalize()) {
+            delete m_pStaticScene;
+            m_pStaticScene = NULL;
+            return;
+        }
+
+        // Видимость копий проверяется вычислительным шейдером, без него
+        // рисуются все копии
+        m_pStaticScene->InitCulling();
+
+        PrewarmLighting(LightingTechnique::INDIRECT);
+    }
+
+    // Отправить на сборку варианты режима геометрии Flags со всеми
+    // сочетаниями кластерного освещения и узоров
+    void PrewarmLighting(unsigned int Flags)
+    {
+        const unsigned int Options = LightingTechnique::CLUSTERED | LightingTechnique::PATTERNS;
+
+        for (unsigned int i = 0 ; i <= Options ; i++) {
+            if ((i & Options) == i) {
+                m_pEffects->Prewarm(Flags | i, 0, 2);
+            }
+        }
+    }
+
+    // Создать кластеры освещения и сетку цветных точечных источников над полом
+    bool InitLightClusters()
+    {
+        m_pLightClusters = new LightClusters();
+
+        if (!m_pLightClusters->Init()) {
+            return false;
+        }
+
+        m_pLightClusters->SetProjection(60.0f, WINDOW_WIDTH, WINDOW_HEIGHT, 0.1f, 100.0f);
+
+        std::vector<PointLight>& Lights = m_gridPointLights;
+        Lights.resize(CLUSTERED_LIGHTS_GRID_SIZE * CLUSTERED_LIGHTS_GRID_SIZE);
+        const float Spacing = 20.0f / CLUSTERED_LIGHTS_GRID_SIZE;
+
+        for (unsigned int i = 0 ; i < Lights.size() ; i++) {
+            const unsigned int x = i % CLUSTERED_LIGHTS_GRID_SIZE;
+            const unsigned int z = i / CLUSTERED_LIGHTS_GRID_SIZE;
+            Lights[i].Color = Vector3f((x & 1) ? 1.0f : 0.2f, (z & 1) ? 1.0f : 0.2f, ((x + z) % 3) ? 0.2f : 1.0f);
+            Lights[i].DiffuseIntensity = 0.5f;
+            Lights[i].Position = Vector3f(-10.0f + (x + 0.5f) * Spacing, -1.5f, -10.0f + (z + 0.5f) * Spacing);
+            Lights[i].Attenuation.Exp = 10.0f;
+        }
+
+        m_pLightClusters->SetPointLights(Lights.size(), &Lights[0]);
+
+        return true;
     }
 
 
-    GLuint m_VBO;
-    GLuint m_IBO;
-    LightingTechnique* m_pEffect;
-    Texture* m_pTexture;
+    Mesh* m_pFloor;
+    Mesh* m_pPackedFloor;
+    StaticScene* m_pStaticScene;
+    SceneBVH* m_pSceneBVH;
+    std::vector<unsigned int> m_visibleObjects;
+    unsigned int m_floorSceneMesh;
+    BoundingBox m_floorBox;
+    std::vector<Matrix4f> m_instanceWorlds;
+    GLuint m_instanceVBO;
+    GLuint m_patternVBO;
+    unsigned int m_numInstances;
+    bool m_instanced;
+    bool m_multiDraw;
+    unsigned int m_culling;
+    bool m_clustered;
+    bool m_deferred;
+    bool m_patterns;
+    bool m_packedVertices;
+    unsigned int m_floorPattern;
+    LightingParams* m_pLightingParams;
+    LightClusters* m_pLightClusters;
+    DeferredRenderer* m_pDeferredRenderer;
+    TextureArray* m_pPatterns;
+    Sampler* m_pFloorSampler;
+    std::vector<PointLight> m_gridPointLights;
+    LightingVariants* m_pEffects;
+    TechniqueRegistry* m_pTechniques;
+    RenderQueue* m_pRenderQueue;
+    TextureHandle m_texture;
+    TextureLoader* m_pTextureLoader;
+    TextureManager* m_pTextureManager;
     Camera* m_pGameCamera;
+    Pipeline m_pipeline;
     float m_scale;
     DirectionalLight m_directionalLight;
 };
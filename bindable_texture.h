@@ -0,0 +1,19 @@
+#ifndef BINDABLE_TEXTURE_H
+#define BINDABLE_TEXTURE_H
+
+#include <GL/glew.h>
+
+// Anything a draw can bind as its texture, so RenderQueue can sort and
+// bind textures of different kinds the same way
+class IBindableTexture
+{
+    public:
+        virtual ~IBindableTexture() {}
+
+        virtual void Bind(GLenum TextureUnit) = 0;
+
+        // The GL texture object, 0 while there is none
+        virtual GLuint GetTextureObj() const = 0;
+};
+
+#endif /* BINDABLE_TEXTURE_H */
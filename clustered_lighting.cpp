@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <thread>
+
+#include "clustered_lighting.h"
+#include "render_state.h"
+#pragma once
+
+// Every thread walks all the lights for its slices, so a thread is only
+// started for this many lights; below that starting it costs more than it
+// saves
+#define MIN_LIGHTS_PER_THREAD 64
+
+LightClusters::LightClusters()
+{
+    m_FOV    = 60.0f;
+    m_width  = 1.0f;
+    m_height = 1.0f;
+    m_zNear  = 0.1f;
+    m_zFar   = 100.0f;
+
+    for (unsigned int i = 0 ; i < 3 ; i++) {
+        m_buffers[i]  = 0;
+        m_textures[i] = 0;
+    }
+}
+
+LightClusters::~LightClusters()
+{
+    if (m_textures[0] != 0) {
+        RenderState::DeleteTextures(3, m_textures);
+    }
+
+    if (m_buffers[0] != 0) {
+        RenderState::DeleteBuffers(3, m_buffers);
+    }
+}
+
+bool LightClusters::Init()
+{
+    const GLenum Formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+
+    glGenBuffers(3, m_buffers);
+    glGenTextures(3, m_textures);
+
+    for (unsigned int i = 0 ; i < 3 ; i++) {
+        // glTexBuffer needs a buffer with storage, even an empty one
+        UploadTextureBuffer(m_buffers[i], NULL, 16);
+        RenderState::BindTexture(GL_TEXTURE0, GL_TEXTURE_BUFFER, m_textures[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, Formats[i], m_buffers[i]);
+    }
+
+    RenderState::BindTexture(GL_TEXTURE0, GL_TEXTURE_BUFFER, 0);
+
+    m_clusterLights.resize(NUM_CLUSTERS);
+    m_grid.resize(NUM_CLUSTERS * 2);
+    CalcClusterBounds();
+
+    if (glGetError() != GL_NO_ERROR) {
+        fprintf(stderr, "Error creating the light cluster buffers\n");
+        return false;
+    }
+
+    return true;
+}
+
+void LightClusters::SetProjection(float FOV, float Width, float Height, float zNear, float zFar)
+{
+    if (m_FOV == FOV && m_width == Width && m_height == Height && m_zNear == zNear && m_zFar == zFar) {
+        return;
+    }
+
+    m_FOV    = FOV;
+    m_width  = Width;
+    m_height = Height;
+    m_zNear  = zNear;
+    m_zFar   = zFar;
+
+    CalcClusterBounds();
+}
+
+LightClusters::ClusterLight LightClusters::MakeLight(const PointLight& Light, bool IsSpot, const Vector3f& Direction, float Cutoff)
+{
+    ClusterLight l;
+
+    l.Radius = CalcLightRadius(Light);
+
+    l.Position = Light.Position;
+
+    l.Texels[0] = Vector4f(Light.Position, IsSpot ? 1.0f : 0.0f);
+    l.Texels[1] = Vector4f(Light.Color, Light.DiffuseIntensity);
+    l.Texels[2] = Vector4f(Light.Attenuation.Constant, Light.Attenuation.Linear, Light.Attenuation.Exp, Light.AmbientIntensity);
+    l.Texels[3] = Vector4f(Direction, Cutoff);
+
+    return l;
+}
+
+void LightClusters::SetPointLights(unsigned int NumLights, const PointLight* pLights)
+{
+    m_pointLights.clear();
+
+    for (unsigned int i = 0 ; i < NumLights ; i++) {
+        m_pointLights.push_back(MakeLight(pLights[i], false, Vector3f(0.0f, 0.0f, 0.0f), 0.0f));
+    }
+}
+
+void LightClusters::SetSpotLights(unsigned int NumLights, const SpotLight* pLights)
+{
+    m_spotLights.clear();
+
+    for (unsigned int i = 0 ; i < NumLights ; i++) {
+        // Spot lights are culled by their full sphere, the cone is only
+        // applied in the shader
+        Vector3f Direction = pLights[i].Direction;
+        Direction.Normalize();
+        m_spotLights.push_back(MakeLight(pLights[i], true, Direction, cosf(ToRadian(pLights[i].Cutoff))));
+    }
+}
+
+// View space bounds of every cluster. View space looks down +z, and a tile
+// spans a fixed NDC range, so its x/y extent grows linearly with depth and
+// the box is given by the corners at the near and far depth of the slice.
+void LightClusters::CalcClusterBounds()
+{
+    m_clusterBounds.resize(NUM_CLUSTERS);
+
+    const float TanHalfFOV = tanf(ToRadian(m_FOV / 2.0f));
+    const float ScaleX = TanHalfFOV * m_width / m_height;
+    const float ScaleY = TanHalfFOV;
+
+    for (unsigned int s = 0 ; s < SLICES ; s++) {
+        const float zNear = m_zNear * powf(m_zFar / m_zNear, (float)s / SLICES);
+        const float zFar  = m_zNear * powf(m_zFar / m_zNear, (float)(s + 1) / SLICES);
+
+        for (unsigned int y = 0 ; y < TILES_Y ; y++) {
+            const float y0 = (-1.0f + 2.0f * y / TILES_Y) * ScaleY;
+            const float y1 = (-1.0f + 2.0f * (y + 1) / TILES_Y) * ScaleY;
+
+            for (unsigned int x = 0 ; x < TILES_X ; x++) {
+                const float x0 = (-1.0f + 2.0f * x / TILES_X) * ScaleX;
+                const float x1 = (-1.0f + 2.0f * (x + 1) / TILES_X) * ScaleX;
+
+                AABB& Box = m_clusterBounds[(s * TILES_Y + y) * TILES_X + x];
+                Box.Min = Vector3f(fminf(x0 * zNear, x0 * zFar), fminf(y0 * zNear, y0 * zFar), zNear);
+                Box.Max = Vector3f(fmaxf(x1 * zNear, x1 * zFar), fmaxf(y1 * zNear, y1 * zFar), zFar);
+            }
+        }
+    }
+}
+
+unsigned int LightClusters::GetSlice(float ViewZ) const
+{
+    // Written so that NaN lands in the first slice
+    if (!(ViewZ > m_zNear)) {
+        return 0;
+    }
+
+    // Compared as a float, since converting an infinite one is undefined
+    const float Slice = logf(ViewZ / m_zNear) / logf(m_zFar / m_zNear) * SLICES;
+
+    return Slice < SLICES ? (unsigned int)Slice : SLICES - 1;
+}
+
+void LightClusters::AssignLight(const ClusterLight& Light, unsigned int Index, unsigned int FirstSlice, unsigned int LastSlice)
+{
+    const Vector3f& c = Light.ViewPos;
+    const float r = Light.Radius;
+
+    if (c.z + r < m_zNear || c.z - r > m_zFar) {
+        return;
+    }
+
+    const unsigned int SliceBegin = GetSlice(c.z - r) > FirstSlice ? GetSlice(c.z - r) : FirstSlice;
+    const unsigned int SliceEnd   = GetSlice(c.z + r) + 1 < LastSlice ? GetSlice(c.z + r) + 1 : LastSlice;
+
+    for (unsigned int s = SliceBegin ; s < SliceEnd ; s++) {
+        for (unsigned int i = s * TILES_X * TILES_Y ; i < (s + 1) * TILES_X * TILES_Y ; i++) {
+            // Sphere against box: squared distance to the closest point
+            const AABB& Box = m_clusterBounds[i];
+            const float dx = fmaxf(fmaxf(Box.Min.x - c.x, 0.0f), c.x - Box.Max.x);
+            const float dy = fmaxf(fmaxf(Box.Min.y - c.y, 0.0f), c.y - Box.Max.y);
+            const float dz = fmaxf(fmaxf(Box.Min.z - c.z, 0.0f), c.z - Box.Max.z);
+
+            if (dx * dx + dy * dy + dz * dz <= r * r) {
+                m_clusterLights[i].push_back(Index);
+            }
+        }
+    }
+}
+
+void LightClusters::AssignSlices(unsigned int FirstSlice, unsigned int LastSlice)
+{
+    for (unsigned int i = FirstSlice * TILES_X * TILES_Y ; i < LastSlice * TILES_X * TILES_Y ; i++) {
+        m_clusterLights[i].clear();
+    }
+
+    for (unsigned int i = 0 ; i < m_pointLights.size() ; i++) {
+        AssignLight(m_pointLights[i], i, FirstSlice, LastSlice);
+    }
+
+    for (unsigned int i = 0 ; i < m_spotLights.size() ; i++) {
+        AssignLight(m_spotLights[i], m_pointLights.size() + i, FirstSlice, LastSlice);
+    }
+}
+
+void LightClusters::Update(const Matrix4f& View, unsigned int NumThreads)
+{
+    m_lightData.clear();
+
+    for (unsigned int i = 0 ; i < m_pointLights.size() + m_spotLights.size() ; i++) {
+        ClusterLight& l = i < m_pointLights.size() ? m_pointLights[i] : m_spotLights[i - m_pointLights.size()];
+        l.ViewPos = (View * Vector4f(l.Position, 1.0f)).to3f();
+        m_lightData.insert(m_lightData.end(), l.Texels, l.Texels + LIGHT_TEXELS);
+    }
+
+    // Slices are independent, so every thread owns a contiguous range of them
+    const unsigned int NumLights = m_pointLights.size() + m_spotLights.size();
+
+    if (NumThreads > NumLights / MIN_LIGHTS_PER_THREAD) {
+        NumThreads = NumLights / MIN_LIGHTS_PER_THREAD;
+    }
+
+    if (NumThreads > SLICES) {
+        NumThreads = SLICES;
+    }
+
+    if (NumThreads <= 1) {
+        AssignSlices(0, SLICES);
+    }
+    else {
+        std::vector<std::thread> Workers;
+        const unsigned int SlicesPerThread = (SLICES + NumThreads - 1) / NumThreads;
+
+        for (unsigned int First = SlicesPerThread ; First < SLICES ; First += SlicesPerThread) {
+            const unsigned int Last = First + SlicesPerThread < SLICES ? First + SlicesPerThread : SLICES;
+            Workers.push_back(std::thread(&LightClusters::AssignSlices, this, First, Last));
+        }
+
+        AssignSlices(0, SlicesPerThread);
+
+        for (unsigned int i = 0 ; i < Workers.size() ; i++) {
+            Workers[i].join();
+        }
+    }
+
+    m_indices.clear();
+
+    for (unsigned int i = 0 ; i < NUM_CLUSTERS ; i++) {
+        m_grid[i * 2]     = m_indices.size();
+        m_grid[i * 2 + 1] = m_clusterLights[i].size();
+        m_indices.insert(m_indices.end(), m_clusterLights[i].begin(), m_clusterLights[i].end());
+    }
+
+    UploadTextureBuffer(m_buffers[0], m_lightData.empty() ? NULL : &m_lightData[0], sizeof(Vector4f) * m_lightData.size());
+    UploadTextureBuffer(m_buffers[1], &m_grid[0], sizeof(unsigned int) * m_grid.size());
+    UploadTextureBuffer(m_buffers[2], m_indices.empty() ? NULL : &m_indices[0], sizeof(unsigned int) * m_indices.size());
+}
+
+void LightClusters::UploadTextureBuffer(GLuint Buffer, const void* pData, unsigned int Size)
+{
+    RenderState::BindBuffer(GL_TEXTURE_BUFFER, Buffer);
+
+    // Orphan the old storage so the upload does not wait for the GPU
+    glBufferData(GL_TEXTURE_BUFFER, Size > 16 ? Size : 16, NULL, GL_STREAM_DRAW);
+
+    if (pData) {
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, Size, pData);
+    }
+}
+
+void LightClusters::Bind(GLenum LightDataUnit, GLenum GridUnit, GLenum IndicesUnit)
+{
+    const GLenum Units[3] = { LightDataUnit, GridUnit, IndicesUnit };
+
+    for (unsigned int i = 0 ; i < 3 ; i++) {
+        RenderState::BindTexture(Units[i], GL_TEXTURE_BUFFER, m_textures[i]);
+    }
+}
@@ -0,0 +1,114 @@
+#ifndef CLUSTERED_LIGHTING_H
+#define	CLUSTERED_LIGHTING_H
+
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "math_3d.h"
+#include "lighting_technique.h"
+
+// Light lists for clustered forward shading. The view frustum is split into
+// TILES_X x TILES_Y screen tiles and SLICES exponential depth slices; every
+// frame each point and spot light is assigned to the clusters its sphere of
+// influence touches, so the fragment shader only loops over the lights of
+// its own cluster. Lights, the per-cluster (offset, count) grid and the
+// light index list are handed to the shader through texture buffers.
+class LightClusters
+{
+public:
+
+    static const unsigned int TILES_X = 16;
+    static const unsigned int TILES_Y = 8;
+    static const unsigned int SLICES = 24;
+    static const unsigned int NUM_CLUSTERS = TILES_X * TILES_Y * SLICES;
+
+    // Texels of gLightData per light
+    static const unsigned int LIGHT_TEXELS = 4;
+
+    LightClusters();
+
+    ~LightClusters();
+
+    bool Init();
+
+    void SetProjection(float FOV, float Width, float Height, float zNear, float zFar);
+
+    void SetPointLights(unsigned int NumLights, const PointLight* pLights);
+
+    void SetSpotLights(unsigned int NumLights, const SpotLight* pLights);
+
+    // Assigns the lights to clusters for the given view matrix and uploads
+    // the result. NumThreads > 1 splits the depth slices between threads.
+    void Update(const Matrix4f& View, unsigned int NumThreads = 1);
+
+    void Bind(GLenum LightDataUnit, GLenum GridUnit, GLenum IndicesUnit);
+
+    unsigned int GetNumLights() const
+    {
+        return m_pointLights.size() + m_spotLights.size();
+    }
+
+    float GetTileWidth() const
+    {
+        return m_width / TILES_X;
+    }
+
+    float GetTileHeight() const
+    {
+        return m_height / TILES_Y;
+    }
+
+    float GetNear() const
+    {
+        return m_zNear;
+    }
+
+    float GetFar() const
+    {
+        return m_zFar;
+    }
+
+private:
+
+    struct ClusterLight
+    {
+        Vector3f Position;
+        float Radius;
+        Vector3f ViewPos;
+        Vector4f Texels[LIGHT_TEXELS];
+    };
+
+    struct AABB
+    {
+        Vector3f Min;
+        Vector3f Max;
+    };
+
+    static ClusterLight MakeLight(const PointLight& Light, bool IsSpot, const Vector3f& Direction, float Cutoff);
+    void CalcClusterBounds();
+    void AssignSlices(unsigned int FirstSlice, unsigned int LastSlice);
+    void AssignLight(const ClusterLight& Light, unsigned int Index, unsigned int FirstSlice, unsigned int LastSlice);
+    unsigned int GetSlice(float ViewZ) const;
+    static void UploadTextureBuffer(GLuint Buffer, const void* pData, unsigned int Size);
+
+    float m_FOV;
+    float m_width;
+    float m_height;
+    float m_zNear;
+    float m_zFar;
+
+    std::vector<ClusterLight> m_pointLights;
+    std::vector<ClusterLight> m_spotLights;
+    std::vector<AABB> m_clusterBounds;
+    std::vector<std::vector<unsigned int> > m_clusterLights;
+
+    std::vector<Vector4f> m_lightData;
+    std::vector<unsigned int> m_grid;
+    std::vector<unsigned int> m_indices;
+
+    GLuint m_buffers[3];
+    GLuint m_textures[3];
+};
+
+#endif	/* CLUSTERED_LIGHTING_H */
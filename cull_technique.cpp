@@ -0,0 +1,114 @@
+#include "cull_technique.h"
+#include "render_state.h"
+
+static const char* pCullCS = "                                                      \n\
+#version 430                                                                        \n\
+                                                                                    \n\
+layout (local_size_x = 64) in;                                                      \n\
+                                                                                    \n\
+// DrawElementsIndirectCommand                                                      \n\
+struct DrawCommand                                                                  \n\
+{                                                                                   \n\
+    uint Count;                                                                     \n\
+    uint InstanceCount;                                                             \n\
+    uint FirstIndex;                                                                \n\
+    int BaseVertex;                                                                 \n\
+    uint BaseInstance;                                                              \n\
+};                                                                                  \n\
+                                                                                    \n\
+layout (std430, binding = 1) readonly buffer Commands                               \n\
+{                                                                                   \n\
+    DrawCommand gCommands[];                                                        \n\
+};                                                                                  \n\
+                                                                                    \n\
+// Bounding sphere of every object in world space, (center, radius)                 \n\
+layout (std430, binding = 2) readonly buffer Bounds                                 \n\
+{                                                                                   \n\
+    vec4 gSpheres[];                                                                \n\
+};                                                                                  \n\
+                                                                                    \n\
+layout (std430, binding = 3) writeonly buffer VisibleCommands                       \n\
+{                                                                                   \n\
+    DrawCommand gVisible[];                                                         \n\
+};                                                                                  \n\
+                                                                                    \n\
+layout (std430, binding = 4) buffer DrawCount                                       \n\
+{                                                                                   \n\
+    uint gDrawCount;                                                                \n\
+};                                                                                  \n\
+                                                                                    \n\
+uniform vec4 gPlanes[6];                                                            \n\
+uniform int gNumObjects;                                                            \n\
+                                                                                    \n\
+void main()                                                                         \n\
+{                                                                                   \n\
+    uint i = gl_GlobalInvocationID.x;                                               \n\
+                                                                                    \n\
+    if (i >= uint(gNumObjects)) {                                                   \n\
+        return;                                                                     \n\
+    }                                                                               \n\
+                                                                                    \n\
+    vec4 Sphere = gSpheres[i];                                                      \n\
+    bool Visible = true;                                                            \n\
+                                                                                    \n\
+    for (int p = 0 ; p < 6 ; p++) {                                                 \n\
+        if (dot(gPlanes[p].xyz, Sphere.xyz) + gPlanes[p].w < -Sphere.w) {           \n\
+            Visible = false;                                                        \n\
+        }                                                                           \n\
+    }                                                                               \n\
+                                                                                    \n\
+#ifdef COMPACT                                                                      \n\
+    if (Visible) {                                                                  \n\
+        gVisible[atomicAdd(gDrawCount, 1u)] = gCommands[i];                         \n\
+    }                                                                               \n\
+#else                                                                               \n\
+    DrawCommand Command = gCommands[i];                                             \n\
+    Command.InstanceCount = Visible ? 1u : 0u;                                      \n\
+    gVisible[i] = Command;                                                          \n\
+#endif                                                                              \n\
+}";
+
+CullTechnique::CullTechnique(bool Compact)
+{
+    m_compact = Compact;
+}
+
+bool CullTechnique::Init()
+{
+    if (!Technique::Init()) {
+        return false;
+    }
+
+    if (m_compact) {
+        AddDefine("COMPACT");
+    }
+
+    if (!AddShader(GL_COMPUTE_SHADER, pCullCS)) {
+        return false;
+    }
+
+    return Finalize();
+}
+
+bool CullTechnique::ResolveUniforms()
+{
+    m_planesLocation = GetUniformLocation("gPlanes");
+    m_numObjectsLocation = GetUniformLocation("gNumObjects");
+
+    if (m_planesLocation == INVALID_UNIFORM_LOCATION ||
+        m_numObjectsLocation == INVALID_UNIFORM_LOCATION) {
+        return false;
+    }
+
+    return true;
+}
+
+void CullTechnique::SetFrustum(const Frustum& f)
+{
+    RenderState::Uniform4fv(m_planesLocation, Frustum::NUM_PLANES, &f.Planes[0].x);
+}
+
+void CullTechnique::SetNumObjects(unsigned int NumObjects)
+{
+    RenderState::Uniform1i(m_numObjectsLocation, NumObjects);
+}
@@ -0,0 +1,44 @@
+#ifndef CULL_TECHNIQUE_H
+#define	CULL_TECHNIQUE_H
+
+#include "technique.h"
+#include "math_3d.h"
+
+// Compute pass testing the bounding sphere of every object against the
+// view frustum. Visible objects get their draw command copied to the
+// output buffer: packed to the front with the count in the draw count
+// buffer when compacting, otherwise in place with an instance count of 0
+// or 1.
+class CullTechnique : public Technique {
+public:
+
+    // Objects tested by one work group
+    static const unsigned int GROUP_SIZE = 64;
+
+    // Shader storage bindings
+    static const GLuint COMMANDS_BINDING = 1;
+    static const GLuint BOUNDS_BINDING = 2;
+    static const GLuint VISIBLE_BINDING = 3;
+    static const GLuint DRAW_COUNT_BINDING = 4;
+
+    CullTechnique(bool Compact);
+
+    virtual bool Init();
+
+    void SetFrustum(const Frustum& f);
+    void SetNumObjects(unsigned int NumObjects);
+
+protected:
+
+    virtual bool ResolveUniforms();
+
+private:
+
+    bool m_compact;
+
+    GLuint m_planesLocation;
+    GLuint m_numObjectsLocation;
+};
+
+
+#endif	/* CULL_TECHNIQUE_H */
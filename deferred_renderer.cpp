@@ -0,0 +1,342 @@
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+#include "deferred_renderer.h"
+#include "render_state.h"
+#include "util.h"
+
+// Light volumes wider than this part of the view distance cover most of the
+// screen anyway and are drawn as a full screen quad
+#define MAX_VOLUME_RADIUS_FACTOR 0.5f
+
+DeferredRenderer::DeferredRenderer() :
+    m_dirLightPassTech(DSLightPassTech::DIRECTIONAL_LIGHT),
+    m_pointLightPassTech(DSLightPassTech::POINT_LIGHT),
+    m_spotLightPassTech(DSLightPassTech::SPOT_LIGHT)
+{
+    m_windowWidth = 0;
+    m_windowHeight = 0;
+    m_zNear = 0.0f;
+    m_zFar = 0.0f;
+    m_sphereVAO = 0;
+    m_sphereVBO = 0;
+    m_sphereIBO = 0;
+    m_sphereNumIndices = 0;
+    m_sphereScale = 1.0f;
+    m_quadVAO = 0;
+    m_quadVBO = 0;
+    m_quadIBO = 0;
+}
+
+DeferredRenderer::~DeferredRenderer()
+{
+    if (m_sphereVBO != 0) {
+        RenderState::DeleteVertexArrays(1, &m_sphereVAO);
+        RenderState::DeleteBuffers(1, &m_sphereVBO);
+        RenderState::DeleteBuffers(1, &m_sphereIBO);
+    }
+
+    if (m_quadVBO != 0) {
+        RenderState::DeleteVertexArrays(1, &m_quadVAO);
+        RenderState::DeleteBuffers(1, &m_quadVBO);
+        RenderState::DeleteBuffers(1, &m_quadIBO);
+    }
+}
+
+bool DeferredRenderer::Init(unsigned int WindowWidth, unsigned int WindowHeight, float zNear, float zFar,
+                            TechniqueRegistry* pRegistry)
+{
+    m_windowWidth = WindowWidth;
+    m_windowHeight = WindowHeight;
+    m_zNear = zNear;
+    m_zFar = zFar;
+
+    if (!m_gbuffer.Init(WindowWidth, WindowHeight)) {
+        return false;
+    }
+
+    const char* pTechNames[] = { "null", "geometry pass", "directional light pass",
+                                 "point light pass", "spot light pass" };
+    Technique* pTechs[] = { &m_nullTech, &m_geomPassTech, &m_dirLightPassTech,
+                            &m_pointLightPassTech, &m_spotLightPassTech };
+
+    // Through the registry every program is submitted before waiting for
+    // any of them, so the driver can compile them concurrently
+    for (unsigned int i = 0 ; i < ARRAY_SIZE_IN_ELEMENTS(pTechs) ; i++) {
+        const bool Ok = pRegistry ? pRegistry->Add(pTechs[i]) : pTechs[i]->Init();
+
+        if (!Ok) {
+            printf("Error initializing the %s technique\n", pTechNames[i]);
+            return false;
+        }
+    }
+
+    for (unsigned int i = 0 ; pRegistry && i < ARRAY_SIZE_IN_ELEMENTS(pTechs) ; i++) {
+        if (!pRegistry->Finish(pTechs[i])) {
+            printf("Error initializing the %s technique\n", pTechNames[i]);
+            return false;
+        }
+    }
+
+    m_geomPassTech.Enable();
+    m_geomPassTech.SetColorTextureUnit(0);
+
+    DSLightPassTech* pLightPassTechs[] = { &m_dirLightPassTech, &m_pointLightPassTech, &m_spotLightPassTech };
+
+    for (unsigned int i = 0 ; i < ARRAY_SIZE_IN_ELEMENTS(pLightPassTechs) ; i++) {
+        pLightPassTechs[i]->Enable();
+        pLightPassTechs[i]->SetPositionTextureUnit(GBuffer::GBUFFER_TEXTURE_TYPE_POSITION);
+        pLightPassTechs[i]->SetColorTextureUnit(GBuffer::GBUFFER_TEXTURE_TYPE_DIFFUSE);
+        pLightPassTechs[i]->SetNormalTextureUnit(GBuffer::GBUFFER_TEXTURE_TYPE_NORMAL);
+        pLightPassTechs[i]->SetScreenSize(WindowWidth, WindowHeight);
+    }
+
+    // The quad is given directly in clip space
+    Matrix4f Identity;
+    Identity.InitIdentity();
+    m_dirLightPassTech.Enable();
+    m_dirLightPassTech.SetWVP(Identity);
+
+    CreateSphere(16, 12);
+    CreateQuad();
+
+    return true;
+}
+
+// Unit sphere, front faces (clockwise) looking out. The faces lie inside
+// the unit sphere, so m_sphereScale is set to make the mesh enclose it.
+void DeferredRenderer::CreateSphere(unsigned int Slices, unsigned int Stacks)
+{
+    std::vector<Vector3f> Vertices;
+
+    for (unsigned int st = 0 ; st <= Stacks ; st++) {
+        const float Theta = (float)M_PI * st / Stacks;
+
+        for (unsigned int sl = 0 ; sl < Slices ; sl++) {
+            const float Phi = 2.0f * (float)M_PI * sl / Slices;
+            Vertices.push_back(Vector3f(sinf(Theta) * cosf(Phi), cosf(Theta), sinf(Theta) * sinf(Phi)));
+        }
+    }
+
+    std::vector<unsigned int> Indices;
+
+    for (unsigned int st = 0 ; st < Stacks ; st++) {
+        for (unsigned int sl = 0 ; sl < Slices ; sl++) {
+            const unsigned int a = st * Slices + sl;
+            const unsigned int b = (st + 1) * Slices + sl;
+            const unsigned int c = (st + 1) * Slices + (sl + 1) % Slices;
+            const unsigned int d = st * Slices + (sl + 1) % Slices;
+
+            // The quads touching the poles collapse into a single triangle
+            if (st > 0) {
+                Indices.push_back(a);
+                Indices.push_back(d);
+                Indices.push_back(b);
+            }
+
+            if (st < Stacks - 1) {
+                Indices.push_back(b);
+                Indices.push_back(d);
+                Indices.push_back(c);
+            }
+        }
+    }
+
+    m_sphereNumIndices = Indices.size();
+    m_sphereScale = 1.0f / (cosf((float)M_PI / Slices) * cosf((float)M_PI / (2.0f * Stacks)));
+
+    glGenBuffers(1, &m_sphereVBO);
+    RenderState::BindBuffer(GL_ARRAY_BUFFER, m_sphereVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(Vector3f) * Vertices.size(), &Vertices[0], GL_STATIC_DRAW);
+
+    glGenBuffers(1, &m_sphereIBO);
+    RenderState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_sphereIBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * Indices.size(), &Indices[0], GL_STATIC_DRAW);
+
+    m_sphereVAO = CreateVAO(m_sphereVBO, m_sphereIBO);
+}
+
+void DeferredRenderer::CreateQuad()
+{
+    Vector3f Vertices[4] = { Vector3f(-1.0f, -1.0f, 0.0f),
+                             Vector3f(1.0f, -1.0f, 0.0f),
+                             Vector3f(1.0f, 1.0f, 0.0f),
+                             Vector3f(-1.0f, 1.0f, 0.0f) };
+
+    unsigned int Indices[] = { 0, 3, 2,
+                               0, 2, 1 };
+
+    glGenBuffers(1, &m_quadVBO);
+    RenderState::BindBuffer(GL_ARRAY_BUFFER, m_quadVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(Vertices), Vertices, GL_STATIC_DRAW);
+
+    glGenBuffers(1, &m_quadIBO);
+    RenderState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_quadIBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(Indices), Indices, GL_STATIC_DRAW);
+
+    m_quadVAO = CreateVAO(m_quadVBO, m_quadIBO);
+}
+
+// The volumes only have positions, at the location Mesh uses for them
+GLuint DeferredRenderer::CreateVAO(GLuint VBO, GLuint IBO)
+{
+    GLuint VAO;
+    glGenVertexArrays(1, &VAO);
+    RenderState::BindVertexArray(VAO);
+
+    RenderState::BindBuffer(GL_ARRAY_BUFFER, VBO);
+    glVertexAttribPointer(Mesh::POSITION_LOCATION, 3, GL_FLOAT, GL_FALSE, sizeof(Vector3f), 0);
+    glEnableVertexAttribArray(Mesh::POSITION_LOCATION);
+    RenderState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+
+    RenderState::BindVertexArray(0);
+
+    return VAO;
+}
+
+void DeferredRenderer::DrawMesh(GLuint VAO, unsigned int NumIndices)
+{
+    RenderState::BindVertexArray(VAO);
+    glDrawElements(GL_TRIANGLES, NumIndices, GL_UNSIGNED_INT, 0);
+}
+
+DSGeomPassTech* DeferredRenderer::BeginGeometryPass()
+{
+    m_gbuffer.StartFrame();
+    m_gbuffer.BindForGeomPass();
+
+    // Only the geometry pass updates the depth buffer
+    glDepthMask(GL_TRUE);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glEnable(GL_DEPTH_TEST);
+
+    m_geomPassTech.Enable();
+
+    return &m_geomPassTech;
+}
+
+void DeferredRenderer::EndGeometryPass()
+{
+    glDepthMask(GL_FALSE);
+}
+
+void DeferredRenderer::RenderLights(const Matrix4f& VP, const Vector3f& EyeWorldPos,
+                                    unsigned int NumPointLights, const PointLight* pPointLights,
+                                    unsigned int NumSpotLights, const SpotLight* pSpotLights)
+{
+    // Every light adds its contribution to the final image
+    glBlendEquation(GL_FUNC_ADD);
+    glBlendFunc(GL_ONE, GL_ONE);
+
+    for (unsigned int i = 0 ; i < NumPointLights ; i++) {
+        m_pointLightPassTech.Enable();
+        m_pointLightPassTech.SetPointLight(pPointLights[i]);
+        RenderLightVolume(&m_pointLightPassTech, pPointLights[i], VP, EyeWorldPos);
+    }
+
+    // Spot lights are bounded by the sphere of their radius, the cone is
+    // only applied in the shader
+    for (unsigned int i = 0 ; i < NumSpotLights ; i++) {
+        m_spotLightPassTech.Enable();
+        m_spotLightPassTech.SetSpotLight(pSpotLights[i]);
+        RenderLightVolume(&m_spotLightPassTech, pSpotLights[i], VP, EyeWorldPos);
+    }
+
+    RenderDirectionalLight();
+
+    glDisable(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
+}
+
+void DeferredRenderer::RenderLightVolume(DSLightPassTech* pTech, const PointLight& Light,
+                                         const Matrix4f& VP, const Vector3f& EyeWorldPos)
+{
+    const float Radius = CalcLightRadius(Light) * m_sphereScale;
+    const Vector3f ToEye = EyeWorldPos - Light.Position;
+
+    // When the near plane cuts the sphere its front faces go missing and
+    // the stencil test fails, so a light around the camera is drawn over
+    // the whole screen. The margin covers the corners of the near plane.
+    const float Margin = 2.0f * m_zNear;
+    const bool FullScreen = (Radius > m_zFar * MAX_VOLUME_RADIUS_FACTOR) ||
+                            (ToEye.x * ToEye.x + ToEye.y * ToEye.y + ToEye.z * ToEye.z < (Radius + Margin) * (Radius + Margin));
+
+    if (FullScreen) {
+        Matrix4f Identity;
+        Identity.InitIdentity();
+        pTech->SetWVP(Identity);
+
+        m_gbuffer.BindForLightPass();
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_STENCIL_TEST);
+        glEnable(GL_BLEND);
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_BACK);
+        DrawMesh(m_quadVAO, 6);
+        return;
+    }
+
+    Matrix4f World;
+    World.InitWorldTransform(Vector3f(Radius, Radius, Radius), Vector3f(0.0f, 0.0f, 0.0f), Light.Position);
+    const Matrix4f WVP = VP * World;
+
+    // Stencil pass: a pixel is inside the volume when the geometry there
+    // is behind the front faces of the sphere but in front of its back
+    // faces. Back faces failing the depth test increment, front faces
+    // failing it decrement, so only such pixels end up non-zero.
+    m_nullTech.Enable();
+    m_nullTech.SetWVP(WVP);
+
+    m_gbuffer.BindForStencilPass();
+    glEnable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_BLEND);
+    glEnable(GL_STENCIL_TEST);
+    glClear(GL_STENCIL_BUFFER_BIT);
+    glStencilFunc(GL_ALWAYS, 0, 0);
+    glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+    glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+
+    DrawMesh(m_sphereVAO, m_sphereNumIndices);
+
+    // Light pass: the back faces are used so the volume is still drawn
+    // once the camera gets close to it
+    pTech->Enable();
+    pTech->SetWVP(WVP);
+
+    m_gbuffer.BindForLightPass();
+    glStencilFunc(GL_NOTEQUAL, 0, 0xFF);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_FRONT);
+
+    DrawMesh(m_sphereVAO, m_sphereNumIndices);
+
+    glCullFace(GL_BACK);
+    glDisable(GL_STENCIL_TEST);
+}
+
+void DeferredRenderer::RenderDirectionalLight()
+{
+    m_dirLightPassTech.Enable();
+
+    m_gbuffer.BindForLightPass();
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
+
+    DrawMesh(m_quadVAO, 6);
+}
+
+void DeferredRenderer::Present()
+{
+    m_gbuffer.BindForFinalPass();
+    glBlitFramebuffer(0, 0, m_windowWidth, m_windowHeight,
+                      0, 0, m_windowWidth, m_windowHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
@@ -0,0 +1,84 @@
+#ifndef DEFERRED_RENDERER_H
+#define	DEFERRED_RENDERER_H
+
+#include <GL/glew.h>
+
+#include "math_3d.h"
+#include "gbuffer.h"
+#include "mesh.h"
+#include "null_technique.h"
+#include "ds_geom_pass_tech.h"
+#include "ds_light_pass_tech.h"
+#include "lighting_technique.h"
+#include "technique_registry.h"
+
+// Deferred shading: the scene is drawn once into the G-buffer and every
+// light then shades only the pixels it can reach. The directional light is
+// a full screen quad; point and spot lights are spheres of their
+// attenuation radius, first marked in the stencil buffer where they
+// actually contain geometry and then lit only there.
+//
+// Per frame:
+//     BeginGeometryPass(), draw the scene with the returned technique,
+//     EndGeometryPass(), RenderLights(), Present().
+// The directional light, eye position and material come from the shared
+// LightingParams uniform blocks, which must be up to date.
+class DeferredRenderer
+{
+public:
+
+    DeferredRenderer();
+
+    ~DeferredRenderer();
+
+    // With a registry the techniques are compiled concurrently (and along
+    // with whatever else the registry is building)
+    bool Init(unsigned int WindowWidth, unsigned int WindowHeight, float zNear, float zFar,
+              TechniqueRegistry* pRegistry = NULL);
+
+    DSGeomPassTech* BeginGeometryPass();
+
+    void EndGeometryPass();
+
+    void RenderLights(const Matrix4f& VP, const Vector3f& EyeWorldPos,
+                      unsigned int NumPointLights, const PointLight* pPointLights,
+                      unsigned int NumSpotLights, const SpotLight* pSpotLights);
+
+    void Present();
+
+private:
+
+    void CreateSphere(unsigned int Slices, unsigned int Stacks);
+    void CreateQuad();
+    GLuint CreateVAO(GLuint VBO, GLuint IBO);
+    void DrawMesh(GLuint VAO, unsigned int NumIndices);
+
+    void RenderDirectionalLight();
+    void RenderLightVolume(DSLightPassTech* pTech, const PointLight& Light,
+                           const Matrix4f& VP, const Vector3f& EyeWorldPos);
+
+    unsigned int m_windowWidth;
+    unsigned int m_windowHeight;
+    float m_zNear;
+    float m_zFar;
+
+    GBuffer m_gbuffer;
+    NullTechnique m_nullTech;
+    DSGeomPassTech m_geomPassTech;
+    DSLightPassTech m_dirLightPassTech;
+    DSLightPassTech m_pointLightPassTech;
+    DSLightPassTech m_spotLightPassTech;
+
+    GLuint m_sphereVAO;
+    GLuint m_sphereVBO;
+    GLuint m_sphereIBO;
+    unsigned int m_sphereNumIndices;
+    float m_sphereScale;
+
+    GLuint m_quadVAO;
+    GLuint m_quadVBO;
+    GLuint m_quadIBO;
+};
+
+
+#endif	/* DEFERRED_RENDERER_H */
@@ -0,0 +1,114 @@
+#include "ds_geom_pass_tech.h"
+#include "render_state.h"
+#include "render_queue.h"
+#include "lighting_technique.h"
+
+static const char* pGeomPassVS = "                                                  \n\
+#version 330                                                                        \n\
+                                                                                    \n\
+layout (location = 0) in vec3 Position;                                             \n\
+layout (location = 1) in vec2 TexCoord;                                             \n\
+layout (location = 2) in vec3 Normal;                                               \n\
+                                                                                    \n\
+uniform mat4 gWVP;                                                                  \n\
+uniform mat4 gWorld;                                                                \n\
+                                                                                    \n\
+out vec2 TexCoord0;                                                                 \n\
+out vec3 Normal0;                                                                   \n\
+out vec3 WorldPos0;                                                                 \n\
+                                                                                    \n\
+void main()                                                                         \n\
+{                                                                                   \n\
+    gl_Position = gWVP * vec4(Position, 1.0);                                       \n\
+    TexCoord0   = TexCoord;                                                         \n\
+    Normal0     = (gWorld * vec4(Normal, 0.0)).xyz;                                 \n\
+    WorldPos0   = (gWorld * vec4(Position, 1.0)).xyz;                               \n\
+}";
+
+static const char* pGeomPassFS = "                                                  \n\
+#version 330                                                                        \n\
+                                                                                    \n\
+in vec2 TexCoord0;                                                                  \n\
+in vec3 Normal0;                                                                    \n\
+in vec3 WorldPos0;                                                                  \n\
+                                                                                    \n\
+layout (location = 0) out vec3 WorldPosOut;                                         \n\
+layout (location = 1) out vec4 DiffuseOut;                                          \n\
+layout (location = 2) out vec4 NormalOut;                                           \n\
+                                                                                    \n\
+layout (std140) uniform Material                                                    \n\
+{                                                                                   \n\
+    float gMatSpecularIntensity;                                                    \n\
+    float gSpecularPower;                                                           \n\
+};                                                                                  \n\
+                                                                                    \n\
+uniform sampler2D gColorMap;                                                        \n\
+                                                                                    \n\
+void main()                                                                         \n\
+{                                                                                   \n\
+    WorldPosOut = WorldPos0;                                                        \n\
+    DiffuseOut  = vec4(texture(gColorMap, TexCoord0).rgb, gMatSpecularIntensity);   \n\
+    NormalOut   = vec4(normalize(Normal0), gSpecularPower);                         \n\
+}";
+
+
+DSGeomPassTech::DSGeomPassTech()
+{
+}
+
+bool DSGeomPassTech::Init()
+{
+    if (!Technique::Init()) {
+        return false;
+    }
+
+    if (!AddShader(GL_VERTEX_SHADER, pGeomPassVS)) {
+        return false;
+    }
+
+    if (!AddShader(GL_FRAGMENT_SHADER, pGeomPassFS)) {
+        return false;
+    }
+
+    return Finalize();
+}
+
+bool DSGeomPassTech::ResolveUniforms()
+{
+    m_WVPLocation = GetUniformLocation("gWVP");
+    m_WorldMatrixLocation = GetUniformLocation("gWorld");
+    m_colorTextureUnitLocation = GetUniformLocation("gColorMap");
+
+    if (m_WVPLocation == INVALID_UNIFORM_LOCATION ||
+        m_WorldMatrixLocation == INVALID_UNIFORM_LOCATION ||
+        m_colorTextureUnitLocation == INVALID_UNIFORM_LOCATION) {
+        return false;
+    }
+
+    if (!BindUniformBlock("Material", LightingParams::MATERIAL_BINDING)) {
+        return false;
+    }
+
+    return true;
+}
+
+void DSGeomPassTech::SetWVP(const Matrix4f& WVP)
+{
+    RenderState::UniformMatrix4fv(m_WVPLocation, 1, GL_TRUE, (const GLfloat*)WVP.m);
+}
+
+void DSGeomPassTech::SetWorldMatrix(const Matrix4f& World)
+{
+    RenderState::UniformMatrix4fv(m_WorldMatrixLocation, 1, GL_TRUE, (const GLfloat*)World.m);
+}
+
+void DSGeomPassTech::SetDrawParams(const DrawParams& Params)
+{
+    SetWVP(Params.WVP);
+    SetWorldMatrix(Params.World);
+}
+
+void DSGeomPassTech::SetColorTextureUnit(unsigned int TextureUnit)
+{
+    RenderState::Uniform1i(m_colorTextureUnitLocation, TextureUnit);
+}
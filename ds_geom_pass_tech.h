@@ -0,0 +1,35 @@
+#ifndef DS_GEOM_PASS_TECH_H
+#define	DS_GEOM_PASS_TECH_H
+
+#include "technique.h"
+#include "math_3d.h"
+
+// Geometry pass of the deferred renderer: writes world position, diffuse
+// color and normal of the visible surfaces into the G-buffer. The specular
+// parameters are taken from the shared "Material" uniform block and stored
+// in the alpha channels, so the light passes can shade per pixel.
+class DSGeomPassTech : public Technique {
+public:
+
+    DSGeomPassTech();
+
+    virtual bool Init();
+
+    void SetWVP(const Matrix4f& WVP);
+    void SetWorldMatrix(const Matrix4f& World);
+    void SetColorTextureUnit(unsigned int TextureUnit);
+
+    virtual void SetDrawParams(const DrawParams& Params);
+
+protected:
+
+    virtual bool ResolveUniforms();
+
+private:
+
+    GLuint m_WVPLocation;
+    GLuint m_WorldMatrixLocation;
+    GLuint m_colorTextureUnitLocation;
+};
+
+#endif	/* DS_GEOM_PASS_TECH_H */
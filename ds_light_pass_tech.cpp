@@ -0,0 +1,289 @@
+#include <string.h>
+
+#include "ds_light_pass_tech.h"
+#include "render_state.h"
+
+static const char* pLightPassVS = "                                                 \n\
+#version 330                                                                        \n\
+                                                                                    \n\
+layout (location = 0) in vec3 Position;                                             \n\
+                                                                                    \n\
+uniform mat4 gWVP;                                                                  \n\
+                                                                                    \n\
+void main()                                                                         \n\
+{                                                                                   \n\
+    gl_Position = gWVP * vec4(Position, 1.0);                                       \n\
+}";
+
+// Compiled after "#version" and a "#define" naming the light type
+static const char* pLightPassFS = "                                                         \n\
+const int MAX_POINT_LIGHTS = 2;                                                             \n\
+const int MAX_SPOT_LIGHTS = 2;                                                              \n\
+                                                                                            \n\
+out vec4 FragColor;                                                                         \n\
+                                                                                            \n\
+struct BaseLight                                                                            \n\
+{                                                                                           \n\
+    vec3 Color;                                                                             \n\
+    float AmbientIntensity;                                                                 \n\
+    float DiffuseIntensity;                                                                 \n\
+};                                                                                          \n\
+                                                                                            \n\
+struct DirectionalLight                                                                     \n\
+{                                                                                           \n\
+    struct BaseLight Base;                                                                  \n\
+    vec3 Direction;                                                                         \n\
+};                                                                                          \n\
+                                                                                            \n\
+struct Attenuation                                                                          \n\
+{                                                                                           \n\
+    float Constant;                                                                         \n\
+    float Linear;                                                                           \n\
+    float Exp;                                                                              \n\
+};                                                                                          \n\
+                                                                                            \n\
+struct PointLight                                                                           \n\
+{                                                                                           \n\
+    struct BaseLight Base;                                                                  \n\
+    vec3 Position;                                                                          \n\
+    Attenuation Atten;                                                                      \n\
+};                                                                                          \n\
+                                                                                            \n\
+struct SpotLight                                                                            \n\
+{                                                                                           \n\
+    struct PointLight Base;                                                                 \n\
+    vec3 Direction;                                                                         \n\
+    float Cutoff;                                                                           \n\
+};                                                                                          \n\
+                                                                                            \n\
+layout (std140) uniform Lights                                                              \n\
+{                                                                                           \n\
+    DirectionalLight gDirectionalLight;                                                     \n\
+    PointLight gPointLights[MAX_POINT_LIGHTS];                                              \n\
+    SpotLight gSpotLights[MAX_SPOT_LIGHTS];                                                 \n\
+    vec3 gEyeWorldPos;                                                                      \n\
+    int gNumPointLights;                                                                    \n\
+    int gNumSpotLights;                                                                     \n\
+};                                                                                          \n\
+                                                                                            \n\
+uniform sampler2D gPositionMap;                                                             \n\
+uniform sampler2D gColorMap;                                                                \n\
+uniform sampler2D gNormalMap;                                                               \n\
+uniform vec2 gScreenSize;                                                                   \n\
+                                                                                            \n\
+// Point or spot light packed as in LightClusters: (position, is spot),                     \n\
+// (color, diffuse), (attenuation, ambient), (direction, cos cutoff)                        \n\
+uniform vec4 gLight[4];                                                                     \n\
+                                                                                            \n\
+vec3 WorldPos;                                                                              \n\
+float SpecularIntensity;                                                                    \n\
+float SpecularPower;                                                                        \n\
+                                                                                            \n\
+vec4 CalcLightInternal(BaseLight Light, vec3 LightDirection, vec3 Normal)                   \n\
+{                                                                                           \n\
+    vec4 AmbientColor = vec4(Light.Color, 1.0f) * Light.AmbientIntensity;                   \n\
+    float DiffuseFactor = dot(Normal, -LightDirection);                                     \n\
+                                                                                            \n\
+    vec4 DiffuseColor  = vec4(0, 0, 0, 0);                                                  \n\
+    vec4 SpecularColor = vec4(0, 0, 0, 0);                                                  \n\
+                                                                                            \n\
+    if (DiffuseFactor > 0) {                                                                \n\
+        DiffuseColor = vec4(Light.Color, 1.0f) * Light.DiffuseIntensity * DiffuseFactor;    \n\
+                                                                                            \n\
+        vec3 VertexToEye = normalize(gEyeWorldPos - WorldPos);                              \n\
+        vec3 LightReflect = normalize(reflect(LightDirection, Normal));                     \n\
+        float SpecularFactor = dot(VertexToEye, LightReflect);                              \n\
+        SpecularFactor = pow(SpecularFactor, SpecularPower);                                \n\
+        if (SpecularFactor > 0) {                                                           \n\
+            SpecularColor = vec4(Light.Color, 1.0f) *                                       \n\
+                            SpecularIntensity * SpecularFactor;                             \n\
+        }                                                                                   \n\
+    }                                                                                       \n\
+                                                                                            \n\
+    return (AmbientColor + DiffuseColor + SpecularColor);                                   \n\
+}                                                                                           \n\
+                                                                                            \n\
+vec4 CalcPointLight(PointLight l, vec3 Normal)                                              \n\
+{                                                                                           \n\
+    vec3 LightDirection = WorldPos - l.Position;                                            \n\
+    float Distance = length(LightDirection);                                                \n\
+    LightDirection = normalize(LightDirection);                                             \n\
+                                                                                            \n\
+    vec4 Color = CalcLightInternal(l.Base, LightDirection, Normal);                         \n\
+    float Attenuation =  l.Atten.Constant +                                                 \n\
+                         l.Atten.Linear * Distance +                                        \n\
+                         l.Atten.Exp * Distance * Distance;                                 \n\
+                                                                                            \n\
+    return Color / Attenuation;                                                             \n\
+}                                                                                           \n\
+                                                                                            \n\
+vec4 CalcSpotLight(SpotLight l, vec3 Normal)                                                \n\
+{                                                                                           \n\
+    vec3 LightToPixel = normalize(WorldPos - l.Base.Position);                              \n\
+    float SpotFactor = dot(LightToPixel, l.Direction);                                      \n\
+                                                                                            \n\
+    if (SpotFactor > l.Cutoff) {                                                            \n\
+        vec4 Color = CalcPointLight(l.Base, Normal);                                        \n\
+        return Color * (1.0 - (1.0 - SpotFactor) * 1.0/(1.0 - l.Cutoff));                   \n\
+    }                                                                                       \n\
+    else {                                                                                  \n\
+        return vec4(0,0,0,0);                                                               \n\
+    }                                                                                       \n\
+}                                                                                           \n\
+                                                                                            \n\
+void main()                                                                                 \n\
+{                                                                                           \n\
+    vec2 TexCoord = gl_FragCoord.xy / gScreenSize;                                          \n\
+    vec4 ColorSpecular = texture(gColorMap, TexCoord);                                      \n\
+    vec4 NormalPower = texture(gNormalMap, TexCoord);                                       \n\
+                                                                                            \n\
+    WorldPos = texture(gPositionMap, TexCoord).xyz;                                         \n\
+    SpecularIntensity = ColorSpecular.a;                                                    \n\
+    SpecularPower = NormalPower.a;                                                          \n\
+                                                                                            \n\
+    // Pixels not covered by the geometry pass have nothing to light                        \n\
+    if (NormalPower.xyz == vec3(0.0)) {                                                     \n\
+        discard;                                                                            \n\
+    }                                                                                       \n\
+                                                                                            \n\
+    vec3 Normal = normalize(NormalPower.xyz);                                               \n\
+                                                                                            \n\
+#ifdef DIRECTIONAL_LIGHT                                                                    \n\
+    vec4 Light = CalcLightInternal(gDirectionalLight.Base, gDirectionalLight.Direction, Normal);\n\
+#else                                                                                       \n\
+    PointLight p;                                                                           \n\
+    p.Base.Color = gLight[1].rgb;                                                           \n\
+    p.Base.AmbientIntensity = gLight[2].w;                                                  \n\
+    p.Base.DiffuseIntensity = gLight[1].w;                                                  \n\
+    p.Position = gLight[0].xyz;                                                             \n\
+    p.Atten.Constant = gLight[2].x;                                                         \n\
+    p.Atten.Linear = gLight[2].y;                                                           \n\
+    p.Atten.Exp = gLight[2].z;                                                              \n\
+#ifdef SPOT_LIGHT                                                                           \n\
+    SpotLight l;                                                                            \n\
+    l.Base = p;                                                                             \n\
+    l.Direction = gLight[3].xyz;                                                            \n\
+    l.Cutoff = gLight[3].w;                                                                 \n\
+    vec4 Light = CalcSpotLight(l, Normal);                                                  \n\
+#else                                                                                       \n\
+    vec4 Light = CalcPointLight(p, Normal);                                                 \n\
+#endif                                                                                      \n\
+#endif                                                                                      \n\
+                                                                                            \n\
+    FragColor = vec4(ColorSpecular.rgb, 1.0) * Light;                                       \n\
+}";
+
+
+DSLightPassTech::DSLightPassTech(LIGHT_TYPE LightType)
+{
+    m_lightType = LightType;
+}
+
+bool DSLightPassTech::Init()
+{
+    if (!Technique::Init()) {
+        return false;
+    }
+
+    if (!AddShader(GL_VERTEX_SHADER, pLightPassVS)) {
+        return false;
+    }
+
+    const char* pDefines[] = { "#define DIRECTIONAL_LIGHT\n",
+                               "#define POINT_LIGHT\n",
+                               "#define SPOT_LIGHT\n" };
+
+    const char* pFSTexts[3] = { "#version 330\n", pDefines[m_lightType], pLightPassFS };
+
+    if (!AddShader(GL_FRAGMENT_SHADER, pFSTexts, 3)) {
+        return false;
+    }
+
+    return Finalize();
+}
+
+bool DSLightPassTech::ResolveUniforms()
+{
+    m_WVPLocation = GetUniformLocation("gWVP");
+    m_posTextureUnitLocation = GetUniformLocation("gPositionMap");
+    m_colorTextureUnitLocation = GetUniformLocation("gColorMap");
+    m_normalTextureUnitLocation = GetUniformLocation("gNormalMap");
+    m_screenSizeLocation = GetUniformLocation("gScreenSize");
+
+    if (m_WVPLocation == INVALID_UNIFORM_LOCATION ||
+        m_posTextureUnitLocation == INVALID_UNIFORM_LOCATION ||
+        m_colorTextureUnitLocation == INVALID_UNIFORM_LOCATION ||
+        m_normalTextureUnitLocation == INVALID_UNIFORM_LOCATION ||
+        m_screenSizeLocation == INVALID_UNIFORM_LOCATION) {
+        return false;
+    }
+
+    if (m_lightType == DIRECTIONAL_LIGHT) {
+        m_lightLocation = INVALID_UNIFORM_LOCATION;
+    }
+    else {
+        m_lightLocation = GetUniformLocation("gLight");
+
+        if (m_lightLocation == INVALID_UNIFORM_LOCATION) {
+            return false;
+        }
+    }
+
+    if (!BindUniformBlock("Lights", LightingParams::LIGHTS_BINDING)) {
+        return false;
+    }
+
+    return true;
+}
+
+void DSLightPassTech::SetWVP(const Matrix4f& WVP)
+{
+    RenderState::UniformMatrix4fv(m_WVPLocation, 1, GL_TRUE, (const GLfloat*)WVP.m);
+}
+
+void DSLightPassTech::SetPositionTextureUnit(unsigned int TextureUnit)
+{
+    RenderState::Uniform1i(m_posTextureUnitLocation, TextureUnit);
+}
+
+void DSLightPassTech::SetColorTextureUnit(unsigned int TextureUnit)
+{
+    RenderState::Uniform1i(m_colorTextureUnitLocation, TextureUnit);
+}
+
+void DSLightPassTech::SetNormalTextureUnit(unsigned int TextureUnit)
+{
+    RenderState::Uniform1i(m_normalTextureUnitLocation, TextureUnit);
+}
+
+void DSLightPassTech::SetScreenSize(unsigned int Width, unsigned int Height)
+{
+    RenderState::Uniform2f(m_screenSizeLocation, (float)Width, (float)Height);
+}
+
+void DSLightPassTech::SetPointLight(const PointLight& Light)
+{
+    const Vector4f Packed[4] = {
+        Vector4f(Light.Position, 0.0f),
+        Vector4f(Light.Color, Light.DiffuseIntensity),
+        Vector4f(Light.Attenuation.Constant, Light.Attenuation.Linear, Light.Attenuation.Exp, Light.AmbientIntensity),
+        Vector4f(0.0f, 0.0f, 0.0f, 0.0f)
+    };
+
+    RenderState::Uniform4fv(m_lightLocation, 4, &Packed[0].x);
+}
+
+void DSLightPassTech::SetSpotLight(const SpotLight& Light)
+{
+    Vector3f Direction = Light.Direction;
+    Direction.Normalize();
+
+    const Vector4f Packed[4] = {
+        Vector4f(Light.Position, 1.0f),
+        Vector4f(Light.Color, Light.DiffuseIntensity),
+        Vector4f(Light.Attenuation.Constant, Light.Attenuation.Linear, Light.Attenuation.Exp, Light.AmbientIntensity),
+        Vector4f(Direction, cosf(ToRadian(Light.Cutoff)))
+    };
+
+    RenderState::Uniform4fv(m_lightLocation, 4, &Packed[0].x);
+}
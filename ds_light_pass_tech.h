@@ -0,0 +1,50 @@
+#ifndef DS_LIGHT_PASS_TECH_H
+#define	DS_LIGHT_PASS_TECH_H
+
+#include "technique.h"
+#include "math_3d.h"
+#include "lighting_technique.h"
+
+// Light pass of the deferred renderer. Reads the G-buffer at the current
+// pixel and adds the contribution of one light. The directional light comes
+// from the shared "Lights" block and is drawn as a full screen quad; point
+// and spot lights are set per draw and drawn as light volumes.
+class DSLightPassTech : public Technique {
+public:
+
+    enum LIGHT_TYPE {
+        DIRECTIONAL_LIGHT,
+        POINT_LIGHT,
+        SPOT_LIGHT
+    };
+
+    DSLightPassTech(LIGHT_TYPE LightType);
+
+    virtual bool Init();
+
+    void SetWVP(const Matrix4f& WVP);
+    void SetPositionTextureUnit(unsigned int TextureUnit);
+    void SetColorTextureUnit(unsigned int TextureUnit);
+    void SetNormalTextureUnit(unsigned int TextureUnit);
+    void SetScreenSize(unsigned int Width, unsigned int Height);
+    void SetPointLight(const PointLight& Light);
+    void SetSpotLight(const SpotLight& Light);
+
+protected:
+
+    virtual bool ResolveUniforms();
+
+private:
+
+    LIGHT_TYPE m_lightType;
+
+    GLuint m_WVPLocation;
+    GLuint m_posTextureUnitLocation;
+    GLuint m_colorTextureUnitLocation;
+    GLuint m_normalTextureUnitLocation;
+    GLuint m_screenSizeLocation;
+    GLuint m_lightLocation;
+};
+
+
+#endif	/* DS_LIGHT_PASS_TECH_H */
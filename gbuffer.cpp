@@ -0,0 +1,121 @@
+#include <stdio.h>
+
+#include "gbuffer.h"
+#include "render_state.h"
+#include "util.h"
+
+// The final image lives right after the G-buffer textures
+#define GBUFFER_FINAL_ATTACHMENT (GL_COLOR_ATTACHMENT0 + GBUFFER_NUM_TEXTURES)
+
+GBuffer::GBuffer()
+{
+    m_fbo = 0;
+    m_depthTexture = 0;
+    m_finalTexture = 0;
+
+    for (unsigned int i = 0 ; i < ARRAY_SIZE_IN_ELEMENTS(m_textures) ; i++) {
+        m_textures[i] = 0;
+    }
+}
+
+GBuffer::~GBuffer()
+{
+    if (m_fbo != 0) {
+        glDeleteFramebuffers(1, &m_fbo);
+    }
+
+    if (m_textures[0] != 0) {
+        RenderState::DeleteTextures(ARRAY_SIZE_IN_ELEMENTS(m_textures), m_textures);
+    }
+
+    if (m_depthTexture != 0) {
+        RenderState::DeleteTextures(1, &m_depthTexture);
+    }
+
+    if (m_finalTexture != 0) {
+        RenderState::DeleteTextures(1, &m_finalTexture);
+    }
+}
+
+bool GBuffer::Init(unsigned int WindowWidth, unsigned int WindowHeight)
+{
+    glGenFramebuffers(1, &m_fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_fbo);
+
+    glGenTextures(ARRAY_SIZE_IN_ELEMENTS(m_textures), m_textures);
+    glGenTextures(1, &m_depthTexture);
+    glGenTextures(1, &m_finalTexture);
+
+    // Position needs full precision, the rest fits in half floats
+    const GLenum Formats[GBUFFER_NUM_TEXTURES] = { GL_RGB32F, GL_RGBA16F, GL_RGBA16F };
+
+    for (unsigned int i = 0 ; i < ARRAY_SIZE_IN_ELEMENTS(m_textures) ; i++) {
+        RenderState::BindTexture(GL_TEXTURE0, GL_TEXTURE_2D, m_textures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, Formats[i], WindowWidth, WindowHeight, 0, GL_RGBA, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, m_textures[i], 0);
+    }
+
+    RenderState::BindTexture(GL_TEXTURE0, GL_TEXTURE_2D, m_depthTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH32F_STENCIL8, WindowWidth, WindowHeight, 0, GL_DEPTH_STENCIL,
+                 GL_FLOAT_32_UNSIGNED_INT_24_8_REV, NULL);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, m_depthTexture, 0);
+
+    RenderState::BindTexture(GL_TEXTURE0, GL_TEXTURE_2D, m_finalTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, WindowWidth, WindowHeight, 0, GL_RGB, GL_FLOAT, NULL);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GBUFFER_FINAL_ATTACHMENT, GL_TEXTURE_2D, m_finalTexture, 0);
+
+    GLenum Status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+
+    if (Status != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "FB error, status: 0x%x\n", Status);
+        return false;
+    }
+
+    return true;
+}
+
+void GBuffer::StartFrame()
+{
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_fbo);
+    glDrawBuffer(GBUFFER_FINAL_ATTACHMENT);
+    glClear(GL_COLOR_BUFFER_BIT);
+}
+
+void GBuffer::BindForGeomPass()
+{
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_fbo);
+
+    GLenum DrawBuffers[] = { GL_COLOR_ATTACHMENT0,
+                             GL_COLOR_ATTACHMENT1,
+                             GL_COLOR_ATTACHMENT2 };
+
+    glDrawBuffers(ARRAY_SIZE_IN_ELEMENTS(DrawBuffers), DrawBuffers);
+}
+
+void GBuffer::BindForStencilPass()
+{
+    // Only the stencil is written, so no color output is needed
+    glDrawBuffer(GL_NONE);
+}
+
+void GBuffer::BindForLightPass()
+{
+    glDrawBuffer(GBUFFER_FINAL_ATTACHMENT);
+
+    // A sampler left on the unit would override the nearest filtering
+    for (unsigned int i = 0 ; i < ARRAY_SIZE_IN_ELEMENTS(m_textures) ; i++) {
+        RenderState::BindTexture(GL_TEXTURE0 + i, GL_TEXTURE_2D, m_textures[i]);
+        RenderState::BindSampler(GL_TEXTURE0 + i, 0);
+    }
+}
+
+void GBuffer::BindForFinalPass()
+{
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo);
+    glReadBuffer(GBUFFER_FINAL_ATTACHMENT);
+}
@@ -0,0 +1,45 @@
+#ifndef GBUFFER_H
+#define	GBUFFER_H
+
+#include <GL/glew.h>
+
+// Render targets of the deferred renderer: world position, diffuse color
+// (specular intensity in alpha) and normal (specular power in alpha) written
+// by the geometry pass, a depth/stencil buffer used to bound the light
+// volumes, and the final color the light passes accumulate into.
+class GBuffer
+{
+public:
+
+    enum GBUFFER_TEXTURE_TYPE {
+        GBUFFER_TEXTURE_TYPE_POSITION,
+        GBUFFER_TEXTURE_TYPE_DIFFUSE,
+        GBUFFER_TEXTURE_TYPE_NORMAL,
+        GBUFFER_NUM_TEXTURES
+    };
+
+    GBuffer();
+
+    ~GBuffer();
+
+    bool Init(unsigned int WindowWidth, unsigned int WindowHeight);
+
+    void StartFrame();
+
+    void BindForGeomPass();
+
+    void BindForStencilPass();
+
+    void BindForLightPass();
+
+    void BindForFinalPass();
+
+private:
+
+    GLuint m_fbo;
+    GLuint m_textures[GBUFFER_NUM_TEXTURES];
+    GLuint m_depthTexture;
+    GLuint m_finalTexture;
+};
+
+#endif	/* GBUFFER_H */
@@ -1,17 +1,59 @@
 
+#include <float.h>
 #include <limits.h>
+#include <math.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "lighting_technique.h"
+#include "render_state.h"
+#include "render_queue.h"
+#include "clustered_lighting.h"
+#include "technique_registry.h"
 #include "util.h"
 
-static const char* pVS = "                                                          \n\
-#version 330                                                                        \n\
+static const char* pVertexInputs = "                                                \n\
                                                                                     \n\
 layout (location = 0) in vec3 Position;                                             \n\
 layout (location = 1) in vec2 TexCoord;                                             \n\
+                                                                                    \n\
+// Packed vertices (see vertex_format.h) hold the position in [0, 1] across         \n\
+// the mesh bounds and the normal folded onto the octahedron                        \n\
+#ifdef PACKED_VERTICES                                                              \n\
+layout (location = 2) in vec2 Normal;                                               \n\
+                                                                                    \n\
+uniform vec3 gPosScale;                                                             \n\
+uniform vec3 gPosBias;                                                              \n\
+                                                                                    \n\
+vec3 GetPosition()                                                                  \n\
+{                                                                                   \n\
+    return gPosBias + Position * gPosScale;                                         \n\
+}                                                                                   \n\
+                                                                                    \n\
+vec3 GetNormal()                                                                    \n\
+{                                                                                   \n\
+    vec3 n = vec3(Normal, 1.0 - abs(Normal.x) - abs(Normal.y));                     \n\
+    float t = max(-n.z, 0.0);                                                       \n\
+    n.x += n.x >= 0.0 ? -t : t;                                                     \n\
+    n.y += n.y >= 0.0 ? -t : t;                                                     \n\
+    return normalize(n);                                                            \n\
+}                                                                                   \n\
+#else                                                                               \n\
 layout (location = 2) in vec3 Normal;                                               \n\
                                                                                     \n\
+vec3 GetPosition()                                                                  \n\
+{                                                                                   \n\
+    return Position;                                                                \n\
+}                                                                                   \n\
+                                                                                    \n\
+vec3 GetNormal()                                                                    \n\
+{                                                                                   \n\
+    return Normal;                                                                  \n\
+}                                                                                   \n\
+#endif";
+
+static const char* pVS = "                                                          \n\
+                                                                                    \n\
 uniform mat4 gWVP;                                                                  \n\
 uniform mat4 gWorld;                                                                \n\
                                                                                     \n\
@@ -19,16 +61,102 @@ out vec2 TexCoord0;
 out vec3 Normal0;                                                                   \n\
 out vec3 WorldPos0;                                                                 \n\
                                                                                     \n\
+#ifdef PATTERNS                                                                     \n\
+uniform vec4 gPatternRect;                                                          \n\
+uniform float gPatternLayer;                                                        \n\
+                                                                                    \n\
+flat out vec4 PatternRect0;                                                         \n\
+flat out float PatternLayer0;                                                       \n\
+#endif                                                                              \n\
+                                                                                    \n\
+void main()                                                                         \n\
+{                                                                                   \n\
+    gl_Position = gWVP * vec4(GetPosition(), 1.0);                                  \n\
+    TexCoord0   = TexCoord;                                                         \n\
+    Normal0     = (gWorld * vec4(GetNormal(), 0.0)).xyz;                            \n\
+    WorldPos0   = (gWorld * vec4(GetPosition(), 1.0)).xyz;                          \n\
+#ifdef PATTERNS                                                                     \n\
+    PatternRect0 = gPatternRect;                                                    \n\
+    PatternLayer0 = gPatternLayer;                                                  \n\
+#endif                                                                              \n\
+}";
+
+static const char* pInstancedVS = "                                                 \n\
+                                                                                    \n\
+layout (location = 3) in mat4 World;                                                \n\
+                                                                                    \n\
+uniform mat4 gVP;                                                                   \n\
+                                                                                    \n\
+out vec2 TexCoord0;                                                                 \n\
+out vec3 Normal0;                                                                   \n\
+out vec3 WorldPos0;                                                                 \n\
+                                                                                    \n\
+#ifdef PATTERNS                                                                     \n\
+layout (location = 7) in vec4 PatternRect;                                          \n\
+layout (location = 8) in float PatternLayer;                                        \n\
+                                                                                    \n\
+flat out vec4 PatternRect0;                                                         \n\
+flat out float PatternLayer0;                                                       \n\
+#endif                                                                              \n\
+                                                                                    \n\
+// World comes straight from the row-major Matrix4f data, so GLSL sees it           \n\
+// transposed and the vector is multiplied from the left                            \n\
+void main()                                                                         \n\
+{                                                                                   \n\
+    vec4 WorldPos = vec4(GetPosition(), 1.0) * World;                               \n\
+    gl_Position = gVP * WorldPos;                                                   \n\
+    TexCoord0   = TexCoord;                                                         \n\
+    Normal0     = (vec4(GetNormal(), 0.0) * World).xyz;                             \n\
+    WorldPos0   = WorldPos.xyz;                                                     \n\
+#ifdef PATTERNS                                                                     \n\
+    PatternRect0 = PatternRect;                                                     \n\
+    PatternLayer0 = PatternLayer;                                                   \n\
+#endif                                                                              \n\
+}";
+
+static const char* pIndirectVS = "                                                  \n\
+                                                                                    \n\
+layout (location = 9) in uint DrawID;                                               \n\
+                                                                                    \n\
+struct ObjectData                                                                   \n\
+{                                                                                   \n\
+    mat4 World;                                                                     \n\
+    vec4 PatternRect;                                                               \n\
+    float PatternLayer;                                                             \n\
+};                                                                                  \n\
+                                                                                    \n\
+// Written by StaticScene from row-major Matrix4f data                              \n\
+layout (std430, row_major, binding = 0) readonly buffer Objects                     \n\
+{                                                                                   \n\
+    ObjectData gObjects[];                                                          \n\
+};                                                                                  \n\
+                                                                                    \n\
+uniform mat4 gVP;                                                                   \n\
+                                                                                    \n\
+out vec2 TexCoord0;                                                                 \n\
+out vec3 Normal0;                                                                   \n\
+out vec3 WorldPos0;                                                                 \n\
+                                                                                    \n\
+#ifdef PATTERNS                                                                     \n\
+flat out vec4 PatternRect0;                                                         \n\
+flat out float PatternLayer0;                                                       \n\
+#endif                                                                              \n\
+                                                                                    \n\
 void main()                                                                         \n\
 {                                                                                   \n\
-    gl_Position = gWVP * vec4(Position, 1.0);                                       \n\
+    mat4 World = gObjects[DrawID].World;                                            \n\
+    vec4 WorldPos = World * vec4(GetPosition(), 1.0);                               \n\
+    gl_Position = gVP * WorldPos;                                                   \n\
     TexCoord0   = TexCoord;                                                         \n\
-    Normal0     = (gWorld * vec4(Normal, 0.0)).xyz;                                 \n\
-    WorldPos0   = (gWorld * vec4(Position, 1.0)).xyz;                               \n\
+    Normal0     = (World * vec4(GetNormal(), 0.0)).xyz;                             \n\
+    WorldPos0   = WorldPos.xyz;                                                     \n\
+#ifdef PATTERNS                                                                     \n\
+    PatternRect0 = gObjects[DrawID].PatternRect;                                    \n\
+    PatternLayer0 = gObjects[DrawID].PatternLayer;                                  \n\
+#endif                                                                              \n\
 }";
 
 static const char* pFS = "                                                          \n\
-#version 330                                                                        \n\
                                                                                     \n\
 const int MAX_POINT_LIGHTS = 2;                                                     \n\
 const int MAX_SPOT_LIGHTS = 2;                                                      \n\
@@ -73,15 +201,48 @@ struct SpotLight
     float Cutoff;                                                                           \n\
 };                                                                                          \n\
                                                                                             \n\
-uniform int gNumPointLights;                                                                \n\
-uniform int gNumSpotLights;                                                                 \n\
-uniform DirectionalLight gDirectionalLight;                                                 \n\
-uniform PointLight gPointLights[MAX_POINT_LIGHTS];                                          \n\
-uniform SpotLight gSpotLights[MAX_SPOT_LIGHTS];                                             \n\
+layout (std140) uniform Lights                                                              \n\
+{                                                                                           \n\
+    DirectionalLight gDirectionalLight;                                                     \n\
+    PointLight gPointLights[MAX_POINT_LIGHTS];                                              \n\
+    SpotLight gSpotLights[MAX_SPOT_LIGHTS];                                                 \n\
+    vec3 gEyeWorldPos;                                                                      \n\
+    int gNumPointLights;                                                                    \n\
+    int gNumSpotLights;                                                                     \n\
+};                                                                                          \n\
+                                                                                            \n\
+layout (std140) uniform Material                                                            \n\
+{                                                                                           \n\
+    float gMatSpecularIntensity;                                                            \n\
+    float gSpecularPower;                                                                   \n\
+};                                                                                          \n\
+                                                                                            \n\
+// With PATTERNS the color comes from a region of a texture array layer (see                \n\
+// TextureArray); the region is tiled here, as it does not wrap by itself                   \n\
+#ifdef PATTERNS                                                                             \n\
+uniform sampler2DArray gSampler;                                                            \n\
+                                                                                            \n\
+flat in vec4 PatternRect0;                                                                  \n\
+flat in float PatternLayer0;                                                                \n\
+                                                                                            \n\
+vec4 SampleColor()                                                                          \n\
+{                                                                                           \n\
+    vec2 Scale = PatternRect0.zw;                                                           \n\
+    vec2 UV = PatternRect0.xy + fract(TexCoord0) * Scale;                                   \n\
+                                                                                            \n\
+    // The derivatives of the unwrapped coordinates keep the mip level                      \n\
+    // steady across the region borders                                                     \n\
+    return textureGrad(gSampler, vec3(UV, PatternLayer0),                                   \n\
+                       dFdx(TexCoord0) * Scale, dFdy(TexCoord0) * Scale);                   \n\
+}                                                                                           \n\
+#else                                                                                       \n\
 uniform sampler2D gSampler;                                                                 \n\
-uniform vec3 gEyeWorldPos;                                                                  \n\
-uniform float gMatSpecularIntensity;                                                        \n\
-uniform float gSpecularPower;                                                               \n\
+                                                                                            \n\
+vec4 SampleColor()                                                                          \n\
+{                                                                                           \n\
+    return texture2D(gSampler, TexCoord0.xy);                                               \n\
+}                                                                                           \n\
+#endif                                                                                      \n\
                                                                                             \n\
 vec4 CalcLightInternal( BaseLight Light, vec3 LightDirection, vec3 Normal)            \n\
 {                                                                                           \n\
@@ -94,6 +255,7 @@ vec4 CalcLightInternal( BaseLight Light, vec3 LightDirection, vec3 Normal)
     if (DiffuseFactor > 0) {                                                                \n\
         DiffuseColor = vec4(Light.Color, 1.0f) * Light.DiffuseIntensity * DiffuseFactor;    \n\
                                                                                             \n\
+#ifndef NO_SPECULAR                                                                         \n\
         vec3 VertexToEye = normalize(gEyeWorldPos - WorldPos0);                             \n\
         vec3 LightReflect = normalize(reflect(LightDirection, Normal));                     \n\
         float SpecularFactor = dot(VertexToEye, LightReflect);                              \n\
@@ -102,6 +264,7 @@ vec4 CalcLightInternal( BaseLight Light, vec3 LightDirection, vec3 Normal)
             SpecularColor = vec4(Light.Color, 1.0f) *                                       \n\
                             gMatSpecularIntensity * SpecularFactor;                         \n\
         }                                                                                   \n\
+#endif                                                                                      \n\
     }                                                                                       \n\
                                                                                             \n\
     return (AmbientColor + DiffuseColor + SpecularColor);                                   \n\
@@ -138,28 +301,122 @@ vec4 CalcSpotLight( SpotLight l, vec3 Normal)
     else {                                                                                  \n\
         return vec4(0,0,0,0);                                                               \n\
     }                                                                                       \n\
-}                                                                                           \n\
-                                                                                            \n\
+}";
+
+// Forward main: every fragment loops over all lights of the "Lights" block,
+// or over a fixed number of them in a permutation built for that count
+static const char* pFSMain = "                                                              \n\
 void main()                                                                                 \n\
 {                                                                                           \n\
     vec3 Normal = normalize(Normal0);                                                       \n\
     vec4 TotalLight = CalcDirectionalLight(Normal);                                         \n\
                                                                                             \n\
+    // A permutation with known light counts gets constant loop bounds, so                  \n\
+    // the loops are unrolled or dropped entirely                                           \n\
+#ifdef NUM_POINT_LIGHTS                                                                     \n\
+    for (int i = 0 ; i < NUM_POINT_LIGHTS ; i++) {                                          \n\
+#else                                                                                       \n\
     for (int i = 0 ; i < gNumPointLights ; i++) {                                           \n\
+#endif                                                                                      \n\
         TotalLight += CalcPointLight(gPointLights[i], Normal);                              \n\
     }                                                                                       \n\
                                                                                             \n\
+#ifdef NUM_SPOT_LIGHTS                                                                      \n\
+    for (int i = 0 ; i < NUM_SPOT_LIGHTS ; i++) {                                           \n\
+#else                                                                                       \n\
     for (int i = 0 ; i < gNumSpotLights ; i++) {                                            \n\
+#endif                                                                                      \n\
         TotalLight += CalcSpotLight(gSpotLights[i], Normal);                                \n\
     }                                                                                       \n\
                                                                                             \n\
-    FragColor = texture2D(gSampler, TexCoord0.xy) * TotalLight;                             \n\
+    FragColor = SampleColor() * TotalLight;                                                 \n\
+}";
+
+
+// Clustered main: the lights come from texture buffers and only the ones
+// assigned to the cluster of the fragment are evaluated (see LightClusters)
+static const char* pClusteredFSMain = "                                                     \n\
+uniform samplerBuffer gLightData;                                                           \n\
+uniform usamplerBuffer gClusterGrid;                                                        \n\
+uniform usamplerBuffer gLightIndices;                                                       \n\
+uniform ivec3 gClusterDims;                                                                 \n\
+uniform vec2 gTileSize;                                                                     \n\
+uniform vec2 gClusterZParams;                                                               \n\
+uniform vec3 gViewDir;                                                                      \n\
+                                                                                            \n\
+void main()                                                                                 \n\
+{                                                                                           \n\
+    vec3 Normal = normalize(Normal0);                                                       \n\
+    vec4 TotalLight = CalcDirectionalLight(Normal);                                         \n\
+                                                                                            \n\
+    float ViewZ = max(dot(WorldPos0 - gEyeWorldPos, gViewDir), 1e-4);                       \n\
+    int Slice = clamp(int(log(ViewZ) * gClusterZParams.x + gClusterZParams.y), 0, gClusterDims.z - 1);\n\
+    ivec2 Tile = min(ivec2(gl_FragCoord.xy / gTileSize), gClusterDims.xy - 1);              \n\
+    int Cluster = (Slice * gClusterDims.y + Tile.y) * gClusterDims.x + Tile.x;              \n\
+    uvec2 Range = texelFetch(gClusterGrid, Cluster).xy;                                     \n\
+                                                                                            \n\
+    for (uint i = 0u ; i < Range.y ; i++) {                                                 \n\
+        int Texel = int(texelFetch(gLightIndices, int(Range.x + i)).x) * 4;                 \n\
+        vec4 PosType = texelFetch(gLightData, Texel);                                       \n\
+        vec4 ColorDiffuse = texelFetch(gLightData, Texel + 1);                              \n\
+        vec4 AttenAmbient = texelFetch(gLightData, Texel + 2);                              \n\
+                                                                                            \n\
+        PointLight p;                                                                       \n\
+        p.Base.Color = ColorDiffuse.rgb;                                                    \n\
+        p.Base.AmbientIntensity = AttenAmbient.w;                                           \n\
+        p.Base.DiffuseIntensity = ColorDiffuse.w;                                           \n\
+        p.Position = PosType.xyz;                                                           \n\
+        p.Atten.Constant = AttenAmbient.x;                                                  \n\
+        p.Atten.Linear = AttenAmbient.y;                                                    \n\
+        p.Atten.Exp = AttenAmbient.z;                                                       \n\
+                                                                                            \n\
+        if (PosType.w > 0.5) {                                                              \n\
+            vec4 DirCutoff = texelFetch(gLightData, Texel + 3);                             \n\
+            SpotLight l;                                                                    \n\
+            l.Base = p;                                                                     \n\
+            l.Direction = DirCutoff.xyz;                                                    \n\
+            l.Cutoff = DirCutoff.w;                                                         \n\
+            TotalLight += CalcSpotLight(l, Normal);                                         \n\
+        }                                                                                   \n\
+        else {                                                                              \n\
+            TotalLight += CalcPointLight(p, Normal);                                        \n\
+        }                                                                                   \n\
+    }                                                                                       \n\
+                                                                                            \n\
+    FragColor = SampleColor() * TotalLight;                                                 \n\
 }";
 
 
+float CalcLightRadius(const PointLight& Light)
+{
+    // The specular term adds at most the material intensity, taken as 1
+    const float MaxColor  = fmaxf(Light.Color.x, fmaxf(Light.Color.y, Light.Color.z));
+    const float Threshold = MaxColor * (Light.AmbientIntensity + Light.DiffuseIntensity + 1.0f) * 256.0f;
+    const float c = Light.Attenuation.Constant - Threshold;
+    const float b = Light.Attenuation.Linear;
+    const float a = Light.Attenuation.Exp;
+
+    // Already below the threshold at the light itself; this also keeps the
+    // square root below from a negative argument
+    if (c >= 0.0f) {
+        return 0.0f;
+    }
 
-LightingTechnique::LightingTechnique()
+    if (a > 0.0f) {
+        return (-b + sqrtf(b * b - 4.0f * a * c)) / (2.0f * a);
+    }
+    else if (b > 0.0f) {
+        return -c / b;
+    }
+    else {
+        return FLT_MAX;
+    }
+}
+LightingTechnique::LightingTechnique(unsigned int Flags, int NumPointLights, int NumSpotLights)
 {
+    m_flags = Flags;
+    m_numPointLights = NumPointLights;
+    m_numSpotLights = NumSpotLights;
 }
 
 bool LightingTechnique::Init()
@@ -168,120 +425,130 @@ bool LightingTechnique::Init()
         return false;
     }
 
-    if (!AddShader(GL_VERTEX_SHADER, pVS)) {
-        return false;
+    // Every option of the permutation becomes a define of both stages
+    if (m_flags & PATTERNS) {
+        AddDefine("PATTERNS");
     }
 
-    if (!AddShader(GL_FRAGMENT_SHADER, pFS)) {
-        return false;
+    if (m_flags & NO_SPECULAR) {
+        AddDefine("NO_SPECULAR");
     }
 
-    if (!Finalize()) {
-        return false;
+    if (m_flags & PACKED_VERTICES) {
+        AddDefine("PACKED_VERTICES");
     }
 
-    m_WVPLocation = GetUniformLocation("gWVP");
-    m_WorldMatrixLocation = GetUniformLocation("gWorld");
-    m_samplerLocation = GetUniformLocation("gSampler");
-    m_eyeWorldPosLocation = GetUniformLocation("gEyeWorldPos");
-    m_dirLightLocation.Color = GetUniformLocation("gDirectionalLight.Base.Color");
-    m_dirLightLocation.AmbientIntensity = GetUniformLocation("gDirectionalLight.Base.AmbientIntensity");
-    m_dirLightLocation.Direction = GetUniformLocation("gDirectionalLight.Direction");
-    m_dirLightLocation.DiffuseIntensity = GetUniformLocation("gDirectionalLight.Base.DiffuseIntensity");
-    m_matSpecularIntensityLocation = GetUniformLocation("gMatSpecularIntensity");
-    m_matSpecularPowerLocation = GetUniformLocation("gSpecularPower");
-    m_numPointLightsLocation = GetUniformLocation("gNumPointLights");
-    m_numSpotLightsLocation = GetUniformLocation("gNumSpotLights");
-
-    if (m_dirLightLocation.AmbientIntensity == INVALID_UNIFORM_LOCATION ||
-        m_WVPLocation == INVALID_UNIFORM_LOCATION ||
-        m_WorldMatrixLocation == INVALID_UNIFORM_LOCATION ||
-        m_samplerLocation == INVALID_UNIFORM_LOCATION ||
-        m_eyeWorldPosLocation == INVALID_UNIFORM_LOCATION ||
-        m_dirLightLocation.Color == INVALID_UNIFORM_LOCATION ||
-        m_dirLightLocation.DiffuseIntensity == INVALID_UNIFORM_LOCATION ||
-        m_dirLightLocation.Direction == INVALID_UNIFORM_LOCATION ||
-        m_matSpecularIntensityLocation == INVALID_UNIFORM_LOCATION ||
-        m_matSpecularPowerLocation == INVALID_UNIFORM_LOCATION ||
-        m_numPointLightsLocation == INVALID_UNIFORM_LOCATION ||
-        m_numSpotLightsLocation == INVALID_UNIFORM_LOCATION) {
-        return false;
-    }
+    // The clustered main takes its lights from the clusters, the counts
+    // only apply to the forward one
+    if (!(m_flags & CLUSTERED)) {
+        if (m_numPointLights != DYNAMIC_LIGHT_COUNT) {
+            AddDefine("NUM_POINT_LIGHTS", m_numPointLights);
+        }
 
-    for (unsigned int i = 0 ; i < ARRAY_SIZE_IN_ELEMENTS(m_pointLightsLocation) ; i++) {
-        char Name[128];
-        memset(Name, 0, sizeof(Name));
-        snprintf(Name, sizeof(Name), "gPointLights[%d].Base.Color", i);
-        m_pointLightsLocation[i].Color = GetUniformLocation(Name);
+        if (m_numSpotLights != DYNAMIC_LIGHT_COUNT) {
+            AddDefine("NUM_SPOT_LIGHTS", m_numSpotLights);
+        }
+    }
 
-        snprintf(Name, sizeof(Name), "gPointLights[%d].Base.AmbientIntensity", i);
-        m_pointLightsLocation[i].AmbientIntensity = GetUniformLocation(Name);
+    // Storage buffers need GLSL 4.30
+    const char* pVersion = (m_flags & INDIRECT) ? "#version 430\n" : "#version 330\n";
 
-        snprintf(Name, sizeof(Name), "gPointLights[%d].Position", i);
-        m_pointLightsLocation[i].Position = GetUniformLocation(Name);
+    const char* pVSTexts[3] = { pVersion, pVertexInputs, (m_flags & INDIRECT) ? pIndirectVS :
+                                                         (m_flags & INSTANCED) ? pInstancedVS : pVS };
 
-        snprintf(Name, sizeof(Name), "gPointLights[%d].Base.DiffuseIntensity", i);
-        m_pointLightsLocation[i].DiffuseIntensity = GetUniformLocation(Name);
+    if (!AddShader(GL_VERTEX_SHADER, pVSTexts, 3)) {
+        return false;
+    }
 
-        snprintf(Name, sizeof(Name), "gPointLights[%d].Atten.Constant", i);
-        m_pointLightsLocation[i].Atten.Constant = GetUniformLocation(Name);
+    const char* pFSTexts[3] = { pVersion, pFS, (m_flags & CLUSTERED) ? pClusteredFSMain : pFSMain };
 
-        snprintf(Name, sizeof(Name), "gPointLights[%d].Atten.Linear", i);
-        m_pointLightsLocation[i].Atten.Linear = GetUniformLocation(Name);
+    if (!AddShader(GL_FRAGMENT_SHADER, pFSTexts, 3)) {
+        return false;
+    }
 
-        snprintf(Name, sizeof(Name), "gPointLights[%d].Atten.Exp", i);
-        m_pointLightsLocation[i].Atten.Exp = GetUniformLocation(Name);
+    return Finalize();
+}
 
-        if (m_pointLightsLocation[i].Color == INVALID_UNIFORM_LOCATION ||
-            m_pointLightsLocation[i].AmbientIntensity == INVALID_UNIFORM_LOCATION ||
-            m_pointLightsLocation[i].Position == INVALID_UNIFORM_LOCATION ||
-            m_pointLightsLocation[i].DiffuseIntensity == INVALID_UNIFORM_LOCATION ||
-            m_pointLightsLocation[i].Atten.Constant == INVALID_UNIFORM_LOCATION ||
-            m_pointLightsLocation[i].Atten.Linear == INVALID_UNIFORM_LOCATION ||
-            m_pointLightsLocation[i].Atten.Exp == INVALID_UNIFORM_LOCATION) {
+bool LightingTechnique::ResolveUniforms()
+{
+    // The instanced and indirect shaders take the world matrix per instance
+    // or per draw and only need the shared view-projection matrix as a uniform
+    if (m_flags & (INSTANCED | INDIRECT)) {
+        m_VPLocation = GetUniformLocation("gVP");
+        m_WVPLocation = INVALID_UNIFORM_LOCATION;
+        m_WorldMatrixLocation = INVALID_UNIFORM_LOCATION;
+
+        if (m_VPLocation == INVALID_UNIFORM_LOCATION) {
             return false;
         }
     }
+    else {
+        m_VPLocation = INVALID_UNIFORM_LOCATION;
+        m_WVPLocation = GetUniformLocation("gWVP");
+        m_WorldMatrixLocation = GetUniformLocation("gWorld");
 
-    for (unsigned int i = 0 ; i < ARRAY_SIZE_IN_ELEMENTS(m_spotLightsLocation) ; i++) {
-        char Name[128];
-        memset(Name, 0, sizeof(Name));
-        snprintf(Name, sizeof(Name), "gSpotLights[%d].Base.Base.Color", i);
-        m_spotLightsLocation[i].Color = GetUniformLocation(Name);
-
-        snprintf(Name, sizeof(Name), "gSpotLights[%d].Base.Base.AmbientIntensity", i);
-        m_spotLightsLocation[i].AmbientIntensity = GetUniformLocation(Name);
+        if (m_WVPLocation == INVALID_UNIFORM_LOCATION ||
+            m_WorldMatrixLocation == INVALID_UNIFORM_LOCATION) {
+            return false;
+        }
+    }
 
-        snprintf(Name, sizeof(Name), "gSpotLights[%d].Base.Position", i);
-        m_spotLightsLocation[i].Position = GetUniformLocation(Name);
+    m_samplerLocation = GetUniformLocation("gSampler");
 
-        snprintf(Name, sizeof(Name), "gSpotLights[%d].Direction", i);
-        m_spotLightsLocation[i].Direction = GetUniformLocation(Name);
+    if (m_samplerLocation == INVALID_UNIFORM_LOCATION) {
+        return false;
+    }
 
-        snprintf(Name, sizeof(Name), "gSpotLights[%d].Cutoff", i);
-        m_spotLightsLocation[i].Cutoff = GetUniformLocation(Name);
+    // Instanced and indirect pattern modes take the region per instance
+    if ((m_flags & PATTERNS) && !(m_flags & (INSTANCED | INDIRECT))) {
+        m_patternRectLocation = GetUniformLocation("gPatternRect");
+        m_patternLayerLocation = GetUniformLocation("gPatternLayer");
 
-        snprintf(Name, sizeof(Name), "gSpotLights[%d].Base.Base.DiffuseIntensity", i);
-        m_spotLightsLocation[i].DiffuseIntensity = GetUniformLocation(Name);
+        if (m_patternRectLocation == INVALID_UNIFORM_LOCATION ||
+            m_patternLayerLocation == INVALID_UNIFORM_LOCATION) {
+            return false;
+        }
+    }
+    else {
+        m_patternRectLocation = INVALID_UNIFORM_LOCATION;
+        m_patternLayerLocation = INVALID_UNIFORM_LOCATION;
+    }
 
-        snprintf(Name, sizeof(Name), "gSpotLights[%d].Base.Atten.Constant", i);
-        m_spotLightsLocation[i].Atten.Constant = GetUniformLocation(Name);
+    if (m_flags & PACKED_VERTICES) {
+        m_posScaleLocation = GetUniformLocation("gPosScale");
+        m_posBiasLocation = GetUniformLocation("gPosBias");
 
-        snprintf(Name, sizeof(Name), "gSpotLights[%d].Base.Atten.Linear", i);
-        m_spotLightsLocation[i].Atten.Linear = GetUniformLocation(Name);
+        if (m_posScaleLocation == INVALID_UNIFORM_LOCATION ||
+            m_posBiasLocation == INVALID_UNIFORM_LOCATION) {
+            return false;
+        }
+    }
+    else {
+        m_posScaleLocation = INVALID_UNIFORM_LOCATION;
+        m_posBiasLocation = INVALID_UNIFORM_LOCATION;
+    }
 
-        snprintf(Name, sizeof(Name), "gSpotLights[%d].Base.Atten.Exp", i);
-        m_spotLightsLocation[i].Atten.Exp = GetUniformLocation(Name);
+    if (!BindUniformBlock("Lights", LightingParams::LIGHTS_BINDING) ||
+        !BindUniformBlock("Material", LightingParams::MATERIAL_BINDING)) {
+        return false;
+    }
 
-        if (m_spotLightsLocation[i].Color == INVALID_UNIFORM_LOCATION ||
-            m_spotLightsLocation[i].AmbientIntensity == INVALID_UNIFORM_LOCATION ||
-            m_spotLightsLocation[i].Position == INVALID_UNIFORM_LOCATION ||
-            m_spotLightsLocation[i].Direction == INVALID_UNIFORM_LOCATION ||
-            m_spotLightsLocation[i].Cutoff == INVALID_UNIFORM_LOCATION ||
-            m_spotLightsLocation[i].DiffuseIntensity == INVALID_UNIFORM_LOCATION ||
-            m_spotLightsLocation[i].Atten.Constant == INVALID_UNIFORM_LOCATION ||
-            m_spotLightsLocation[i].Atten.Linear == INVALID_UNIFORM_LOCATION ||
-            m_spotLightsLocation[i].Atten.Exp == INVALID_UNIFORM_LOCATION) {
+    if (m_flags & CLUSTERED) {
+        m_clusterLocation.LightData = GetUniformLocation("gLightData");
+        m_clusterLocation.Grid = GetUniformLocation("gClusterGrid");
+        m_clusterLocation.Indices = GetUniformLocation("gLightIndices");
+        m_clusterLocation.Dims = GetUniformLocation("gClusterDims");
+        m_clusterLocation.TileSize = GetUniformLocation("gTileSize");
+        m_clusterLocation.ZParams = GetUniformLocation("gClusterZParams");
+        m_clusterLocation.ViewDir = GetUniformLocation("gViewDir");
+
+        if (m_clusterLocation.LightData == INVALID_UNIFORM_LOCATION ||
+            m_clusterLocation.Grid == INVALID_UNIFORM_LOCATION ||
+            m_clusterLocation.Indices == INVALID_UNIFORM_LOCATION ||
+            m_clusterLocation.Dims == INVALID_UNIFORM_LOCATION ||
+            m_clusterLocation.TileSize == INVALID_UNIFORM_LOCATION ||
+            m_clusterLocation.ZParams == INVALID_UNIFORM_LOCATION ||
+            m_clusterLocation.ViewDir == INVALID_UNIFORM_LOCATION) {
             return false;
         }
     }
@@ -291,77 +558,338 @@ bool LightingTechnique::Init()
 
 void LightingTechnique::SetWVP(const Matrix4f& WVP)
 {
-    glUniformMatrix4fv(m_WVPLocation, 1, GL_TRUE, (const GLfloat*)WVP.m);
+    RenderState::UniformMatrix4fv(m_WVPLocation, 1, GL_TRUE, (const GLfloat*)WVP.m);
+}
+
+
+void LightingTechnique::SetVP(const Matrix4f& VP)
+{
+    RenderState::UniformMatrix4fv(m_VPLocation, 1, GL_TRUE, (const GLfloat*)VP.m);
 }
 
 
 void LightingTechnique::SetWorldMatrix(const Matrix4f& WorldInverse)
 {
-    glUniformMatrix4fv(m_WorldMatrixLocation, 1, GL_TRUE, (const GLfloat*)WorldInverse.m);
+    RenderState::UniformMatrix4fv(m_WorldMatrixLocation, 1, GL_TRUE, (const GLfloat*)WorldInverse.m);
 }
 
 
 void LightingTechnique::SetTextureUnit(unsigned int TextureUnit)
 {
-    glUniform1i(m_samplerLocation, TextureUnit);
+    RenderState::Uniform1i(m_samplerLocation, TextureUnit);
+}
+
+
+void LightingTechnique::SetPattern(const Vector4f& Rect, float Layer)
+{
+    RenderState::Uniform4f(m_patternRectLocation, Rect.x, Rect.y, Rect.z, Rect.w);
+    RenderState::Uniform1f(m_patternLayerLocation, Layer);
+}
+
+
+void LightingTechnique::SetVertexQuantization(const VertexQuantization& Quantization)
+{
+    RenderState::Uniform3f(m_posScaleLocation, Quantization.Scale.x, Quantization.Scale.y, Quantization.Scale.z);
+    RenderState::Uniform3f(m_posBiasLocation, Quantization.Bias.x, Quantization.Bias.y, Quantization.Bias.z);
+}
+
+
+void LightingTechnique::SetDrawParams(const DrawParams& Params)
+{
+    if (m_flags & PACKED_VERTICES) {
+        SetVertexQuantization(Params.Quantization);
+    }
+
+    if (m_flags & (INSTANCED | INDIRECT)) {
+        SetVP(Params.WVP);
+        return;
+    }
+
+    SetWVP(Params.WVP);
+    SetWorldMatrix(Params.World);
+
+    if (m_flags & PATTERNS) {
+        SetPattern(Params.PatternRect, Params.PatternLayer);
+    }
+}
+
+
+void LightingTechnique::SetClusterTextureUnits(unsigned int LightDataUnit, unsigned int GridUnit, unsigned int IndicesUnit)
+{
+    RenderState::Uniform1i(m_clusterLocation.LightData, LightDataUnit);
+    RenderState::Uniform1i(m_clusterLocation.Grid, GridUnit);
+    RenderState::Uniform1i(m_clusterLocation.Indices, IndicesUnit);
+}
+
+
+void LightingTechnique::SetLightClusters(const LightClusters& Clusters, const Vector3f& ViewDir)
+{
+    // Slice = log(z / zNear) / log(zFar / zNear) * SLICES, split into a scale
+    // and a bias applied to log(z) in the shader
+    const float Scale = LightClusters::SLICES / logf(Clusters.GetFar() / Clusters.GetNear());
+
+    RenderState::Uniform3i(m_clusterLocation.Dims, LightClusters::TILES_X, LightClusters::TILES_Y, LightClusters::SLICES);
+    RenderState::Uniform2f(m_clusterLocation.TileSize, Clusters.GetTileWidth(), Clusters.GetTileHeight());
+    RenderState::Uniform2f(m_clusterLocation.ZParams, Scale, -logf(Clusters.GetNear()) * Scale);
+    RenderState::Uniform3f(m_clusterLocation.ViewDir, ViewDir.x, ViewDir.y, ViewDir.z);
+}
+
+
+
+LightingVariants::LightingVariants()
+{
+    m_pRegistry = NULL;
+    m_textureUnit = 0;
+    m_lightDataUnit = 0;
+    m_gridUnit = 0;
+    m_indicesUnit = 0;
+}
+
+LightingVariants::~LightingVariants()
+{
+    for (std::map<unsigned int, Variant>::iterator it = m_variants.begin() ; it != m_variants.end() ; ++it) {
+        // A variant still compiling is completed first, so the registry
+        // does not keep a deleted technique
+        if (it->second.pEffect && m_pRegistry) {
+            m_pRegistry->Finish(it->second.pEffect);
+        }
+
+        delete it->second.pEffect;
+    }
+}
+
+void LightingVariants::SetTextureUnit(unsigned int TextureUnit)
+{
+    m_textureUnit = TextureUnit;
+}
+
+void LightingVariants::SetClusterTextureUnits(unsigned int LightDataUnit, unsigned int GridUnit, unsigned int IndicesUnit)
+{
+    m_lightDataUnit = LightDataUnit;
+    m_gridUnit = GridUnit;
+    m_indicesUnit = IndicesUnit;
+}
+
+void LightingVariants::SetRegistry(TechniqueRegistry* pRegistry)
+{
+    m_pRegistry = pRegistry;
+}
+
+void LightingVariants::Prewarm(unsigned int Flags, int NumPointLights, int NumSpotLights)
+{
+    Build(Flags, NumPointLights, NumSpotLights);
+}
+
+LightingTechnique* LightingVariants::Get(unsigned int Flags, const LightingParams& Params)
+{
+    if (Params.GetMatSpecularIntensity() == 0.0f) {
+        Flags |= LightingTechnique::NO_SPECULAR;
+    }
+
+    return Get(Flags, Params.GetNumPointLights(), Params.GetNumSpotLights());
+}
+
+LightingTechnique* LightingVariants::Get(unsigned int Flags, int NumPointLights, int NumSpotLights)
+{
+    Variant& v = Build(Flags, NumPointLights, NumSpotLights);
+
+    if (!v.pEffect || v.Configured) {
+        return v.pEffect;
+    }
+
+    // The variant is needed now, so a pending compile is waited for
+    if (!v.pEffect->IsReady() && !(m_pRegistry && m_pRegistry->Finish(v.pEffect))) {
+        fprintf(stderr, "Error building lighting variant (flags 0x%x)\n", Flags);
+        delete v.pEffect;
+        v.pEffect = NULL;
+        return NULL;
+    }
+
+    v.pEffect->Enable();
+    v.pEffect->SetTextureUnit(m_textureUnit);
+
+    if (Flags & LightingTechnique::CLUSTERED) {
+        v.pEffect->SetClusterTextureUnits(m_lightDataUnit, m_gridUnit, m_indicesUnit);
+    }
+
+    v.Configured = true;
+
+    return v.pEffect;
+}
+
+LightingVariants::Variant& LightingVariants::Build(unsigned int Flags, int NumPointLights, int NumSpotLights)
+{
+    // Clustered variants ignore the counts, so they all share one entry
+    if (Flags & LightingTechnique::CLUSTERED) {
+        NumPointLights = LightingTechnique::DYNAMIC_LIGHT_COUNT;
+        NumSpotLights = LightingTechnique::DYNAMIC_LIGHT_COUNT;
+    }
+
+    // Flags in the low byte, each count biased by one (0 = dynamic) above it
+    const unsigned int Key = (Flags & 0xFF) |
+                             ((unsigned int)(NumPointLights + 1) & 0xFF) << 8 |
+                             ((unsigned int)(NumSpotLights + 1) & 0xFF) << 16;
+
+    std::map<unsigned int, Variant>::iterator it = m_variants.find(Key);
+
+    if (it != m_variants.end()) {
+        return it->second;
+    }
+
+    Variant v;
+    v.pEffect = new LightingTechnique(Flags, NumPointLights, NumSpotLights);
+    v.Configured = false;
+
+    const bool Ok = m_pRegistry ? m_pRegistry->Add(v.pEffect) : v.pEffect->Init();
+
+    // The failure is remembered, not retried every frame
+    if (!Ok) {
+        fprintf(stderr, "Error building lighting variant 0x%06x\n", Key);
+        delete v.pEffect;
+        v.pEffect = NULL;
+    }
+
+    return m_variants[Key] = v;
 }
 
 
-void LightingTechnique::SetDirectionalLight(const DirectionalLight& Light)
+
+
+LightingParams::LightingParams()
+{
+    memset((void*)&m_lights, 0, sizeof(m_lights));
+    memset((void*)&m_material, 0, sizeof(m_material));
+    m_lightsDirty = true;
+    m_materialDirty = true;
+}
+
+bool LightingParams::Init()
 {
-    glUniform3f(m_dirLightLocation.Color, Light.Color.x, Light.Color.y, Light.Color.z);
-    glUniform1f(m_dirLightLocation.AmbientIntensity, Light.AmbientIntensity);
+    if (!m_lightsBuffer.Init(LIGHTS_BINDING, sizeof(m_lights))) {
+        return false;
+    }
+
+    if (!m_materialBuffer.Init(MATERIAL_BINDING, sizeof(m_material))) {
+        return false;
+    }
+
+    return true;
+}
+
+// The setters are called every frame, mostly with the values already set,
+// so a block is only marked for upload when its contents really change
+void LightingParams::SetDirectionalLight(const DirectionalLight& Light)
+{
+    DirectionalLightStd140 l;
+    memset((void*)&l, 0, sizeof(l));
+    l.Base.Color = Light.Color;
+    l.Base.AmbientIntensity = Light.AmbientIntensity;
+    l.Base.DiffuseIntensity = Light.DiffuseIntensity;
     Vector3f Direction = Light.Direction;
     Direction.Normalize();
-    glUniform3f(m_dirLightLocation.Direction, Direction.x, Direction.y, Direction.z);
-    glUniform1f(m_dirLightLocation.DiffuseIntensity, Light.DiffuseIntensity);
+    l.Direction = Direction;
+
+    if (memcmp(&l, &m_lights.DirectionalLight, sizeof(l)) != 0) {
+        m_lights.DirectionalLight = l;
+        m_lightsDirty = true;
+    }
 }
 
-void LightingTechnique::SetEyeWorldPos(const Vector3f& EyeWorldPos)
+void LightingParams::SetEyeWorldPos(const Vector3f& EyeWorldPos)
 {
-    glUniform3f(m_eyeWorldPosLocation, EyeWorldPos.x, EyeWorldPos.y, EyeWorldPos.z);
+    if (memcmp(&EyeWorldPos, &m_lights.EyeWorldPos, sizeof(Vector3f)) != 0) {
+        m_lights.EyeWorldPos = EyeWorldPos;
+        m_lightsDirty = true;
+    }
 }
 
-void LightingTechnique::SetMatSpecularIntensity(float Intensity)
+void LightingParams::SetMatSpecularIntensity(float Intensity)
 {
-    glUniform1f(m_matSpecularIntensityLocation, Intensity);
+    if (Intensity != m_material.SpecularIntensity) {
+        m_material.SpecularIntensity = Intensity;
+        m_materialDirty = true;
+    }
 }
 
-void LightingTechnique::SetMatSpecularPower(float Power)
+void LightingParams::SetMatSpecularPower(float Power)
 {
-    glUniform1f(m_matSpecularPowerLocation, Power);
+    if (Power != m_material.SpecularPower) {
+        m_material.SpecularPower = Power;
+        m_materialDirty = true;
+    }
 }
 
-void LightingTechnique::SetPointLights(unsigned int NumLights, const PointLight* pLights)
+void LightingParams::SetPointLights(unsigned int NumLights, const PointLight* pLights)
 {
-    glUniform1i(m_numPointLightsLocation, NumLights);
+    if (NumLights > MAX_POINT_LIGHTS) {
+        NumLights = MAX_POINT_LIGHTS;
+    }
+
+    if ((unsigned int)m_lights.NumPointLights != NumLights) {
+        m_lights.NumPointLights = NumLights;
+        m_lightsDirty = true;
+    }
 
     for (unsigned int i = 0 ; i < NumLights ; i++) {
-        glUniform3f(m_pointLightsLocation[i].Color, pLights[i].Color.x, pLights[i].Color.y, pLights[i].Color.z);
-        glUniform1f(m_pointLightsLocation[i].AmbientIntensity, pLights[i].AmbientIntensity);
-        glUniform1f(m_pointLightsLocation[i].DiffuseIntensity, pLights[i].DiffuseIntensity);
-        glUniform3f(m_pointLightsLocation[i].Position, pLights[i].Position.x, pLights[i].Position.y, pLights[i].Position.z);
-        glUniform1f(m_pointLightsLocation[i].Atten.Constant, pLights[i].Attenuation.Constant);
-        glUniform1f(m_pointLightsLocation[i].Atten.Linear, pLights[i].Attenuation.Linear);
-        glUniform1f(m_pointLightsLocation[i].Atten.Exp, pLights[i].Attenuation.Exp);
+        PointLightStd140 l;
+        memset((void*)&l, 0, sizeof(l));
+        l.Base.Color = pLights[i].Color;
+        l.Base.AmbientIntensity = pLights[i].AmbientIntensity;
+        l.Base.DiffuseIntensity = pLights[i].DiffuseIntensity;
+        l.Position = pLights[i].Position;
+        l.Atten.Constant = pLights[i].Attenuation.Constant;
+        l.Atten.Linear = pLights[i].Attenuation.Linear;
+        l.Atten.Exp = pLights[i].Attenuation.Exp;
+
+        if (memcmp(&l, &m_lights.PointLights[i], sizeof(l)) != 0) {
+            m_lights.PointLights[i] = l;
+            m_lightsDirty = true;
+        }
     }
 }
 
-void LightingTechnique::SetSpotLights(unsigned int NumLights, const SpotLight* pLights)
+void LightingParams::SetSpotLights(unsigned int NumLights, const SpotLight* pLights)
 {
-    glUniform1i(m_numSpotLightsLocation, NumLights);
+    if (NumLights > MAX_SPOT_LIGHTS) {
+        NumLights = MAX_SPOT_LIGHTS;
+    }
+
+    if ((unsigned int)m_lights.NumSpotLights != NumLights) {
+        m_lights.NumSpotLights = NumLights;
+        m_lightsDirty = true;
+    }
 
     for (unsigned int i = 0 ; i < NumLights ; i++) {
-        glUniform3f(m_spotLightsLocation[i].Color, pLights[i].Color.x, pLights[i].Color.y, pLights[i].Color.z);
-        glUniform1f(m_spotLightsLocation[i].AmbientIntensity, pLights[i].AmbientIntensity);
-        glUniform1f(m_spotLightsLocation[i].DiffuseIntensity, pLights[i].DiffuseIntensity);
-        glUniform3f(m_spotLightsLocation[i].Position,  pLights[i].Position.x, pLights[i].Position.y, pLights[i].Position.z);
+        SpotLightStd140 l;
+        memset((void*)&l, 0, sizeof(l));
+        l.Base.Base.Color = pLights[i].Color;
+        l.Base.Base.AmbientIntensity = pLights[i].AmbientIntensity;
+        l.Base.Base.DiffuseIntensity = pLights[i].DiffuseIntensity;
+        l.Base.Position = pLights[i].Position;
         Vector3f Direction = pLights[i].Direction;
         Direction.Normalize();
-        glUniform3f(m_spotLightsLocation[i].Direction, Direction.x, Direction.y, Direction.z);
-        glUniform1f(m_spotLightsLocation[i].Cutoff, cosf(ToRadian(pLights[i].Cutoff)));
-        glUniform1f(m_spotLightsLocation[i].Atten.Constant, pLights[i].Attenuation.Constant);
-        glUniform1f(m_spotLightsLocation[i].Atten.Linear,   pLights[i].Attenuation.Linear);
-        glUniform1f(m_spotLightsLocation[i].Atten.Exp,      pLights[i].Attenuation.Exp);
+        l.Direction = Direction;
+        l.Cutoff = cosf(ToRadian(pLights[i].Cutoff));
+        l.Base.Atten.Constant = pLights[i].Attenuation.Constant;
+        l.Base.Atten.Linear = pLights[i].Attenuation.Linear;
+        l.Base.Atten.Exp = pLights[i].Attenuation.Exp;
+
+        if (memcmp(&l, &m_lights.SpotLights[i], sizeof(l)) != 0) {
+            m_lights.SpotLights[i] = l;
+            m_lightsDirty = true;
+        }
+    }
+}
+
+void LightingParams::Update()
+{
+    if (m_lightsDirty) {
+        m_lightsBuffer.Update(&m_lights);
+        m_lightsDirty = false;
+    }
+
+    if (m_materialDirty) {
+        m_materialBuffer.Update(&m_material);
+        m_materialDirty = false;
     }
 }
@@ -2,10 +2,15 @@
 #ifndef LIGHTING_TECHNIQUE_H
 #define	LIGHTING_TECHNIQUE_H
 
+#include <map>
+
 #include "technique.h"
 #include "technique.cpp"
+#include "uniform_buffer.h"
+#include "uniform_buffer.cpp"
 #include "math_3d.h"
 #include "math_3d.cpp"
+#include "vertex_format.h"
 
 struct BaseLight
 {
@@ -63,19 +68,75 @@ struct SpotLight : public PointLight
     }
 };
 
-class LightingTechnique : public Technique {
+// Distance at which the light falls below 1/256 of its strength, used to
+// bound the light for culling
+float CalcLightRadius(const PointLight& Light);
+
+// Mirrors of the shader light structs with the std140 layout of the
+// "Lights" uniform block: every struct is padded to a multiple of 16 bytes
+// and vec3 members start on a 16 byte boundary.
+struct BaseLightStd140
+{
+    Vector3f Color;
+    float AmbientIntensity;
+    float DiffuseIntensity;
+    float Padding[3];
+};
+
+struct DirectionalLightStd140
+{
+    BaseLightStd140 Base;
+    Vector3f Direction;
+    float Padding;
+};
+
+struct AttenuationStd140
+{
+    float Constant;
+    float Linear;
+    float Exp;
+    float Padding;
+};
+
+struct PointLightStd140
+{
+    BaseLightStd140 Base;
+    Vector3f Position;
+    float Padding;
+    AttenuationStd140 Atten;
+};
+
+struct SpotLightStd140
+{
+    PointLightStd140 Base;
+    Vector3f Direction;
+    float Cutoff;
+};
+
+static_assert(sizeof(BaseLightStd140) == 32, "std140 layout mismatch");
+static_assert(sizeof(DirectionalLightStd140) == 48, "std140 layout mismatch");
+static_assert(sizeof(PointLightStd140) == 64, "std140 layout mismatch");
+static_assert(sizeof(SpotLightStd140) == 80, "std140 layout mismatch");
+
+
+// CPU copy of the "Lights" and "Material" uniform blocks of the lighting
+// shaders. One instance is shared by every technique using these blocks;
+// the setters only touch the CPU copy and Update() uploads each changed
+// block with a single buffer write.
+class LightingParams
+{
 public:
 
     static const unsigned int MAX_POINT_LIGHTS = 2;
     static const unsigned int MAX_SPOT_LIGHTS = 2;
 
-    LightingTechnique();
+    static const GLuint LIGHTS_BINDING = 0;
+    static const GLuint MATERIAL_BINDING = 1;
 
-    virtual bool Init();
+    LightingParams();
+
+    bool Init();
 
-    void SetWVP(const Matrix4f& WVP);
-    void SetWorldMatrix(const Matrix4f& WVP);
-    void SetTextureUnit(unsigned int TextureUnit);
     void SetDirectionalLight(const DirectionalLight& Light);
     void SetPointLights(unsigned int NumLights, const PointLight* pLights);
     void SetSpotLights(unsigned int NumLights, const SpotLight* pLights);
@@ -83,49 +144,175 @@ public:
     void SetMatSpecularIntensity(float Intensity);
     void SetMatSpecularPower(float Power);
 
+    unsigned int GetNumPointLights() const { return m_lights.NumPointLights; }
+    unsigned int GetNumSpotLights() const { return m_lights.NumSpotLights; }
+    float GetMatSpecularIntensity() const { return m_material.SpecularIntensity; }
+
+    void Update();
+
+private:
+
+    struct {
+        DirectionalLightStd140 DirectionalLight;
+        PointLightStd140 PointLights[MAX_POINT_LIGHTS];
+        SpotLightStd140 SpotLights[MAX_SPOT_LIGHTS];
+        Vector3f EyeWorldPos;
+        int NumPointLights;
+        int NumSpotLights;
+        float Padding[3];
+    } m_lights;
+
+    struct {
+        float SpecularIntensity;
+        float SpecularPower;
+        float Padding[2];
+    } m_material;
+
+    bool m_lightsDirty;
+    bool m_materialDirty;
+
+    UniformBuffer m_lightsBuffer;
+    UniformBuffer m_materialBuffer;
+};
+
+
+class LightClusters;
+class TechniqueRegistry;
+
+class LightingTechnique : public Technique {
+public:
+
+    enum {
+        // World matrices come per instance (see INSTANCE_WORLD_LOCATION)
+        INSTANCED = 0x01,
+        // Point and spot lights come from LightClusters instead of the
+        // "Lights" block arrays
+        CLUSTERED = 0x02,
+        // The color comes from a region of a TextureArray, set with
+        // SetPattern() or per instance (see PATTERN_RECT_LOCATION)
+        PATTERNS = 0x04,
+        // The specular term is compiled out
+        NO_SPECULAR = 0x08,
+        // World matrices and pattern regions come from the StaticScene
+        // object buffer, indexed by the draw (see StaticScene)
+        INDIRECT = 0x10,
+        // Vertices in VERTEX_FORMAT_PACKED, decoded with the quantization
+        // set by SetVertexQuantization()
+        PACKED_VERTICES = 0x20
+    };
+
+    // Light count of a permutation taken from the "Lights" block at run time
+    // instead of being compiled in
+    static const int DYNAMIC_LIGHT_COUNT = -1;
+
+    // First of the four attribute locations holding the per-instance world
+    // matrix in instanced mode
+    static const unsigned int INSTANCE_WORLD_LOCATION = 3;
+
+    // Per-instance TextureRegion in instanced pattern mode
+    static const unsigned int PATTERN_RECT_LOCATION = 7;
+    static const unsigned int PATTERN_LAYER_LOCATION = 8;
+
+    LightingTechnique(unsigned int Flags = 0,
+                      int NumPointLights = DYNAMIC_LIGHT_COUNT,
+                      int NumSpotLights = DYNAMIC_LIGHT_COUNT);
+
+    virtual bool Init();
+
+    void SetWVP(const Matrix4f& WVP);
+    void SetVP(const Matrix4f& VP);
+    void SetWorldMatrix(const Matrix4f& WVP);
+    void SetTextureUnit(unsigned int TextureUnit);
+    void SetPattern(const Vector4f& Rect, float Layer);
+    void SetVertexQuantization(const VertexQuantization& Quantization);
+    void SetClusterTextureUnits(unsigned int LightDataUnit, unsigned int GridUnit, unsigned int IndicesUnit);
+    void SetLightClusters(const LightClusters& Clusters, const Vector3f& ViewDir);
+
+    // Instanced and indirect variants take DrawParams::WVP as the view-projection matrix
+    virtual void SetDrawParams(const DrawParams& Params);
+
+protected:
+
+    virtual bool ResolveUniforms();
+
 private:
 
+    unsigned int m_flags;
+    int m_numPointLights;
+    int m_numSpotLights;
+
     GLuint m_WVPLocation;
+    GLuint m_VPLocation;
     GLuint m_WorldMatrixLocation;
     GLuint m_samplerLocation;
-    GLuint m_eyeWorldPosLocation;
-    GLuint m_matSpecularIntensityLocation;
-    GLuint m_matSpecularPowerLocation;
-    GLuint m_numPointLightsLocation;
-    GLuint m_numSpotLightsLocation;
+    GLuint m_patternRectLocation;
+    GLuint m_patternLayerLocation;
+    GLuint m_posScaleLocation;
+    GLuint m_posBiasLocation;
 
     struct {
-        GLuint Color;
-        GLuint AmbientIntensity;
-        GLuint DiffuseIntensity;
-        GLuint Direction;
-    } m_dirLightLocation;
+        GLuint LightData;
+        GLuint Grid;
+        GLuint Indices;
+        GLuint Dims;
+        GLuint TileSize;
+        GLuint ZParams;
+        GLuint ViewDir;
+    } m_clusterLocation;
+};
 
-    struct {
-        GLuint Color;
-        GLuint AmbientIntensity;
-        GLuint DiffuseIntensity;
-        GLuint Position;
-        struct {
-            GLuint Constant;
-            GLuint Linear;
-            GLuint Exp;
-        } Atten;
-    } m_pointLightsLocation[MAX_POINT_LIGHTS];
 
-    struct {
-        GLuint Color;
-        GLuint AmbientIntensity;
-        GLuint DiffuseIntensity;
-        GLuint Position;
-        GLuint Direction;
-        GLuint Cutoff;
-        struct {
-            GLuint Constant;
-            GLuint Linear;
-            GLuint Exp;
-        } Atten;
-    } m_spotLightsLocation[MAX_SPOT_LIGHTS];
+// Permutations of LightingTechnique built on demand. Get() returns the
+// tightest variant for the current LightingParams: the exact light counts
+// compiled in and the specular term dropped when the material has none.
+// Every variant stays alive (and its binary in the program cache) once
+// built, so a state seen before costs a map lookup.
+//
+// With a TechniqueRegistry set, variants are built through it: Prewarm()
+// submits the variants expected soon without waiting for them, and Get()
+// only waits for a variant still compiling when it is needed right away.
+class LightingVariants
+{
+public:
+
+    LightingVariants();
+
+    ~LightingVariants();
+
+    // Sampler units set on every variant when it is built
+    void SetTextureUnit(unsigned int TextureUnit);
+    void SetClusterTextureUnits(unsigned int LightDataUnit, unsigned int GridUnit, unsigned int IndicesUnit);
+
+    void SetRegistry(TechniqueRegistry* pRegistry);
+
+    void Prewarm(unsigned int Flags, int NumPointLights, int NumSpotLights);
+
+    // Flags are the LightingTechnique options the caller needs, the rest of
+    // the permutation comes from Params. Returns NULL if the variant fails
+    // to build (the failure is remembered, not retried every frame).
+    LightingTechnique* Get(unsigned int Flags, const LightingParams& Params);
+
+    LightingTechnique* Get(unsigned int Flags, int NumPointLights, int NumSpotLights);
+
+    unsigned int GetNumVariants() const { return (unsigned int)m_variants.size(); }
+
+private:
+
+    struct Variant {
+        LightingTechnique* pEffect;
+        // The sampler units are set (after the program is ready)
+        bool Configured;
+    };
+
+    Variant& Build(unsigned int Flags, int NumPointLights, int NumSpotLights);
+
+    std::map<unsigned int, Variant> m_variants;
+    TechniqueRegistry* m_pRegistry;
+
+    unsigned int m_textureUnit;
+    unsigned int m_lightDataUnit;
+    unsigned int m_gridUnit;
+    unsigned int m_indicesUnit;
 };
 
 
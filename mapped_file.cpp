@@ -0,0 +1,133 @@
+#include <stdio.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mapped_file.h"
+
+#pragma once
+
+MappedFile::MappedFile()
+{
+#ifdef _WIN32
+    m_file = INVALID_HANDLE_VALUE;
+    m_mapping = NULL;
+#else
+    m_fd = -1;
+#endif
+    m_pData = NULL;
+    m_size = 0;
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+bool MappedFile::Open(const std::string& FileName)
+{
+    Close();
+
+#ifdef _WIN32
+    m_file = CreateFileA(FileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                         FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+    if (m_file == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "Error opening '%s'\n", FileName.c_str());
+        return false;
+    }
+
+    LARGE_INTEGER Size;
+
+    if (!GetFileSizeEx(m_file, &Size) || Size.QuadPart == 0) {
+        fprintf(stderr, "Error reading the size of '%s'\n", FileName.c_str());
+        Close();
+        return false;
+    }
+
+    m_size = (size_t)Size.QuadPart;
+    m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+
+    if (m_mapping) {
+        m_pData = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+#else
+    m_fd = open(FileName.c_str(), O_RDONLY);
+
+    if (m_fd < 0) {
+        fprintf(stderr, "Error opening '%s'\n", FileName.c_str());
+        return false;
+    }
+
+    struct stat Stat;
+
+    if (fstat(m_fd, &Stat) != 0 || Stat.st_size == 0) {
+        fprintf(stderr, "Error reading the size of '%s'\n", FileName.c_str());
+        Close();
+        return false;
+    }
+
+    m_size = (size_t)Stat.st_size;
+    m_pData = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+
+    if (m_pData == MAP_FAILED) {
+        m_pData = NULL;
+    }
+#endif
+
+    if (m_pData == NULL) {
+        fprintf(stderr, "Error mapping '%s'\n", FileName.c_str());
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void MappedFile::Prefetch() const
+{
+    const volatile unsigned char* p = (const volatile unsigned char*)m_pData;
+    unsigned char Sum = 0;
+
+    for (size_t i = 0 ; i < m_size ; i += 4096) {
+        Sum += p[i];
+    }
+
+    (void)Sum;
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+    if (m_pData) {
+        UnmapViewOfFile(m_pData);
+    }
+
+    if (m_mapping) {
+        CloseHandle(m_mapping);
+    }
+
+    if (m_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_file);
+    }
+
+    m_file = INVALID_HANDLE_VALUE;
+    m_mapping = NULL;
+#else
+    if (m_pData) {
+        munmap(m_pData, m_size);
+    }
+
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+
+    m_fd = -1;
+#endif
+    m_pData = NULL;
+    m_size = 0;
+}
@@ -0,0 +1,54 @@
+#ifndef MAPPED_FILE_H
+#define	MAPPED_FILE_H
+
+#include <stddef.h>
+#include <string>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+// Read only view of a whole file. The pages are brought in by the OS on
+// first access, so opening costs no copy and no parse.
+class MappedFile
+{
+public:
+
+    MappedFile();
+
+    ~MappedFile();
+
+    bool Open(const std::string& FileName);
+
+    void Close();
+
+    const void* GetData() const { return m_pData; }
+
+    size_t GetSize() const { return m_size; }
+
+    // Reads one byte of every page, so later accesses do not wait for disk
+    void Prefetch() const;
+
+private:
+
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+#ifdef _WIN32
+    HANDLE m_file;
+    HANDLE m_mapping;
+#else
+    int m_fd;
+#endif
+    void* m_pData;
+    size_t m_size;
+};
+
+
+#endif	/* MAPPED_FILE_H */
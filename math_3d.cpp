@@ -16,25 +16,23 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <float.h>
+
 #include "math_3d.h"
 #pragma once
 
 Vector3f Vector3f::Cross(const Vector3f& v) const
 {
-    const float _x = y * v.z - z * v.y;
-    const float _y = z * v.x - x * v.z;
-    const float _z = x * v.y - y * v.x;
+    Vector3f Ret;
+
+    Vec3Cross(&Ret.x, &x, &v.x);
 
-    return Vector3f(_x, _y, _z);
+    return Ret;
 }
 
 Vector3f& Vector3f::Normalize()
 {
-    const float Length = sqrtf(x * x + y * y + z * z);
-
-    x /= Length;
-    y /= Length;
-    z /= Length;
+    Vec3Normalize(&x);
 
     return *this;
 }
@@ -130,6 +128,97 @@ void Matrix4f::InitPersProjTransform(float FOV, float Width, float Height, float
     m[3][0] = 0.0f;                   m[3][1] = 0.0f;            m[3][2] = 1.0f;          m[3][3] = 0.0;
 }
 
+// Same result as Translation * Rotation * Scale, but built directly from the
+// closed form of Rz * Ry * Rx instead of four matrix multiplications
+void Matrix4f::InitWorldTransform(const Vector3f& Scale, const Vector3f& Rotate, const Vector3f& Pos)
+{
+    const float sx = sinf(ToRadian(Rotate.x)), cx = cosf(ToRadian(Rotate.x));
+    const float sy = sinf(ToRadian(Rotate.y)), cy = cosf(ToRadian(Rotate.y));
+    const float sz = sinf(ToRadian(Rotate.z)), cz = cosf(ToRadian(Rotate.z));
+
+    m[0][0] = cz * cy * Scale.x; m[0][1] = (-cz * sy * sx - sz * cx) * Scale.y; m[0][2] = (-cz * sy * cx + sz * sx) * Scale.z; m[0][3] = Pos.x;
+    m[1][0] = sz * cy * Scale.x; m[1][1] = (-sz * sy * sx + cz * cx) * Scale.y; m[1][2] = (-sz * sy * cx - cz * sx) * Scale.z; m[1][3] = Pos.y;
+    m[2][0] = sy * Scale.x;      m[2][1] = cy * sx * Scale.y;                   m[2][2] = cy * cx * Scale.z;                   m[2][3] = Pos.z;
+    m[3][0] = 0.0f;              m[3][1] = 0.0f;                                m[3][2] = 0.0f;                                m[3][3] = 1.0f;
+}
+
+
+void Frustum::Init(const Matrix4f& VP)
+{
+    // A point is inside when -w <= x, y, z <= w in clip space, every
+    // inequality is a plane made of two rows of the matrix
+    for (unsigned int i = 0 ; i < 3 ; i++) {
+        Planes[i * 2] = Vector4f(VP.m[3][0] + VP.m[i][0], VP.m[3][1] + VP.m[i][1],
+                                 VP.m[3][2] + VP.m[i][2], VP.m[3][3] + VP.m[i][3]);
+        Planes[i * 2 + 1] = Vector4f(VP.m[3][0] - VP.m[i][0], VP.m[3][1] - VP.m[i][1],
+                                     VP.m[3][2] - VP.m[i][2], VP.m[3][3] - VP.m[i][3]);
+    }
+
+    for (unsigned int i = 0 ; i < NUM_PLANES ; i++) {
+        Vector4f& p = Planes[i];
+        const float Length = sqrtf(p.x * p.x + p.y * p.y + p.z * p.z);
+        p.x /= Length;
+        p.y /= Length;
+        p.z /= Length;
+        p.w /= Length;
+    }
+}
+
+bool Frustum::IsSphereVisible(const Vector3f& Center, float Radius) const
+{
+    for (unsigned int i = 0 ; i < NUM_PLANES ; i++) {
+        const Vector4f& p = Planes[i];
+
+        if (p.x * Center.x + p.y * Center.y + p.z * Center.z + p.w < -Radius) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+BoundingBox::BoundingBox()
+{
+    Min = Vector3f(FLT_MAX, FLT_MAX, FLT_MAX);
+    Max = Vector3f(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+}
+
+void BoundingBox::Expand(const Vector3f& p)
+{
+    Min = Vector3f(fminf(Min.x, p.x), fminf(Min.y, p.y), fminf(Min.z, p.z));
+    Max = Vector3f(fmaxf(Max.x, p.x), fmaxf(Max.y, p.y), fmaxf(Max.z, p.z));
+}
+
+void BoundingBox::Expand(const BoundingBox& b)
+{
+    Expand(b.Min);
+    Expand(b.Max);
+}
+
+BoundingBox BoundingBox::Transform(const Matrix4f& m) const
+{
+    // Every output coordinate is the translation plus, per input axis, the
+    // smaller or larger of the two scaled extremes
+    const float* pMin = &Min.x;
+    const float* pMax = &Max.x;
+
+    BoundingBox Ret;
+    float* pRetMin = &Ret.Min.x;
+    float* pRetMax = &Ret.Max.x;
+
+    for (unsigned int i = 0 ; i < 3 ; i++) {
+        pRetMin[i] = pRetMax[i] = m.m[i][3];
+
+        for (unsigned int j = 0 ; j < 3 ; j++) {
+            const float a = m.m[i][j] * pMin[j];
+            const float b = m.m[i][j] * pMax[j];
+            pRetMin[i] += fminf(a, b);
+            pRetMax[i] += fmaxf(a, b);
+        }
+    }
+
+    return Ret;
+}
 
 Quaternion::Quaternion(float _x, float _y, float _z, float _w)
 {
@@ -158,24 +247,20 @@ Quaternion Quaternion::Conjugate()
 
 Quaternion operator*(const Quaternion& l, const Quaternion& r)
 {
-    const float w = (l.w * r.w) - (l.x * r.x) - (l.y * r.y) - (l.z * r.z);
-    const float x = (l.x * r.w) + (l.w * r.x) + (l.y * r.z) - (l.z * r.y);
-    const float y = (l.y * r.w) + (l.w * r.y) + (l.z * r.x) - (l.x * r.z);
-    const float z = (l.z * r.w) + (l.w * r.z) + (l.x * r.y) - (l.y * r.x);
+    Quaternion ret(0.0f, 0.0f, 0.0f, 0.0f);
 
-    Quaternion ret(x, y, z, w);
+    QuatMul(&ret.x, &l.x, &r.x);
 
     return ret;
 }
 
 Quaternion operator*(const Quaternion& q, const Vector3f& v)
 {
-    const float w = - (q.x * v.x) - (q.y * v.y) - (q.z * v.z);
-    const float x =   (q.w * v.x) + (q.y * v.z) - (q.z * v.y);
-    const float y =   (q.w * v.y) + (q.z * v.x) - (q.x * v.z);
-    const float z =   (q.w * v.z) + (q.x * v.y) - (q.y * v.x);
+    // v is treated as the pure quaternion (v, 0)
+    const float r[4] = { v.x, v.y, v.z, 0.0f };
+    Quaternion ret(0.0f, 0.0f, 0.0f, 0.0f);
 
-    Quaternion ret(x, y, z, w);
+    QuatMul(&ret.x, &q.x, r);
 
     return ret;
 }
\ No newline at end of file
@@ -23,6 +23,8 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 
+#include "math_simd.h"
+
 #define ToRadian(x) ((x) * M_PI / 180.0f)
 #define ToDegree(x) ((x) * 180.0f / M_PI)
 
@@ -134,6 +136,40 @@ inline Vector3f operator*(const Vector3f& l, float f)
 }
 
 
+struct Vector4f
+{
+    float x;
+    float y;
+    float z;
+    float w;
+
+    Vector4f()
+    {
+    }
+
+    Vector4f(float _x, float _y, float _z, float _w)
+    {
+        x = _x;
+        y = _y;
+        z = _z;
+        w = _w;
+    }
+
+    Vector4f(const Vector3f& v, float _w)
+    {
+        x = v.x;
+        y = v.y;
+        z = v.z;
+        w = _w;
+    }
+
+    Vector3f to3f() const
+    {
+        return Vector3f(x, y, z);
+    }
+};
+
+
 class Matrix4f
 {
 public:
@@ -156,14 +192,16 @@ public:
     {
         Matrix4f Ret;
 
-        for (unsigned int i = 0 ; i < 4 ; i++) {
-            for (unsigned int j = 0 ; j < 4 ; j++) {
-                Ret.m[i][j] = m[i][0] * Right.m[0][j] +
-                              m[i][1] * Right.m[1][j] +
-                              m[i][2] * Right.m[2][j] +
-                              m[i][3] * Right.m[3][j];
-            }
-        }
+        Mat4Mul(&Ret.m[0][0], &m[0][0], &Right.m[0][0]);
+
+        return Ret;
+    }
+
+    inline Vector4f operator*(const Vector4f& v) const
+    {
+        Vector4f Ret;
+
+        Mat4Transform(&Ret.x, &m[0][0], &v.x);
 
         return Ret;
     }
@@ -173,6 +211,43 @@ public:
     void InitTranslationTransform(float x, float y, float z);
     void InitCameraTransform(const Vector3f& Target, const Vector3f& Up);
     void InitPersProjTransform(float FOV, float Width, float Height, float zNear, float zFar);
+    void InitWorldTransform(const Vector3f& Scale, const Vector3f& Rotate, const Vector3f& Pos);
+};
+
+
+// The six planes of a view-projection matrix as (a, b, c, d) with
+// a*x + b*y + c*z + d >= 0 inside and (a, b, c) of unit length, so the
+// plane equation is the signed distance to the plane
+struct Frustum
+{
+    enum { LEFT, RIGHT, BOTTOM, TOP, NEAR_PLANE, FAR_PLANE, NUM_PLANES };
+
+    Vector4f Planes[NUM_PLANES];
+
+    void Init(const Matrix4f& VP);
+
+    bool IsSphereVisible(const Vector3f& Center, float Radius) const;
+};
+
+
+// Axis aligned box, empty (Min above Max) when default constructed
+struct BoundingBox
+{
+    Vector3f Min;
+    Vector3f Max;
+
+    BoundingBox();
+
+    void Expand(const Vector3f& p);
+    void Expand(const BoundingBox& b);
+
+    // The box around this box after the transform
+    BoundingBox Transform(const Matrix4f& m) const;
+
+    Vector3f GetCenter() const
+    {
+        return Vector3f((Min.x + Max.x) * 0.5f, (Min.y + Max.y) * 0.5f, (Min.z + Max.z) * 0.5f);
+    }
 };
 
 
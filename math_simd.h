@@ -0,0 +1,383 @@
+#ifndef MATH_SIMD_H
+#define	MATH_SIMD_H
+
+#include <math.h>
+
+// The vector backend is chosen at compile time. Define MATH_3D_FORCE_SCALAR to
+// build everything on the scalar reference kernels (useful to verify results).
+#if !defined(MATH_3D_FORCE_SCALAR) && (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#define MATH_3D_SIMD_SSE
+#include <xmmintrin.h>
+#if defined(__AVX__)
+#define MATH_3D_SIMD_AVX
+#include <immintrin.h>
+#endif
+#elif !defined(MATH_3D_FORCE_SCALAR) && (defined(__aarch64__) || defined(_M_ARM64))
+#define MATH_3D_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(MATH_3D_SIMD_SSE) || defined(MATH_3D_SIMD_NEON)
+#define MATH_3D_SIMD
+#endif
+
+
+// Scalar reference kernels. They are always compiled so that the vector
+// kernels can be checked against them. All matrices are row major 4x4.
+
+inline void Mat4MulScalar(float* pOut, const float* pL, const float* pR)
+{
+    for (unsigned int i = 0 ; i < 4 ; i++) {
+        for (unsigned int j = 0 ; j < 4 ; j++) {
+            pOut[i * 4 + j] = pL[i * 4 + 0] * pR[0 * 4 + j] +
+                              pL[i * 4 + 1] * pR[1 * 4 + j] +
+                              pL[i * 4 + 2] * pR[2 * 4 + j] +
+                              pL[i * 4 + 3] * pR[3 * 4 + j];
+        }
+    }
+}
+
+inline void Mat4TransformScalar(float* pOut, const float* pM, const float* pV)
+{
+    for (unsigned int i = 0 ; i < 4 ; i++) {
+        pOut[i] = pM[i * 4 + 0] * pV[0] +
+                  pM[i * 4 + 1] * pV[1] +
+                  pM[i * 4 + 2] * pV[2] +
+                  pM[i * 4 + 3] * pV[3];
+    }
+}
+
+inline void Vec3CrossScalar(float* pOut, const float* pL, const float* pR)
+{
+    const float x = pL[1] * pR[2] - pL[2] * pR[1];
+    const float y = pL[2] * pR[0] - pL[0] * pR[2];
+    const float z = pL[0] * pR[1] - pL[1] * pR[0];
+
+    pOut[0] = x;
+    pOut[1] = y;
+    pOut[2] = z;
+}
+
+inline void Vec3NormalizeScalar(float* pV)
+{
+    const float Length = sqrtf(pV[0] * pV[0] + pV[1] * pV[1] + pV[2] * pV[2]);
+
+    pV[0] /= Length;
+    pV[1] /= Length;
+    pV[2] /= Length;
+}
+
+// Quaternions are stored as (x, y, z, w)
+inline void QuatMulScalar(float* pOut, const float* pL, const float* pR)
+{
+    const float w = (pL[3] * pR[3]) - (pL[0] * pR[0]) - (pL[1] * pR[1]) - (pL[2] * pR[2]);
+    const float x = (pL[0] * pR[3]) + (pL[3] * pR[0]) + (pL[1] * pR[2]) - (pL[2] * pR[1]);
+    const float y = (pL[1] * pR[3]) + (pL[3] * pR[1]) + (pL[2] * pR[0]) - (pL[0] * pR[2]);
+    const float z = (pL[2] * pR[3]) + (pL[3] * pR[2]) + (pL[0] * pR[1]) - (pL[1] * pR[0]);
+
+    pOut[0] = x;
+    pOut[1] = y;
+    pOut[2] = z;
+    pOut[3] = w;
+}
+
+// Frustum test of four boxes stored as a structure of arrays: pBoxes holds
+// MinX[4], MinY[4], MinZ[4], MaxX[4], MaxY[4], MaxZ[4] and pPlanes the six
+// (a, b, c, d) planes of a Frustum. Bit i of the result is set unless box i
+// lies completely outside one of the planes. Only the box corner farthest
+// along the plane normal needs testing, and that corner is the same for all
+// four boxes.
+inline unsigned int Box4FrustumTestScalar(const float* pBoxes, const float* pPlanes)
+{
+    unsigned int Mask = 0;
+
+    for (unsigned int i = 0 ; i < 4 ; i++) {
+        bool Visible = true;
+
+        for (unsigned int p = 0 ; p < 6 && Visible ; p++) {
+            const float* pPlane = pPlanes + p * 4;
+            const float x = pBoxes[(pPlane[0] > 0.0f ? 12 : 0) + i];
+            const float y = pBoxes[(pPlane[1] > 0.0f ? 16 : 4) + i];
+            const float z = pBoxes[(pPlane[2] > 0.0f ? 20 : 8) + i];
+
+            Visible = pPlane[0] * x + pPlane[1] * y + pPlane[2] * z + pPlane[3] >= 0.0f;
+        }
+
+        if (Visible) {
+            Mask |= 1 << i;
+        }
+    }
+
+    return Mask;
+}
+
+
+#ifdef MATH_3D_SIMD
+
+// Thin wrapper over the native 4-wide float register. The kernels below are
+// written only against these functions, so a new backend has to provide just
+// this set.
+
+#if defined(MATH_3D_SIMD_SSE)
+
+typedef __m128 Simd4f;
+
+inline Simd4f Simd4fLoad(const float* p)                  { return _mm_loadu_ps(p); }
+inline void   Simd4fStore(float* p, Simd4f v)             { _mm_storeu_ps(p, v); }
+inline Simd4f Simd4fSet(float x, float y, float z, float w) { return _mm_setr_ps(x, y, z, w); }
+inline Simd4f Simd4fSplat(float f)                        { return _mm_set1_ps(f); }
+inline Simd4f Simd4fAdd(Simd4f a, Simd4f b)               { return _mm_add_ps(a, b); }
+inline Simd4f Simd4fSub(Simd4f a, Simd4f b)               { return _mm_sub_ps(a, b); }
+inline Simd4f Simd4fMul(Simd4f a, Simd4f b)               { return _mm_mul_ps(a, b); }
+inline Simd4f Simd4fDiv(Simd4f a, Simd4f b)               { return _mm_div_ps(a, b); }
+inline Simd4f Simd4fSqrt(Simd4f a)                        { return _mm_sqrt_ps(a); }
+inline Simd4f Simd4fMax(Simd4f a, Simd4f b)               { return _mm_max_ps(a, b); }
+inline Simd4f Simd4fMulAdd(Simd4f a, Simd4f b, Simd4f c)  { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+inline float  Simd4fGetX(Simd4f v)                        { return _mm_cvtss_f32(v); }
+inline Simd4f Simd4fCmpLt(Simd4f a, Simd4f b)             { return _mm_cmplt_ps(a, b); }
+inline Simd4f Simd4fOr(Simd4f a, Simd4f b)                { return _mm_or_ps(a, b); }
+inline int    Simd4fMoveMask(Simd4f v)                    { return _mm_movemask_ps(v); }
+
+template <int X, int Y, int Z, int W>
+inline Simd4f Simd4fSwizzle(Simd4f v)
+{
+    return _mm_shuffle_ps(v, v, _MM_SHUFFLE(W, Z, Y, X));
+}
+
+inline void Simd4fTranspose(Simd4f& r0, Simd4f& r1, Simd4f& r2, Simd4f& r3)
+{
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+}
+
+#elif defined(MATH_3D_SIMD_NEON)
+
+typedef float32x4_t Simd4f;
+
+inline Simd4f Simd4fLoad(const float* p)                  { return vld1q_f32(p); }
+inline void   Simd4fStore(float* p, Simd4f v)             { vst1q_f32(p, v); }
+inline Simd4f Simd4fSet(float x, float y, float z, float w) { const float f[4] = { x, y, z, w }; return vld1q_f32(f); }
+inline Simd4f Simd4fSplat(float f)                        { return vdupq_n_f32(f); }
+inline Simd4f Simd4fAdd(Simd4f a, Simd4f b)               { return vaddq_f32(a, b); }
+inline Simd4f Simd4fSub(Simd4f a, Simd4f b)               { return vsubq_f32(a, b); }
+inline Simd4f Simd4fMul(Simd4f a, Simd4f b)               { return vmulq_f32(a, b); }
+inline Simd4f Simd4fDiv(Simd4f a, Simd4f b)               { return vdivq_f32(a, b); }
+inline Simd4f Simd4fSqrt(Simd4f a)                        { return vsqrtq_f32(a); }
+inline Simd4f Simd4fMax(Simd4f a, Simd4f b)               { return vmaxq_f32(a, b); }
+inline Simd4f Simd4fMulAdd(Simd4f a, Simd4f b, Simd4f c)  { return vmlaq_f32(c, a, b); }
+inline float  Simd4fGetX(Simd4f v)                        { return vgetq_lane_f32(v, 0); }
+inline Simd4f Simd4fCmpLt(Simd4f a, Simd4f b)             { return vreinterpretq_f32_u32(vcltq_f32(a, b)); }
+
+inline Simd4f Simd4fOr(Simd4f a, Simd4f b)
+{
+    return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+}
+
+// Sign bit of every lane, lane 0 in bit 0
+inline int Simd4fMoveMask(Simd4f v)
+{
+    const uint32x4_t u = vreinterpretq_u32_f32(v);
+    return (vgetq_lane_u32(u, 0) >> 31) | ((vgetq_lane_u32(u, 1) >> 31) << 1) |
+           ((vgetq_lane_u32(u, 2) >> 31) << 2) | ((vgetq_lane_u32(u, 3) >> 31) << 3);
+}
+
+template <int X, int Y, int Z, int W>
+inline Simd4f Simd4fSwizzle(Simd4f v)
+{
+    float f[4];
+    vst1q_f32(f, v);
+    return Simd4fSet(f[X], f[Y], f[Z], f[W]);
+}
+
+inline void Simd4fTranspose(Simd4f& r0, Simd4f& r1, Simd4f& r2, Simd4f& r3)
+{
+    const float32x4x2_t t01 = vtrnq_f32(r0, r1);
+    const float32x4x2_t t23 = vtrnq_f32(r2, r3);
+    r0 = vcombine_f32(vget_low_f32(t01.val[0]),  vget_low_f32(t23.val[0]));
+    r1 = vcombine_f32(vget_low_f32(t01.val[1]),  vget_low_f32(t23.val[1]));
+    r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+    r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+
+#endif
+
+
+inline void Mat4MulSimd(float* pOut, const float* pL, const float* pR)
+{
+#if defined(MATH_3D_SIMD_AVX)
+    // Two output rows per iteration: each 128 bit half of a register holds
+    // one row of the left matrix, broadcast against the same right row.
+    const __m256 r0 = _mm256_broadcast_ps((const __m128*)(pR + 0));
+    const __m256 r1 = _mm256_broadcast_ps((const __m128*)(pR + 4));
+    const __m256 r2 = _mm256_broadcast_ps((const __m128*)(pR + 8));
+    const __m256 r3 = _mm256_broadcast_ps((const __m128*)(pR + 12));
+
+    for (unsigned int i = 0 ; i < 16 ; i += 8) {
+        const __m256 l = _mm256_loadu_ps(pL + i);
+        __m256 Ret = _mm256_mul_ps(_mm256_shuffle_ps(l, l, 0x00), r0);
+        Ret = _mm256_add_ps(Ret, _mm256_mul_ps(_mm256_shuffle_ps(l, l, 0x55), r1));
+        Ret = _mm256_add_ps(Ret, _mm256_mul_ps(_mm256_shuffle_ps(l, l, 0xAA), r2));
+        Ret = _mm256_add_ps(Ret, _mm256_mul_ps(_mm256_shuffle_ps(l, l, 0xFF), r3));
+        _mm256_storeu_ps(pOut + i, Ret);
+    }
+#else
+    const Simd4f r0 = Simd4fLoad(pR + 0);
+    const Simd4f r1 = Simd4fLoad(pR + 4);
+    const Simd4f r2 = Simd4fLoad(pR + 8);
+    const Simd4f r3 = Simd4fLoad(pR + 12);
+
+    // Row i of the result is a linear combination of the rows of the right
+    // matrix weighted by row i of the left one
+    for (unsigned int i = 0 ; i < 4 ; i++) {
+        const float* pRow = pL + i * 4;
+        Simd4f Ret = Simd4fMul(Simd4fSplat(pRow[0]), r0);
+        Ret = Simd4fMulAdd(Simd4fSplat(pRow[1]), r1, Ret);
+        Ret = Simd4fMulAdd(Simd4fSplat(pRow[2]), r2, Ret);
+        Ret = Simd4fMulAdd(Simd4fSplat(pRow[3]), r3, Ret);
+        Simd4fStore(pOut + i * 4, Ret);
+    }
+#endif
+}
+
+inline void Mat4TransformSimd(float* pOut, const float* pM, const float* pV)
+{
+    const Simd4f v = Simd4fLoad(pV);
+    Simd4f p0 = Simd4fMul(Simd4fLoad(pM + 0),  v);
+    Simd4f p1 = Simd4fMul(Simd4fLoad(pM + 4),  v);
+    Simd4f p2 = Simd4fMul(Simd4fLoad(pM + 8),  v);
+    Simd4f p3 = Simd4fMul(Simd4fLoad(pM + 12), v);
+
+    // After the transpose lane i of every register belongs to row i, so the
+    // four dot products are finished with three vertical adds
+    Simd4fTranspose(p0, p1, p2, p3);
+    Simd4fStore(pOut, Simd4fAdd(Simd4fAdd(p0, p1), Simd4fAdd(p2, p3)));
+}
+
+inline void Vec3CrossSimd(float* pOut, const float* pL, const float* pR)
+{
+    const Simd4f l = Simd4fSet(pL[0], pL[1], pL[2], 0.0f);
+    const Simd4f r = Simd4fSet(pR[0], pR[1], pR[2], 0.0f);
+
+    const Simd4f Ret = Simd4fSub(Simd4fMul(Simd4fSwizzle<1, 2, 0, 3>(l), Simd4fSwizzle<2, 0, 1, 3>(r)),
+                                 Simd4fMul(Simd4fSwizzle<2, 0, 1, 3>(l), Simd4fSwizzle<1, 2, 0, 3>(r)));
+
+    float f[4];
+    Simd4fStore(f, Ret);
+    pOut[0] = f[0];
+    pOut[1] = f[1];
+    pOut[2] = f[2];
+}
+
+inline void Vec3NormalizeSimd(float* pV)
+{
+    const Simd4f v = Simd4fSet(pV[0], pV[1], pV[2], 0.0f);
+
+    Simd4f Dot = Simd4fMul(v, v);
+    Dot = Simd4fAdd(Dot, Simd4fSwizzle<1, 0, 3, 2>(Dot));
+    Dot = Simd4fAdd(Dot, Simd4fSwizzle<2, 3, 0, 1>(Dot));
+
+    float f[4];
+    Simd4fStore(f, Simd4fDiv(v, Simd4fSqrt(Dot)));
+    pV[0] = f[0];
+    pV[1] = f[1];
+    pV[2] = f[2];
+}
+
+inline void QuatMulSimd(float* pOut, const float* pL, const float* pR)
+{
+    const Simd4f l = Simd4fLoad(pL);
+    const Simd4f r = Simd4fLoad(pR);
+    const Simd4f Sign = Simd4fSet(1.0f, 1.0f, 1.0f, -1.0f);
+
+    // w*r + (x,y,z,x)*(w,w,w,x) + (y,z,x,y)*(z,x,y,y) - (z,x,y,z)*(y,z,x,z),
+    // with the w lane of the two middle terms negated
+    Simd4f Ret = Simd4fMul(Simd4fSwizzle<3, 3, 3, 3>(l), r);
+    Simd4f t = Simd4fMul(Simd4fSwizzle<0, 1, 2, 0>(l), Simd4fSwizzle<3, 3, 3, 0>(r));
+    t = Simd4fMulAdd(Simd4fSwizzle<1, 2, 0, 1>(l), Simd4fSwizzle<2, 0, 1, 1>(r), t);
+    Ret = Simd4fMulAdd(t, Sign, Ret);
+    Ret = Simd4fSub(Ret, Simd4fMul(Simd4fSwizzle<2, 0, 1, 2>(l), Simd4fSwizzle<1, 2, 0, 2>(r)));
+
+    Simd4fStore(pOut, Ret);
+}
+
+inline unsigned int Box4FrustumTestSimd(const float* pBoxes, const float* pPlanes)
+{
+    const Simd4f Zero = Simd4fSplat(0.0f);
+    Simd4f Outside = Zero;
+
+    // The four boxes go through every plane at once, one lane each
+    for (unsigned int p = 0 ; p < 6 ; p++) {
+        const float* pPlane = pPlanes + p * 4;
+        const Simd4f x = Simd4fLoad(pBoxes + (pPlane[0] > 0.0f ? 12 : 0));
+        const Simd4f y = Simd4fLoad(pBoxes + (pPlane[1] > 0.0f ? 16 : 4));
+        const Simd4f z = Simd4fLoad(pBoxes + (pPlane[2] > 0.0f ? 20 : 8));
+
+        Simd4f Dist = Simd4fMulAdd(Simd4fSplat(pPlane[0]), x, Simd4fSplat(pPlane[3]));
+        Dist = Simd4fMulAdd(Simd4fSplat(pPlane[1]), y, Dist);
+        Dist = Simd4fMulAdd(Simd4fSplat(pPlane[2]), z, Dist);
+
+        Outside = Simd4fOr(Outside, Simd4fCmpLt(Dist, Zero));
+    }
+
+    return ~Simd4fMoveMask(Outside) & 0xF;
+}
+
+#endif /* MATH_3D_SIMD */
+
+
+// Kernels used by the rest of the code
+
+inline void Mat4Mul(float* pOut, const float* pL, const float* pR)
+{
+#ifdef MATH_3D_SIMD
+    Mat4MulSimd(pOut, pL, pR);
+#else
+    Mat4MulScalar(pOut, pL, pR);
+#endif
+}
+
+inline void Mat4Transform(float* pOut, const float* pM, const float* pV)
+{
+#ifdef MATH_3D_SIMD
+    Mat4TransformSimd(pOut, pM, pV);
+#else
+    Mat4TransformScalar(pOut, pM, pV);
+#endif
+}
+
+inline void Vec3Cross(float* pOut, const float* pL, const float* pR)
+{
+#ifdef MATH_3D_SIMD
+    Vec3CrossSimd(pOut, pL, pR);
+#else
+    Vec3CrossScalar(pOut, pL, pR);
+#endif
+}
+
+inline void Vec3Normalize(float* pV)
+{
+#ifdef MATH_3D_SIMD
+    Vec3NormalizeSimd(pV);
+#else
+    Vec3NormalizeScalar(pV);
+#endif
+}
+
+inline void QuatMul(float* pOut, const float* pL, const float* pR)
+{
+#ifdef MATH_3D_SIMD
+    QuatMulSimd(pOut, pL, pR);
+#else
+    QuatMulScalar(pOut, pL, pR);
+#endif
+}
+
+inline unsigned int Box4FrustumTest(const float* pBoxes, const float* pPlanes)
+{
+#ifdef MATH_3D_SIMD
+    return Box4FrustumTestSimd(pBoxes, pPlanes);
+#else
+    return Box4FrustumTestScalar(pBoxes, pPlanes);
+#endif
+}
+
+#endif	/* MATH_SIMD_H */
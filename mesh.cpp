@@ -0,0 +1,225 @@
+#include <stddef.h>
+
+#include "mesh.h"
+#include "mesh_file.h"
+#include "render_state.h"
+
+// Binding 0 holds the vertices, the instance buffers follow it
+#define VERTEX_BINDING 0
+
+Mesh::Mesh()
+{
+    m_VAO = 0;
+    m_VBO = 0;
+    m_IBO = 0;
+    m_numIndices = 0;
+    m_indexType = GL_UNSIGNED_INT;
+    m_format = VERTEX_FORMAT_FLOAT;
+}
+
+Mesh::~Mesh()
+{
+    if (m_VAO != 0) {
+        RenderState::DeleteVertexArrays(1, &m_VAO);
+    }
+
+    if (m_VBO != 0) {
+        RenderState::DeleteBuffers(1, &m_VBO);
+    }
+
+    if (m_IBO != 0) {
+        RenderState::DeleteBuffers(1, &m_IBO);
+    }
+}
+
+bool Mesh::Init(const Vertex* pVertices, unsigned int NumVertices,
+                const unsigned int* pIndices, unsigned int NumIndices,
+                VertexFormat Format)
+{
+    Submesh All;
+    All.FirstIndex = 0;
+    All.NumIndices = NumIndices;
+    m_submeshes.assign(1, All);
+
+    m_format = Format;
+
+    if (Format == VERTEX_FORMAT_PACKED) {
+        BoundingBox Bounds;
+
+        for (unsigned int i = 0 ; i < NumVertices ; i++) {
+            Bounds.Expand(pVertices[i].m_pos);
+        }
+
+        m_quantization = CalcVertexQuantization(Bounds);
+
+        std::vector<PackedVertex> Packed(NumVertices);
+        PackVertices(pVertices, NumVertices, m_quantization, &Packed[0]);
+
+        return InitBuffers(&Packed[0], NumVertices, pIndices, sizeof(unsigned int), NumIndices);
+    }
+
+    return InitBuffers(pVertices, NumVertices, pIndices, sizeof(unsigned int), NumIndices);
+}
+
+bool Mesh::Init(const MeshFile& File)
+{
+    m_submeshes.resize(File.GetNumSubmeshes());
+
+    for (unsigned int i = 0 ; i < m_submeshes.size() ; i++) {
+        m_submeshes[i].FirstIndex = File.GetSubmesh(i).FirstIndex;
+        m_submeshes[i].NumIndices = File.GetSubmesh(i).NumIndices;
+    }
+
+    // The packing used the bounds stored in the file
+    m_format = File.GetVertexFormat();
+    m_quantization = CalcVertexQuantization(File.GetBounds());
+
+    return InitBuffers(File.GetVertices(), File.GetNumVertices(),
+                       File.GetIndices(), File.GetIndexSize(), File.GetNumIndices());
+}
+
+bool Mesh::Load(const std::string& FileName)
+{
+    MeshFile File;
+
+    if (!File.Open(FileName)) {
+        return false;
+    }
+
+    // The mapping only lives until the data is in the buffers
+    return Init(File);
+}
+
+bool Mesh::InitBuffers(const void* pVertices, unsigned int NumVertices,
+                       const void* pIndices, unsigned int IndexSize, unsigned int NumIndices)
+{
+    glGenVertexArrays(1, &m_VAO);
+
+    if (m_VAO == 0) {
+        return false;
+    }
+
+    RenderState::BindVertexArray(m_VAO);
+
+    const VertexLayout& Layout = GetVertexLayout(m_format);
+
+    glGenBuffers(1, &m_VBO);
+    RenderState::BindBuffer(GL_ARRAY_BUFFER, m_VBO);
+    glBufferData(GL_ARRAY_BUFFER, Layout.Stride * NumVertices, pVertices, GL_STATIC_DRAW);
+
+    // The element buffer binding is part of the vertex array state
+    glGenBuffers(1, &m_IBO);
+    RenderState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, IndexSize * NumIndices, pIndices, GL_STATIC_DRAW);
+
+    m_numIndices = NumIndices;
+    m_indexType = IndexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+    if (GLEW_ARB_vertex_attrib_binding) {
+        glBindVertexBuffer(VERTEX_BINDING, m_VBO, 0, Layout.Stride);
+    }
+
+    for (unsigned int i = 0 ; i < Layout.NumAttributes ; i++) {
+        const VertexAttribute& a = Layout.Attributes[i];
+
+        if (GLEW_ARB_vertex_attrib_binding) {
+            glVertexAttribFormat(a.Location, a.Size, a.Type, a.Normalized, a.Offset);
+            glVertexAttribBinding(a.Location, VERTEX_BINDING);
+        }
+        else {
+            glVertexAttribPointer(a.Location, a.Size, a.Type, a.Normalized, Layout.Stride, (const GLvoid*)(size_t)a.Offset);
+        }
+
+        glEnableVertexAttribArray(a.Location);
+    }
+
+    RenderState::BindVertexArray(0);
+
+    return true;
+}
+
+GLuint Mesh::AddInstanceBuffer(GLuint Buffer, GLsizei Stride)
+{
+    InstanceBuffer b;
+    b.Buffer = Buffer;
+    b.Stride = Stride;
+    m_instanceBuffers.push_back(b);
+
+    const GLuint Binding = VERTEX_BINDING + m_instanceBuffers.size();
+
+    if (GLEW_ARB_vertex_attrib_binding) {
+        RenderState::BindVertexArray(m_VAO);
+        glBindVertexBuffer(Binding, Buffer, 0, Stride);
+        glVertexBindingDivisor(Binding, 1);
+        RenderState::BindVertexArray(0);
+    }
+
+    return Binding;
+}
+
+void Mesh::AddInstanceAttribute(GLuint Binding, GLuint Location, GLint Size, GLuint Offset)
+{
+    RenderState::BindVertexArray(m_VAO);
+
+    if (GLEW_ARB_vertex_attrib_binding) {
+        glVertexAttribFormat(Location, Size, GL_FLOAT, GL_FALSE, Offset);
+        glVertexAttribBinding(Location, Binding);
+    }
+    else {
+        // Without separate bindings the buffer and the divisor go with
+        // every attribute
+        const InstanceBuffer& b = m_instanceBuffers[Binding - VERTEX_BINDING - 1];
+        RenderState::BindBuffer(GL_ARRAY_BUFFER, b.Buffer);
+        glVertexAttribPointer(Location, Size, GL_FLOAT, GL_FALSE, b.Stride, (const GLvoid*)(size_t)Offset);
+        glVertexAttribDivisor(Location, 1);
+    }
+
+    glEnableVertexAttribArray(Location);
+
+    RenderState::BindVertexArray(0);
+}
+
+void Mesh::AddInstanceAttributeI(GLuint Binding, GLuint Location, GLint Size, GLuint Offset)
+{
+    RenderState::BindVertexArray(m_VAO);
+
+    if (GLEW_ARB_vertex_attrib_binding) {
+        glVertexAttribIFormat(Location, Size, GL_UNSIGNED_INT, Offset);
+        glVertexAttribBinding(Location, Binding);
+    }
+    else {
+        const InstanceBuffer& b = m_instanceBuffers[Binding - VERTEX_BINDING - 1];
+        RenderState::BindBuffer(GL_ARRAY_BUFFER, b.Buffer);
+        glVertexAttribIPointer(Location, Size, GL_UNSIGNED_INT, b.Stride, (const GLvoid*)(size_t)Offset);
+        glVertexAttribDivisor(Location, 1);
+    }
+
+    glEnableVertexAttribArray(Location);
+
+    RenderState::BindVertexArray(0);
+}
+
+void Mesh::Render()
+{
+    RenderState::BindVertexArray(m_VAO);
+    glDrawElements(GL_TRIANGLES, m_numIndices, m_indexType, 0);
+}
+
+void Mesh::RenderInstanced(unsigned int NumInstances)
+{
+    RenderState::BindVertexArray(m_VAO);
+    glDrawElementsInstanced(GL_TRIANGLES, m_numIndices, m_indexType, 0, NumInstances);
+}
+
+void Mesh::RenderSubmesh(unsigned int Index)
+{
+    const Submesh& s = m_submeshes[Index];
+
+    RenderState::BindVertexArray(m_VAO);
+    glDrawElements(GL_TRIANGLES, s.NumIndices, m_indexType, (const GLvoid*)(size_t)(s.FirstIndex * GetIndexSize()));
+}
+
+void Mesh::Unbind()
+{
+    RenderState::BindVertexArray(0);
+}
@@ -0,0 +1,127 @@
+#ifndef MESH_H
+#define	MESH_H
+
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+#include "math_3d.h"
+#include "vertex_format.h"
+
+struct Vertex
+{
+    Vector3f m_pos;
+    Vector2f m_tex;
+    Vector3f m_normal;
+
+    Vertex() {}
+
+    Vertex(Vector3f pos, Vector2f tex)
+    {
+        m_pos = pos;
+        m_tex = tex;
+        m_normal = Vector3f(0.0f, 0.0f, 0.0f);
+    }
+};
+
+class MeshFile;
+
+// Indexed triangle mesh of Vertex. The vertex layout (and any per-instance
+// buffers added afterwards) is captured once in a vertex array object, so a
+// draw is a single bind and a single draw call. With ARB_vertex_attrib_binding
+// the formats are specified apart from the buffers (glVertexAttribFormat /
+// glBindVertexBuffer), otherwise with glVertexAttribPointer.
+//
+// The vertices are kept in one of the VertexFormat layouts, FLOAT unless
+// asked otherwise; PACKED ones are drawn with their GetQuantization().
+//
+// A mesh loaded from a baked file (see mesh_file.h) keeps the 16 bit
+// indices of the file and its submesh ranges; meshes built in code are one
+// submesh with 32 bit indices.
+//
+// The mesh stays bound after Render(); code that sets up attributes of its
+// own must call Unbind() first so it does not change the mesh layout.
+class Mesh
+{
+public:
+
+    // Attribute locations of the vertex members in every shader
+    static const GLuint POSITION_LOCATION = 0;
+    static const GLuint TEX_COORD_LOCATION = 1;
+    static const GLuint NORMAL_LOCATION = 2;
+
+    Mesh();
+
+    ~Mesh();
+
+    bool Init(const Vertex* pVertices, unsigned int NumVertices,
+              const unsigned int* pIndices, unsigned int NumIndices,
+              VertexFormat Format = VERTEX_FORMAT_FLOAT);
+
+    bool Init(const MeshFile& File);
+
+    // Maps a baked mesh file and uploads it
+    bool Load(const std::string& FileName);
+
+    // Adds a buffer of per-instance data (advancing once per instance) and
+    // returns the binding to pass to AddInstanceAttribute(). The buffer
+    // stays owned by the caller.
+    GLuint AddInstanceBuffer(GLuint Buffer, GLsizei Stride);
+
+    // A float attribute of Size components at Offset inside each element
+    // of the instance buffer
+    void AddInstanceAttribute(GLuint Binding, GLuint Location, GLint Size, GLuint Offset);
+
+    // An unsigned integer attribute, read by the shader as uint/uvecN
+    void AddInstanceAttributeI(GLuint Binding, GLuint Location, GLint Size, GLuint Offset);
+
+    void Render();
+
+    void RenderInstanced(unsigned int NumInstances);
+
+    void RenderSubmesh(unsigned int Index);
+
+    static void Unbind();
+
+    unsigned int GetNumIndices() const { return m_numIndices; }
+
+    unsigned int GetNumSubmeshes() const { return m_submeshes.size(); }
+
+    GLuint GetVAO() const { return m_VAO; }
+
+    GLenum GetIndexType() const { return m_indexType; }
+
+    VertexFormat GetVertexFormat() const { return m_format; }
+
+    const VertexQuantization& GetQuantization() const { return m_quantization; }
+
+private:
+
+    struct InstanceBuffer {
+        GLuint Buffer;
+        GLsizei Stride;
+    };
+
+    struct Submesh {
+        unsigned int FirstIndex;
+        unsigned int NumIndices;
+    };
+
+    bool InitBuffers(const void* pVertices, unsigned int NumVertices,
+                     const void* pIndices, unsigned int IndexSize, unsigned int NumIndices);
+
+    unsigned int GetIndexSize() const { return m_indexType == GL_UNSIGNED_SHORT ? 2 : 4; }
+
+    GLuint m_VAO;
+    GLuint m_VBO;
+    GLuint m_IBO;
+    unsigned int m_numIndices;
+    GLenum m_indexType;
+    VertexFormat m_format;
+    VertexQuantization m_quantization;
+    std::vector<Submesh> m_submeshes;
+    std::vector<InstanceBuffer> m_instanceBuffers;
+};
+
+
+#endif	/* MESH_H */
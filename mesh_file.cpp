@@ -0,0 +1,185 @@
+#include <stdio.h>
+
+#include "mesh_file.h"
+
+#pragma once
+
+MeshFile::MeshFile()
+{
+    m_pHeader = NULL;
+    m_pSubmeshes = NULL;
+}
+
+bool MeshFile::Open(const std::string& FileName)
+{
+    if (!m_file.Open(FileName)) {
+        return false;
+    }
+
+    const size_t Size = m_file.GetSize();
+    const unsigned char* pData = (const unsigned char*)m_file.GetData();
+
+    m_pHeader = (const MeshFileHeader*)pData;
+    m_pSubmeshes = (const MeshFileSubmesh*)(pData + sizeof(MeshFileHeader));
+
+    if (Size < sizeof(MeshFileHeader) ||
+        m_pHeader->Magic != MESH_FILE_MAGIC ||
+        m_pHeader->Version != MESH_FILE_VERSION) {
+        fprintf(stderr, "'%s' is not a mesh file of version %d\n", FileName.c_str(), MESH_FILE_VERSION);
+        m_file.Close();
+        return false;
+    }
+
+    if (m_pHeader->VertexFormat >= NUM_VERTEX_FORMATS ||
+        m_pHeader->VertexSize != (uint32_t)GetVertexLayout(GetVertexFormat()).Stride ||
+        (m_pHeader->IndexSize != 2 && m_pHeader->IndexSize != 4)) {
+        fprintf(stderr, "'%s' has a different vertex or index layout\n", FileName.c_str());
+        m_file.Close();
+        return false;
+    }
+
+    if (Size < sizeof(MeshFileHeader) + sizeof(MeshFileSubmesh) * (size_t)m_pHeader->NumSubmeshes ||
+        (size_t)m_pHeader->VertexOffset + (size_t)m_pHeader->VertexSize * m_pHeader->NumVertices > Size ||
+        (size_t)m_pHeader->IndexOffset + (size_t)m_pHeader->IndexSize * m_pHeader->NumIndices > Size) {
+        fprintf(stderr, "'%s' is truncated\n", FileName.c_str());
+        m_file.Close();
+        return false;
+    }
+
+    for (unsigned int i = 0 ; i < m_pHeader->NumSubmeshes ; i++) {
+        if ((size_t)m_pSubmeshes[i].FirstIndex + m_pSubmeshes[i].NumIndices > m_pHeader->NumIndices) {
+            fprintf(stderr, "'%s' has a broken submesh table\n", FileName.c_str());
+            m_file.Close();
+            return false;
+        }
+    }
+
+    // An index past the vertices would make the GPU read outside the
+    // vertex buffer. One pass over the indices, which are read for the
+    // upload anyway.
+    if (GetMaxIndex() >= m_pHeader->NumVertices) {
+        fprintf(stderr, "'%s' has indices past its vertices\n", FileName.c_str());
+        m_file.Close();
+        return false;
+    }
+
+    return true;
+}
+
+unsigned int MeshFile::GetMaxIndex() const
+{
+    unsigned int Max = 0;
+
+    if (m_pHeader->IndexSize == 2) {
+        const uint16_t* pIndices = (const uint16_t*)GetIndices();
+
+        for (unsigned int i = 0 ; i < m_pHeader->NumIndices ; i++) {
+            Max = pIndices[i] > Max ? pIndices[i] : Max;
+        }
+    }
+    else {
+        const uint32_t* pIndices = (const uint32_t*)GetIndices();
+
+        for (unsigned int i = 0 ; i < m_pHeader->NumIndices ; i++) {
+            Max = pIndices[i] > Max ? pIndices[i] : Max;
+        }
+    }
+
+    return Max;
+}
+
+const void* MeshFile::GetVertices() const
+{
+    return (const unsigned char*)m_file.GetData() + m_pHeader->VertexOffset;
+}
+
+const void* MeshFile::GetIndices() const
+{
+    return (const unsigned char*)m_file.GetData() + m_pHeader->IndexOffset;
+}
+
+BoundingBox MeshFile::GetBounds() const
+{
+    BoundingBox Box;
+    Box.Min = Vector3f(m_pHeader->BoundsMin[0], m_pHeader->BoundsMin[1], m_pHeader->BoundsMin[2]);
+    Box.Max = Vector3f(m_pHeader->BoundsMax[0], m_pHeader->BoundsMax[1], m_pHeader->BoundsMax[2]);
+
+    return Box;
+}
+
+bool MeshFile::Write(const std::string& FileName, const std::vector<Vertex>& Vertices,
+                     const std::vector<unsigned int>& Indices, const std::vector<MeshFileSubmesh>& Submeshes,
+                     VertexFormat Format)
+{
+    if (Vertices.empty() || Indices.empty() || Submeshes.empty()) {
+        fprintf(stderr, "Nothing to write to '%s'\n", FileName.c_str());
+        return false;
+    }
+
+    FILE* f = fopen(FileName.c_str(), "wb");
+
+    if (!f) {
+        fprintf(stderr, "Error creating '%s'\n", FileName.c_str());
+        return false;
+    }
+
+    BoundingBox Bounds;
+
+    for (unsigned int i = 0 ; i < Vertices.size() ; i++) {
+        Bounds.Expand(Vertices[i].m_pos);
+    }
+
+    MeshFileHeader Header;
+    Header.Magic = MESH_FILE_MAGIC;
+    Header.Version = MESH_FILE_VERSION;
+    Header.VertexFormat = Format;
+    Header.VertexSize = GetVertexLayout(Format).Stride;
+    Header.NumVertices = Vertices.size();
+    Header.IndexSize = Vertices.size() <= 0x10000 ? 2 : 4;
+    Header.NumIndices = Indices.size();
+    Header.NumSubmeshes = Submeshes.size();
+    Header.BoundsMin[0] = Bounds.Min.x;
+    Header.BoundsMin[1] = Bounds.Min.y;
+    Header.BoundsMin[2] = Bounds.Min.z;
+    Header.BoundsMax[0] = Bounds.Max.x;
+    Header.BoundsMax[1] = Bounds.Max.y;
+    Header.BoundsMax[2] = Bounds.Max.z;
+
+    // Both blocks 16 byte aligned
+    const uint32_t TableEnd = sizeof(MeshFileHeader) + sizeof(MeshFileSubmesh) * Submeshes.size();
+    Header.VertexOffset = (TableEnd + 15) & ~15u;
+    Header.IndexOffset = (Header.VertexOffset + Header.VertexSize * Header.NumVertices + 15) & ~15u;
+
+    bool Ok = fwrite(&Header, sizeof(Header), 1, f) == 1 &&
+              fwrite(&Submeshes[0], sizeof(MeshFileSubmesh), Submeshes.size(), f) == Submeshes.size();
+
+    // Seeking past the end fills the alignment gaps with zeros
+    Ok = Ok && fseek(f, Header.VertexOffset, SEEK_SET) == 0;
+
+    if (Ok && Format == VERTEX_FORMAT_PACKED) {
+        std::vector<PackedVertex> Packed(Vertices.size());
+        PackVertices(&Vertices[0], Vertices.size(), CalcVertexQuantization(Bounds), &Packed[0]);
+        Ok = fwrite(&Packed[0], sizeof(PackedVertex), Packed.size(), f) == Packed.size();
+    }
+    else if (Ok) {
+        Ok = fwrite(&Vertices[0], sizeof(Vertex), Vertices.size(), f) == Vertices.size();
+    }
+
+    Ok = Ok && fseek(f, Header.IndexOffset, SEEK_SET) == 0;
+
+    if (Ok && Header.IndexSize == 2) {
+        std::vector<uint16_t> ShortIndices(Indices.begin(), Indices.end());
+        Ok = fwrite(&ShortIndices[0], sizeof(uint16_t), ShortIndices.size(), f) == ShortIndices.size();
+    }
+    else if (Ok) {
+        Ok = fwrite(&Indices[0], sizeof(uint32_t), Indices.size(), f) == Indices.size();
+    }
+
+    fclose(f);
+
+    if (!Ok) {
+        fprintf(stderr, "Error writing '%s'\n", FileName.c_str());
+    }
+
+    return Ok;
+}
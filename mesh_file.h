@@ -0,0 +1,83 @@
+#ifndef MESH_FILE_H
+#define	MESH_FILE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+#include "mesh.h"
+
+// Baked mesh: a header, a table of submeshes, the vertices in one of the
+// VertexFormat layouts and the indices, 16 bit when every vertex can be
+// addressed that way. Packed positions are quantized across the bounds in
+// the header. The file is memory mapped and the two blocks
+// go to the vertex and index buffers as they are. Files are made by
+// tools/mesh_baker.cpp.
+#define MESH_FILE_MAGIC   0x48534D47 // "GMSH"
+#define MESH_FILE_VERSION 2
+#define MESH_FILE_EXT     ".mesh"
+
+struct MeshFileHeader
+{
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t VertexFormat;  // A VertexFormat
+    uint32_t VertexSize;    // Stride of the format in the baker
+    uint32_t NumVertices;
+    uint32_t IndexSize;     // 2 or 4
+    uint32_t NumIndices;
+    uint32_t NumSubmeshes;
+    uint32_t VertexOffset;  // From the start of the file
+    uint32_t IndexOffset;
+    float BoundsMin[3];
+    float BoundsMax[3];
+};
+
+// Triangles of one material or object: a range of the shared index block
+struct MeshFileSubmesh
+{
+    uint32_t FirstIndex;
+    uint32_t NumIndices;
+};
+
+class MeshFile
+{
+public:
+
+    MeshFile();
+
+    bool Open(const std::string& FileName);
+
+    // Submeshes must not overlap and must cover their indices in order
+    static bool Write(const std::string& FileName, const std::vector<Vertex>& Vertices,
+                      const std::vector<unsigned int>& Indices, const std::vector<MeshFileSubmesh>& Submeshes,
+                      VertexFormat Format = VERTEX_FORMAT_FLOAT);
+
+    unsigned int GetNumVertices() const { return m_pHeader->NumVertices; }
+    unsigned int GetNumIndices() const { return m_pHeader->NumIndices; }
+    unsigned int GetIndexSize() const { return m_pHeader->IndexSize; }
+    unsigned int GetNumSubmeshes() const { return m_pHeader->NumSubmeshes; }
+    const MeshFileSubmesh& GetSubmesh(unsigned int Index) const { return m_pSubmeshes[Index]; }
+
+    VertexFormat GetVertexFormat() const { return (VertexFormat)m_pHeader->VertexFormat; }
+
+    // In the layout of GetVertexFormat()
+    const void* GetVertices() const;
+    const void* GetIndices() const;
+
+    BoundingBox GetBounds() const;
+
+    void Prefetch() const { m_file.Prefetch(); }
+
+private:
+
+    unsigned int GetMaxIndex() const;
+
+    MappedFile m_file;
+    const MeshFileHeader* m_pHeader;
+    const MeshFileSubmesh* m_pSubmeshes;
+};
+
+
+#endif	/* MESH_FILE_H */
@@ -0,0 +1,394 @@
+#include <algorithm>
+#include <math.h>
+
+#include "mesh_optimizer.h"
+
+#pragma once
+
+// Weights of the vertex score, as tuned by Forsyth
+#define CACHE_DECAY_POWER   1.5f
+#define LAST_TRIANGLE_SCORE 0.75f
+#define VALENCE_BOOST_SCALE 2.0f
+#define VALENCE_BOOST_POWER 0.5f
+
+MeshOptimizer::MeshOptimizer()
+{
+    for (unsigned int i = 0 ; i < SCORE_CACHE_SIZE ; i++) {
+        // The vertices of the last triangle get a fixed score, so the next
+        // triangle does not simply reuse the same edge
+        if (i < 3) {
+            m_cacheScores[i] = LAST_TRIANGLE_SCORE;
+        }
+        else {
+            const float Scale = 1.0f / (SCORE_CACHE_SIZE - 3);
+            m_cacheScores[i] = powf(1.0f - (i - 3) * Scale, CACHE_DECAY_POWER);
+        }
+    }
+
+    // Vertices with few triangles left get a boost, so they are finished
+    // off instead of staying around for a second miss later
+    m_valenceScores[0] = 0.0f;
+
+    for (unsigned int i = 1 ; i < MAX_VALENCE ; i++) {
+        m_valenceScores[i] = VALENCE_BOOST_SCALE * powf((float)i, -VALENCE_BOOST_POWER);
+    }
+}
+
+float MeshOptimizer::VertexScore(int CachePos, unsigned int NumTriangles) const
+{
+    if (NumTriangles == 0) {
+        return -1.0f;
+    }
+
+    float Score = CachePos >= 0 ? m_cacheScores[CachePos] : 0.0f;
+
+    if (NumTriangles < MAX_VALENCE) {
+        Score += m_valenceScores[NumTriangles];
+    }
+    else {
+        Score += VALENCE_BOOST_SCALE * powf((float)NumTriangles, -VALENCE_BOOST_POWER);
+    }
+
+    return Score;
+}
+
+void MeshOptimizer::BuildAdjacency(const unsigned int* pIndices, unsigned int NumIndices, unsigned int NumVertices)
+{
+    m_numTriangles.assign(NumVertices, 0);
+
+    for (unsigned int i = 0 ; i < NumIndices ; i++) {
+        m_numTriangles[pIndices[i]]++;
+    }
+
+    m_firstTriangle.resize(NumVertices);
+    unsigned int Offset = 0;
+
+    for (unsigned int v = 0 ; v < NumVertices ; v++) {
+        m_firstTriangle[v] = Offset;
+        Offset += m_numTriangles[v];
+    }
+
+    // Filled through the counts, which end up as they started
+    m_vertexTriangles.resize(NumIndices);
+    std::fill(m_numTriangles.begin(), m_numTriangles.end(), 0);
+
+    for (unsigned int i = 0 ; i < NumIndices ; i++) {
+        const unsigned int v = pIndices[i];
+        m_vertexTriangles[m_firstTriangle[v] + m_numTriangles[v]++] = i / 3;
+    }
+}
+
+void MeshOptimizer::OptimizeVertexCache(unsigned int* pIndices, unsigned int NumIndices, unsigned int NumVertices)
+{
+    const unsigned int NumFaces = NumIndices / 3;
+
+    if (NumFaces == 0) {
+        return;
+    }
+
+    BuildAdjacency(pIndices, NumIndices, NumVertices);
+
+    m_cachePos.assign(NumVertices, -1);
+    m_vertexScores.resize(NumVertices);
+
+    for (unsigned int v = 0 ; v < NumVertices ; v++) {
+        m_vertexScores[v] = VertexScore(-1, m_numTriangles[v]);
+    }
+
+    m_triangleScores.resize(NumFaces);
+    m_emitted.assign(NumFaces, false);
+
+    int Best = 0;
+
+    for (unsigned int t = 0 ; t < NumFaces ; t++) {
+        const unsigned int* pFace = &pIndices[t * 3];
+        m_triangleScores[t] = m_vertexScores[pFace[0]] + m_vertexScores[pFace[1]] + m_vertexScores[pFace[2]];
+
+        if (m_triangleScores[t] > m_triangleScores[Best]) {
+            Best = t;
+        }
+    }
+
+    m_scratch.resize(NumFaces * 3);
+
+    // The three extra entries hold what the last triangle pushes out
+    unsigned int Cache[SCORE_CACHE_SIZE + 3];
+    unsigned int CacheSize = 0;
+    unsigned int Cursor = 0;
+
+    for (unsigned int Out = 0 ; Out < NumFaces ; Out++) {
+        // No triangle of the cached vertices is left, so start over from
+        // the first one not emitted
+        if (Best < 0) {
+            while (m_emitted[Cursor]) {
+                Cursor++;
+            }
+
+            Best = Cursor;
+        }
+
+        const unsigned int* pFace = &pIndices[Best * 3];
+        m_scratch[Out * 3] = pFace[0];
+        m_scratch[Out * 3 + 1] = pFace[1];
+        m_scratch[Out * 3 + 2] = pFace[2];
+        m_emitted[Best] = true;
+
+        for (unsigned int k = 0 ; k < 3 ; k++) {
+            const unsigned int v = pFace[k];
+            unsigned int* pTriangles = &m_vertexTriangles[m_firstTriangle[v]];
+            unsigned int* pLast = pTriangles + m_numTriangles[v] - 1;
+
+            // Twice the same vertex in a degenerate triangle removes it once
+            unsigned int* p = std::find(pTriangles, pLast + 1, (unsigned int)Best);
+
+            if (p <= pLast) {
+                std::swap(*p, *pLast);
+                m_numTriangles[v]--;
+            }
+        }
+
+        // The new triangle goes to the front of the LRU cache
+        unsigned int NewCache[SCORE_CACHE_SIZE + 3];
+        unsigned int NewSize = 0;
+
+        for (unsigned int k = 0 ; k < 3 ; k++) {
+            if (std::find(NewCache, NewCache + NewSize, pFace[k]) == NewCache + NewSize) {
+                NewCache[NewSize++] = pFace[k];
+            }
+        }
+
+        for (unsigned int i = 0 ; i < CacheSize ; i++) {
+            const unsigned int v = Cache[i];
+
+            if (v != pFace[0] && v != pFace[1] && v != pFace[2]) {
+                NewCache[NewSize++] = v;
+            }
+        }
+
+        // Rescores the cached vertices and the ones just evicted, and the
+        // triangles that use them
+        for (unsigned int i = 0 ; i < NewSize ; i++) {
+            const unsigned int v = NewCache[i];
+            m_cachePos[v] = i < SCORE_CACHE_SIZE ? (int)i : -1;
+
+            const float Score = VertexScore(m_cachePos[v], m_numTriangles[v]);
+            const float Delta = Score - m_vertexScores[v];
+            m_vertexScores[v] = Score;
+
+            const unsigned int* pTriangles = &m_vertexTriangles[m_firstTriangle[v]];
+
+            for (unsigned int j = 0 ; j < m_numTriangles[v] ; j++) {
+                m_triangleScores[pTriangles[j]] += Delta;
+            }
+        }
+
+        CacheSize = std::min(NewSize, SCORE_CACHE_SIZE);
+        std::copy(NewCache, NewCache + CacheSize, Cache);
+
+        // Only triangles of cached vertices are candidates, the rest score
+        // no better than they did before
+        Best = -1;
+        float BestScore = -1.0f;
+
+        for (unsigned int i = 0 ; i < CacheSize ; i++) {
+            const unsigned int v = Cache[i];
+            const unsigned int* pTriangles = &m_vertexTriangles[m_firstTriangle[v]];
+
+            for (unsigned int j = 0 ; j < m_numTriangles[v] ; j++) {
+                if (m_triangleScores[pTriangles[j]] > BestScore) {
+                    BestScore = m_triangleScores[pTriangles[j]];
+                    Best = pTriangles[j];
+                }
+            }
+        }
+    }
+
+    std::copy(m_scratch.begin(), m_scratch.end(), pIndices);
+}
+
+float MeshOptimizer::CalcACMR(const unsigned int* pIndices, unsigned int NumIndices, unsigned int NumVertices)
+{
+    if (NumIndices < 3) {
+        return 0.0f;
+    }
+
+    // A vertex is in the FIFO while fewer than CACHE_SIZE vertices were
+    // added after it
+    m_stamps.assign(NumVertices, 0);
+    unsigned int Time = CACHE_SIZE + 1;
+    unsigned int Misses = 0;
+
+    for (unsigned int i = 0 ; i < NumIndices ; i++) {
+        const unsigned int v = pIndices[i];
+
+        if (Time - m_stamps[v] > CACHE_SIZE) {
+            m_stamps[v] = Time++;
+            Misses++;
+        }
+    }
+
+    return (float)Misses / (NumIndices / 3);
+}
+
+void MeshOptimizer::OptimizeOverdraw(unsigned int* pIndices, unsigned int NumIndices,
+                                     const Vertex* pVertices, unsigned int NumVertices, float Threshold)
+{
+    const unsigned int NumFaces = NumIndices / 3;
+
+    if (NumFaces == 0) {
+        return;
+    }
+
+    const float MaxACMR = CalcACMR(pIndices, NumIndices, NumVertices) * Threshold;
+
+    // Same FIFO as CalcACMR. A cluster starts where every vertex of a
+    // triangle misses, so moving it costs nothing, or where the cluster
+    // is still under the allowed ACMR when started cold.
+    m_stamps.assign(NumVertices, 0);
+    unsigned int Time = CACHE_SIZE + 1;
+    unsigned int ClusterMisses = 0;
+
+    m_clusters.clear();
+
+    for (unsigned int t = 0 ; t < NumFaces ; t++) {
+        const unsigned int* pFace = &pIndices[t * 3];
+        unsigned int Misses = 0;
+
+        for (unsigned int k = 0 ; k < 3 ; k++) {
+            Misses += Time - m_stamps[pFace[k]] > CACHE_SIZE ? 1 : 0;
+        }
+
+        bool NewCluster = m_clusters.empty() || Misses == 3;
+
+        if (!NewCluster && Threshold > 1.0f) {
+            const unsigned int ClusterFaces = t - m_clusters.back().First / 3;
+            NewCluster = (float)ClusterMisses / ClusterFaces <= MaxACMR;
+        }
+
+        if (NewCluster) {
+            if (!m_clusters.empty()) {
+                m_clusters.back().NumIndices = t * 3 - m_clusters.back().First;
+            }
+
+            Cluster c;
+            c.First = t * 3;
+            c.NumIndices = 0;
+            c.SortKey = 0.0f;
+            m_clusters.push_back(c);
+
+            // The cluster may end up anywhere, so it starts cold
+            Time += CACHE_SIZE + 1;
+            ClusterMisses = 0;
+        }
+
+        for (unsigned int k = 0 ; k < 3 ; k++) {
+            if (Time - m_stamps[pFace[k]] > CACHE_SIZE) {
+                m_stamps[pFace[k]] = Time++;
+                ClusterMisses++;
+            }
+        }
+    }
+
+    m_clusters.back().NumIndices = NumIndices - m_clusters.back().First;
+
+    if (m_clusters.size() > 1) {
+        SortClusters(pIndices, pVertices);
+    }
+}
+
+bool MeshOptimizer::CompareClusters(const Cluster& l, const Cluster& r)
+{
+    return l.SortKey > r.SortKey;
+}
+
+void MeshOptimizer::SortClusters(unsigned int* pIndices, const Vertex* pVertices)
+{
+    // Area weighted centroid of the mesh and of every cluster, and the
+    // summed normal of every cluster
+    Vector3f MeshCentroid(0.0f, 0.0f, 0.0f);
+    float MeshArea = 0.0f;
+
+    std::vector<Vector3f> Centroids(m_clusters.size(), Vector3f(0.0f, 0.0f, 0.0f));
+    std::vector<Vector3f> Normals(m_clusters.size(), Vector3f(0.0f, 0.0f, 0.0f));
+
+    for (unsigned int c = 0 ; c < m_clusters.size() ; c++) {
+        float ClusterArea = 0.0f;
+
+        for (unsigned int i = 0 ; i < m_clusters[c].NumIndices ; i += 3) {
+            const unsigned int* pFace = &pIndices[m_clusters[c].First + i];
+            const Vector3f& p0 = pVertices[pFace[0]].m_pos;
+            const Vector3f& p1 = pVertices[pFace[1]].m_pos;
+            const Vector3f& p2 = pVertices[pFace[2]].m_pos;
+
+            // Same winding as NormalGenerator, twice the area long
+            const Vector3f Normal = (p1 - p0).Cross(p2 - p0);
+            const float Area = sqrtf(Normal.x * Normal.x + Normal.y * Normal.y + Normal.z * Normal.z);
+
+            Centroids[c] += (p0 + p1 + p2) * (Area / 3.0f);
+            Normals[c] += Normal;
+            ClusterArea += Area;
+        }
+
+        MeshCentroid += Centroids[c];
+        MeshArea += ClusterArea;
+
+        if (ClusterArea > 0.0f) {
+            Centroids[c] *= 1.0f / ClusterArea;
+        }
+    }
+
+    if (MeshArea > 0.0f) {
+        MeshCentroid *= 1.0f / MeshArea;
+    }
+
+    for (unsigned int c = 0 ; c < m_clusters.size() ; c++) {
+        const Vector3f Offset = Centroids[c] - MeshCentroid;
+        const Vector3f& n = Normals[c];
+        const float Length = sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+
+        m_clusters[c].SortKey = Length > 0.0f ? (Offset.x * n.x + Offset.y * n.y + Offset.z * n.z) / Length : 0.0f;
+    }
+
+    std::stable_sort(m_clusters.begin(), m_clusters.end(), &MeshOptimizer::CompareClusters);
+
+    m_scratch.resize(0);
+
+    for (unsigned int c = 0 ; c < m_clusters.size() ; c++) {
+        m_scratch.insert(m_scratch.end(), pIndices + m_clusters[c].First,
+                         pIndices + m_clusters[c].First + m_clusters[c].NumIndices);
+    }
+
+    std::copy(m_scratch.begin(), m_scratch.end(), pIndices);
+}
+
+unsigned int MeshOptimizer::OptimizeVertexFetch(Vertex* pVertices, unsigned int NumVertices,
+                                                unsigned int* pIndices, unsigned int NumIndices)
+{
+    const unsigned int UNUSED = 0xFFFFFFFF;
+
+    // m_scratch maps old vertices to new ones
+    m_scratch.assign(NumVertices, UNUSED);
+    unsigned int NumUsed = 0;
+
+    for (unsigned int i = 0 ; i < NumIndices ; i++) {
+        unsigned int& Remap = m_scratch[pIndices[i]];
+
+        if (Remap == UNUSED) {
+            Remap = NumUsed++;
+        }
+
+        pIndices[i] = Remap;
+    }
+
+    std::vector<Vertex> Reordered(NumUsed);
+
+    for (unsigned int v = 0 ; v < NumVertices ; v++) {
+        if (m_scratch[v] != UNUSED) {
+            Reordered[m_scratch[v]] = pVertices[v];
+        }
+    }
+
+    std::copy(Reordered.begin(), Reordered.end(), pVertices);
+
+    return NumUsed;
+}
@@ -0,0 +1,247 @@
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <thread>
+
+#include "normal_generator.h"
+
+// Vertices or faces handed to a thread at least, below that the thread
+// costs more than it saves
+#define MIN_ITEMS_PER_THREAD 16384
+
+NormalGenerator::NormalGenerator()
+{
+    m_pIndices = NULL;
+    m_numFaces = 0;
+    m_pVertices = NULL;
+    m_numVertices = 0;
+    m_pTangents = NULL;
+    m_numThreads = 1;
+}
+
+void NormalGenerator::Run(const unsigned int* pIndices, unsigned int NumIndices,
+                          Vertex* pVertices, unsigned int NumVertices,
+                          unsigned int NumThreads, Vector4f* pTangents)
+{
+    m_pIndices = pIndices;
+    m_numFaces = NumIndices / 3;
+    m_pVertices = pVertices;
+    m_numVertices = NumVertices;
+    m_pTangents = pTangents;
+
+    // Every thread clears and sums a buffer as large as the mesh, so small
+    // meshes take fewer threads
+    m_numThreads = NumThreads;
+
+    if (m_numThreads > m_numFaces / MIN_ITEMS_PER_THREAD) {
+        m_numThreads = m_numFaces / MIN_ITEMS_PER_THREAD;
+    }
+
+    if (m_numThreads < 1) {
+        m_numThreads = 1;
+    }
+
+    m_normals.resize(m_numThreads * NumVertices);
+
+    if (pTangents) {
+        m_tangents.resize(m_numThreads * NumVertices);
+        m_bitangents.resize(m_numThreads * NumVertices);
+    }
+
+    RunParallel(&NormalGenerator::AccumulateFaces, m_numFaces);
+    RunParallel(&NormalGenerator::ResolveVertices, m_numVertices);
+}
+
+void NormalGenerator::AccumulateFaces(unsigned int Thread, unsigned int First, unsigned int Last)
+{
+    // Cleared by the thread using it, so its pages are local to that thread
+    Vector3f* pNormals = &m_normals[Thread * m_numVertices];
+    std::fill(pNormals, pNormals + m_numVertices, Vector3f(0.0f, 0.0f, 0.0f));
+
+    AccumulateNormals(pNormals, First, Last);
+
+    if (m_pTangents) {
+        Vector3f* pTangents = &m_tangents[Thread * m_numVertices];
+        Vector3f* pBitangents = &m_bitangents[Thread * m_numVertices];
+        std::fill(pTangents, pTangents + m_numVertices, Vector3f(0.0f, 0.0f, 0.0f));
+        std::fill(pBitangents, pBitangents + m_numVertices, Vector3f(0.0f, 0.0f, 0.0f));
+
+        AccumulateTangents(pTangents, pBitangents, First, Last);
+    }
+}
+
+void NormalGenerator::AccumulateNormals(Vector3f* pNormals, unsigned int First, unsigned int Last)
+{
+    const unsigned int* pIndices = m_pIndices;
+    const Vertex* pVertices = m_pVertices;
+    unsigned int i = First;
+
+#ifdef MATH_3D_SIMD
+    // Four triangles per iteration, one per lane, the components of every
+    // edge in separate registers
+    const Simd4f MinLength = Simd4fSplat(FLT_MIN);
+
+    for ( ; i + 4 <= Last ; i += 4) {
+        const unsigned int* pFace = pIndices + i * 3;
+        float e[2][3][4];
+
+        for (unsigned int t = 0 ; t < 4 ; t++) {
+            const Vector3f& p0 = pVertices[pFace[t * 3]].m_pos;
+            const Vector3f& p1 = pVertices[pFace[t * 3 + 1]].m_pos;
+            const Vector3f& p2 = pVertices[pFace[t * 3 + 2]].m_pos;
+            e[0][0][t] = p1.x - p0.x;
+            e[0][1][t] = p1.y - p0.y;
+            e[0][2][t] = p1.z - p0.z;
+            e[1][0][t] = p2.x - p0.x;
+            e[1][1][t] = p2.y - p0.y;
+            e[1][2][t] = p2.z - p0.z;
+        }
+
+        const Simd4f e1x = Simd4fLoad(e[0][0]);
+        const Simd4f e1y = Simd4fLoad(e[0][1]);
+        const Simd4f e1z = Simd4fLoad(e[0][2]);
+        const Simd4f e2x = Simd4fLoad(e[1][0]);
+        const Simd4f e2y = Simd4fLoad(e[1][1]);
+        const Simd4f e2z = Simd4fLoad(e[1][2]);
+
+        Simd4f nx = Simd4fSub(Simd4fMul(e1y, e2z), Simd4fMul(e1z, e2y));
+        Simd4f ny = Simd4fSub(Simd4fMul(e1z, e2x), Simd4fMul(e1x, e2z));
+        Simd4f nz = Simd4fSub(Simd4fMul(e1x, e2y), Simd4fMul(e1y, e2x));
+
+        // Degenerate triangles come out as zero instead of NaN
+        const Simd4f Length = Simd4fMax(Simd4fSqrt(Simd4fMulAdd(nx, nx, Simd4fMulAdd(ny, ny, Simd4fMul(nz, nz)))), MinLength);
+        const Simd4f InvLength = Simd4fDiv(Simd4fSplat(1.0f), Length);
+
+        float n[3][4];
+        Simd4fStore(n[0], Simd4fMul(nx, InvLength));
+        Simd4fStore(n[1], Simd4fMul(ny, InvLength));
+        Simd4fStore(n[2], Simd4fMul(nz, InvLength));
+
+        for (unsigned int t = 0 ; t < 4 ; t++) {
+            const Vector3f Normal(n[0][t], n[1][t], n[2][t]);
+            pNormals[pFace[t * 3]] += Normal;
+            pNormals[pFace[t * 3 + 1]] += Normal;
+            pNormals[pFace[t * 3 + 2]] += Normal;
+        }
+    }
+#endif
+
+    for ( ; i < Last ; i++) {
+        const unsigned int* pFace = pIndices + i * 3;
+        const Vector3f& p0 = pVertices[pFace[0]].m_pos;
+
+        Vector3f Normal = (pVertices[pFace[1]].m_pos - p0).Cross(pVertices[pFace[2]].m_pos - p0);
+        const float Length = sqrtf(Normal.x * Normal.x + Normal.y * Normal.y + Normal.z * Normal.z);
+
+        if (Length > 0.0f) {
+            Normal *= 1.0f / Length;
+            pNormals[pFace[0]] += Normal;
+            pNormals[pFace[1]] += Normal;
+            pNormals[pFace[2]] += Normal;
+        }
+    }
+}
+
+void NormalGenerator::AccumulateTangents(Vector3f* pTangents, Vector3f* pBitangents, unsigned int First, unsigned int Last)
+{
+    for (unsigned int i = First ; i < Last ; i++) {
+        const unsigned int* pFace = m_pIndices + i * 3;
+        const Vertex& v0 = m_pVertices[pFace[0]];
+        const Vertex& v1 = m_pVertices[pFace[1]];
+        const Vertex& v2 = m_pVertices[pFace[2]];
+
+        const Vector3f e1 = v1.m_pos - v0.m_pos;
+        const Vector3f e2 = v2.m_pos - v0.m_pos;
+        const float du1 = v1.m_tex.x - v0.m_tex.x;
+        const float dv1 = v1.m_tex.y - v0.m_tex.y;
+        const float du2 = v2.m_tex.x - v0.m_tex.x;
+        const float dv2 = v2.m_tex.y - v0.m_tex.y;
+
+        // Solves e1 = du1 * T + dv1 * B, e2 = du2 * T + dv2 * B; faces
+        // without a texture mapping add nothing
+        const float Det = du1 * dv2 - du2 * dv1;
+
+        if (fabsf(Det) < FLT_MIN) {
+            continue;
+        }
+
+        const float r = 1.0f / Det;
+        const Vector3f Tangent = (e1 * dv2 - e2 * dv1) * r;
+        const Vector3f Bitangent = (e2 * du1 - e1 * du2) * r;
+
+        for (unsigned int j = 0 ; j < 3 ; j++) {
+            pTangents[pFace[j]] += Tangent;
+            pBitangents[pFace[j]] += Bitangent;
+        }
+    }
+}
+
+void NormalGenerator::ResolveVertices(unsigned int /* Thread */, unsigned int First, unsigned int Last)
+{
+    for (unsigned int i = First ; i < Last ; i++) {
+        Vector3f Normal = m_normals[i];
+
+        for (unsigned int t = 1 ; t < m_numThreads ; t++) {
+            Normal += m_normals[t * m_numVertices + i];
+        }
+
+        // Unused vertices keep a zero normal
+        if (Normal.x != 0.0f || Normal.y != 0.0f || Normal.z != 0.0f) {
+            Normal.Normalize();
+        }
+
+        m_pVertices[i].m_normal = Normal;
+
+        if (!m_pTangents) {
+            continue;
+        }
+
+        Vector3f Tangent = m_tangents[i];
+        Vector3f Bitangent = m_bitangents[i];
+
+        for (unsigned int t = 1 ; t < m_numThreads ; t++) {
+            Tangent += m_tangents[t * m_numVertices + i];
+            Bitangent += m_bitangents[t * m_numVertices + i];
+        }
+
+        // Gram-Schmidt against the normal
+        Tangent -= Normal * (Normal.x * Tangent.x + Normal.y * Tangent.y + Normal.z * Tangent.z);
+
+        if (Tangent.x == 0.0f && Tangent.y == 0.0f && Tangent.z == 0.0f) {
+            m_pTangents[i] = Vector4f(0.0f, 0.0f, 0.0f, 1.0f);
+            continue;
+        }
+
+        Tangent.Normalize();
+
+        const Vector3f c = Normal.Cross(Tangent);
+        const float Handedness = (c.x * Bitangent.x + c.y * Bitangent.y + c.z * Bitangent.z) < 0.0f ? -1.0f : 1.0f;
+
+        m_pTangents[i] = Vector4f(Tangent, Handedness);
+    }
+}
+
+void NormalGenerator::RunParallel(void (NormalGenerator::*pFunc)(unsigned int, unsigned int, unsigned int), unsigned int Count)
+{
+    if (m_numThreads <= 1) {
+        (this->*pFunc)(0, 0, Count);
+        return;
+    }
+
+    std::vector<std::thread> Workers;
+
+    // Ranges are a multiple of four, so only the last one has a scalar tail
+    const unsigned int ItemsPerThread = ((Count + m_numThreads - 1) / m_numThreads + 3) & ~3u;
+
+    for (unsigned int t = 1 ; t < m_numThreads ; t++) {
+        const unsigned int First = t * ItemsPerThread < Count ? t * ItemsPerThread : Count;
+        const unsigned int Last = First + ItemsPerThread < Count ? First + ItemsPerThread : Count;
+        Workers.push_back(std::thread(pFunc, this, t, First, Last));
+    }
+
+    (this->*pFunc)(0, 0, ItemsPerThread < Count ? ItemsPerThread : Count);
+
+    for (unsigned int i = 0 ; i < Workers.size() ; i++) {
+        Workers[i].join();
+    }
+}
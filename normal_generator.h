@@ -0,0 +1,63 @@
+#ifndef NORMAL_GENERATOR_H
+#define	NORMAL_GENERATOR_H
+
+#include <vector>
+
+#include "math_3d.h"
+#include "mesh.h"
+
+// Smooth vertex normals, and optionally tangents, of indexed triangle
+// meshes. Every vertex gets the normalized sum of the unit normals of the
+// triangles using it.
+//
+// The triangles are split between threads, and every thread adds its face
+// normals into an accumulation buffer of its own, so there are no shared
+// writes. The buffers are then summed and normalized per vertex range, again
+// in parallel. Face normals are computed four triangles at a time with the
+// math_simd kernels. The buffers are kept between calls, so one generator
+// can process many meshes without reallocating.
+class NormalGenerator
+{
+public:
+
+    NormalGenerator();
+
+    // Overwrites m_normal of every vertex. With pTangents (NumVertices
+    // entries) the tangents along the texture u direction are written as
+    // well, orthogonal to the normal, with the handedness of the bitangent
+    // in w. Degenerate triangles add nothing.
+    void Run(const unsigned int* pIndices, unsigned int NumIndices,
+             Vertex* pVertices, unsigned int NumVertices,
+             unsigned int NumThreads, Vector4f* pTangents = NULL);
+
+private:
+
+    // Accumulates the faces of thread Thread, which are [First, Last)
+    void AccumulateFaces(unsigned int Thread, unsigned int First, unsigned int Last);
+
+    void AccumulateNormals(Vector3f* pNormals, unsigned int First, unsigned int Last);
+
+    void AccumulateTangents(Vector3f* pTangents, Vector3f* pBitangents, unsigned int First, unsigned int Last);
+
+    // Sums the buffers of all threads for the vertices of Thread
+    void ResolveVertices(unsigned int Thread, unsigned int First, unsigned int Last);
+
+    // Calls pFunc(Thread, First, Last) with [0, Count) split into one
+    // contiguous range per thread
+    void RunParallel(void (NormalGenerator::*pFunc)(unsigned int, unsigned int, unsigned int), unsigned int Count);
+
+    const unsigned int* m_pIndices;
+    unsigned int m_numFaces;
+    Vertex* m_pVertices;
+    unsigned int m_numVertices;
+    Vector4f* m_pTangents;
+    unsigned int m_numThreads;
+
+    // NumVertices entries per thread
+    std::vector<Vector3f> m_normals;
+    std::vector<Vector3f> m_tangents;
+    std::vector<Vector3f> m_bitangents;
+};
+
+
+#endif	/* NORMAL_GENERATOR_H */
@@ -0,0 +1,59 @@
+#include "null_technique.h"
+#include "render_state.h"
+
+static const char* pNullVS = "                                                      \n\
+#version 330                                                                        \n\
+                                                                                    \n\
+layout (location = 0) in vec3 Position;                                             \n\
+                                                                                    \n\
+uniform mat4 gWVP;                                                                  \n\
+                                                                                    \n\
+void main()                                                                         \n\
+{                                                                                   \n\
+    gl_Position = gWVP * vec4(Position, 1.0);                                       \n\
+}";
+
+static const char* pNullFS = "                                                      \n\
+#version 330                                                                        \n\
+                                                                                    \n\
+void main()                                                                         \n\
+{                                                                                   \n\
+}";
+
+
+NullTechnique::NullTechnique()
+{
+}
+
+bool NullTechnique::Init()
+{
+    if (!Technique::Init()) {
+        return false;
+    }
+
+    if (!AddShader(GL_VERTEX_SHADER, pNullVS)) {
+        return false;
+    }
+
+    if (!AddShader(GL_FRAGMENT_SHADER, pNullFS)) {
+        return false;
+    }
+
+    return Finalize();
+}
+
+bool NullTechnique::ResolveUniforms()
+{
+    m_WVPLocation = GetUniformLocation("gWVP");
+
+    if (m_WVPLocation == INVALID_UNIFORM_LOCATION) {
+        return false;
+    }
+
+    return true;
+}
+
+void NullTechnique::SetWVP(const Matrix4f& WVP)
+{
+    RenderState::UniformMatrix4fv(m_WVPLocation, 1, GL_TRUE, (const GLfloat*)WVP.m);
+}
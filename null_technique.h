@@ -0,0 +1,28 @@
+#ifndef NULL_TECHNIQUE_H
+#define	NULL_TECHNIQUE_H
+
+#include "technique.h"
+#include "math_3d.h"
+
+// Transforms positions and writes nothing: used when only depth or stencil
+// results are wanted
+class NullTechnique : public Technique {
+public:
+
+    NullTechnique();
+
+    virtual bool Init();
+
+    void SetWVP(const Matrix4f& WVP);
+
+protected:
+
+    virtual bool ResolveUniforms();
+
+private:
+
+    GLuint m_WVPLocation;
+};
+
+
+#endif	/* NULL_TECHNIQUE_H */
@@ -1,27 +1,134 @@
+#include <functional>
+#include <thread>
+#include <vector>
+
 #include "pipeline.h"
 
 const Matrix4f& Pipeline::GetWorldTrans()
 {
-    Matrix4f ScaleTrans, RotateTrans, TranslationTrans;
+    if (m_dirty & DIRTY_ROTATE) {
+        m_rotateTrans.InitRotateTransform(m_rotateInfo.x, m_rotateInfo.y, m_rotateInfo.z);
+    }
+
+    if (m_dirty & DIRTY_WORLD) {
+        // Translation * Rotation * Scale: scale the columns of the cached
+        // rotation and put the position into the last column
+        for (unsigned int i = 0 ; i < 3 ; i++) {
+            m_WorldTransformation.m[i][0] = m_rotateTrans.m[i][0] * m_scale.x;
+            m_WorldTransformation.m[i][1] = m_rotateTrans.m[i][1] * m_scale.y;
+            m_WorldTransformation.m[i][2] = m_rotateTrans.m[i][2] * m_scale.z;
+        }
 
-    ScaleTrans.InitScaleTransform(m_scale.x, m_scale.y, m_scale.z);
-    RotateTrans.InitRotateTransform(m_rotateInfo.x, m_rotateInfo.y, m_rotateInfo.z);
-    TranslationTrans.InitTranslationTransform(m_worldPos.x, m_worldPos.y, m_worldPos.z);
+        m_WorldTransformation.m[0][3] = m_worldPos.x;
+        m_WorldTransformation.m[1][3] = m_worldPos.y;
+        m_WorldTransformation.m[2][3] = m_worldPos.z;
+        m_WorldTransformation.m[3][0] = 0.0f;
+        m_WorldTransformation.m[3][1] = 0.0f;
+        m_WorldTransformation.m[3][2] = 0.0f;
+        m_WorldTransformation.m[3][3] = 1.0f;
+
+        m_dirty = (m_dirty & ~DIRTY_WORLD) | DIRTY_WVP;
+    }
 
-    m_WorldTransformation = TranslationTrans * RotateTrans * ScaleTrans;
     return m_WorldTransformation;
 }
 
+const Matrix4f& Pipeline::GetVPTrans()
+{
+    if (m_dirty & DIRTY_CAMERA) {
+        Matrix4f CameraTranslationTrans, CameraRotateTrans;
+
+        CameraTranslationTrans.InitTranslationTransform(-m_camera.Pos.x, -m_camera.Pos.y, -m_camera.Pos.z);
+        CameraRotateTrans.InitCameraTransform(m_camera.Target, m_camera.Up);
+        m_viewTrans = CameraRotateTrans * CameraTranslationTrans;
+    }
+
+    if (m_dirty & DIRTY_PROJ) {
+        m_projTrans.InitPersProjTransform(m_persProj.FOV, m_persProj.Width, m_persProj.Height, m_persProj.zNear, m_persProj.zFar);
+    }
+
+    if (m_dirty & DIRTY_VP) {
+        m_VPtransformation = m_projTrans * m_viewTrans;
+        m_dirty = (m_dirty & ~DIRTY_VP) | DIRTY_WVP;
+    }
+
+    return m_VPtransformation;
+}
+
 const Matrix4f& Pipeline::GetWVPTrans()
 {
     GetWorldTrans();
+    GetVPTrans();
 
-    Matrix4f CameraTranslationTrans, CameraRotateTrans, PersProjTrans;
-
-    CameraTranslationTrans.InitTranslationTransform(-m_camera.Pos.x, -m_camera.Pos.y, -m_camera.Pos.z);
-    CameraRotateTrans.InitCameraTransform(m_camera.Target, m_camera.Up);
-    PersProjTrans.InitPersProjTransform(m_persProj.FOV, m_persProj.Width, m_persProj.Height, m_persProj.zNear, m_persProj.zFar);
+    if (m_dirty & DIRTY_WVP) {
+        m_WVPtransformation = m_VPtransformation * m_WorldTransformation;
+        m_dirty &= ~DIRTY_WVP;
+    }
 
-    m_WVPtransformation = PersProjTrans * CameraRotateTrans * CameraTranslationTrans * m_WorldTransformation;
     return m_WVPtransformation;
 }
+
+static void CalcTransRange(unsigned int First, unsigned int Last, const Matrix4f* pVP,
+                           const Vector3f* pScale, const Vector3f* pRotate, const Vector3f* pWorldPos,
+                           Matrix4f* pWorldTrans, Matrix4f* pWVPTrans)
+{
+    const Vector3f UnitScale(1.0f, 1.0f, 1.0f);
+    const Vector3f NoRotation(0.0f, 0.0f, 0.0f);
+
+    for (unsigned int i = First ; i < Last ; i++) {
+        Matrix4f World;
+        World.InitWorldTransform(pScale ? pScale[i] : UnitScale,
+                                 pRotate ? pRotate[i] : NoRotation,
+                                 pWorldPos[i]);
+
+        if (pWorldTrans) {
+            pWorldTrans[i] = World;
+        }
+
+        if (pWVPTrans) {
+            Mat4Mul(&pWVPTrans[i].m[0][0], &pVP->m[0][0], &World.m[0][0]);
+        }
+    }
+}
+
+void Pipeline::GetTransBatch(unsigned int NumObjects,
+                             const Vector3f* pScale,
+                             const Vector3f* pRotate,
+                             const Vector3f* pWorldPos,
+                             Matrix4f* pWorldTrans,
+                             Matrix4f* pWVPTrans,
+                             unsigned int NumThreads)
+{
+    // Without WVP matrices the camera and projection are not needed and may
+    // not be set yet
+    const Matrix4f* pVP = pWVPTrans ? &GetVPTrans() : NULL;
+
+    // Spawning threads only pays off for fairly large batches
+    const unsigned int MinObjectsPerThread = 256;
+
+    if (NumThreads > NumObjects / MinObjectsPerThread) {
+        NumThreads = NumObjects / MinObjectsPerThread;
+    }
+
+    if (NumThreads <= 1) {
+        CalcTransRange(0, NumObjects, pVP, pScale, pRotate, pWorldPos, pWorldTrans, pWVPTrans);
+        return;
+    }
+
+    std::vector<std::thread> Workers;
+    const unsigned int ObjectsPerThread = (NumObjects + NumThreads - 1) / NumThreads;
+
+    // The calling thread takes the first range itself
+    for (unsigned int t = 1 ; t < NumThreads ; t++) {
+        const unsigned int First = t * ObjectsPerThread;
+        const unsigned int Last  = (First + ObjectsPerThread < NumObjects) ? First + ObjectsPerThread : NumObjects;
+        Workers.push_back(std::thread(CalcTransRange, First, Last, pVP,
+                                      pScale, pRotate, pWorldPos, pWorldTrans, pWVPTrans));
+    }
+
+    CalcTransRange(0, ObjectsPerThread, pVP, pScale, pRotate, pWorldPos, pWorldTrans, pWVPTrans);
+
+    for (unsigned int t = 0 ; t < Workers.size() ; t++) {
+        Workers[t].join();
+    }
+}
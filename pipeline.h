@@ -12,43 +12,62 @@ public:
         m_scale      = Vector3f(1.0f, 1.0f, 1.0f);
         m_worldPos   = Vector3f(0.0f, 0.0f, 0.0f);
         m_rotateInfo = Vector3f(0.0f, 0.0f, 0.0f);
+        m_dirty      = DIRTY_ALL;
     }
 
     void Scale(float ScaleX, float ScaleY, float ScaleZ)
     {
-        m_scale.x = ScaleX;
-        m_scale.y = ScaleY;
-        m_scale.z = ScaleZ;
+        if (m_scale.x != ScaleX || m_scale.y != ScaleY || m_scale.z != ScaleZ) {
+            m_scale.x = ScaleX;
+            m_scale.y = ScaleY;
+            m_scale.z = ScaleZ;
+            m_dirty |= DIRTY_SCALE;
+        }
     }
 
     void WorldPos(float x, float y, float z)
     {
-        m_worldPos.x = x;
-        m_worldPos.y = y;
-        m_worldPos.z = z;
+        if (m_worldPos.x != x || m_worldPos.y != y || m_worldPos.z != z) {
+            m_worldPos.x = x;
+            m_worldPos.y = y;
+            m_worldPos.z = z;
+            m_dirty |= DIRTY_POS;
+        }
     }
 
     void Rotate(float RotateX, float RotateY, float RotateZ)
     {
-        m_rotateInfo.x = RotateX;
-        m_rotateInfo.y = RotateY;
-        m_rotateInfo.z = RotateZ;
+        if (m_rotateInfo.x != RotateX || m_rotateInfo.y != RotateY || m_rotateInfo.z != RotateZ) {
+            m_rotateInfo.x = RotateX;
+            m_rotateInfo.y = RotateY;
+            m_rotateInfo.z = RotateZ;
+            m_dirty |= DIRTY_ROTATE;
+        }
     }
 
     void SetPerspectiveProj(float FOV, float Width, float Height, float zNear, float zFar)
     {
-        m_persProj.FOV    = FOV;
-        m_persProj.Width  = Width;
-        m_persProj.Height = Height;
-        m_persProj.zNear  = zNear;
-        m_persProj.zFar   = zFar;
+        if ((m_dirty & DIRTY_PROJ) ||
+            m_persProj.FOV != FOV || m_persProj.Width != Width || m_persProj.Height != Height ||
+            m_persProj.zNear != zNear || m_persProj.zFar != zFar) {
+            m_persProj.FOV    = FOV;
+            m_persProj.Width  = Width;
+            m_persProj.Height = Height;
+            m_persProj.zNear  = zNear;
+            m_persProj.zFar   = zFar;
+            m_dirty |= DIRTY_PROJ;
+        }
     }
 
     void SetCamera(const Vector3f& Pos, const Vector3f& Target, const Vector3f& Up)
     {
-        m_camera.Pos = Pos;
-        m_camera.Target = Target;
-        m_camera.Up = Up;
+        if ((m_dirty & DIRTY_CAMERA) ||
+            !IsEqual(m_camera.Pos, Pos) || !IsEqual(m_camera.Target, Target) || !IsEqual(m_camera.Up, Up)) {
+            m_camera.Pos = Pos;
+            m_camera.Target = Target;
+            m_camera.Up = Up;
+            m_dirty |= DIRTY_CAMERA;
+        }
     }
 
 
@@ -56,8 +75,51 @@ public:
 
     const Matrix4f& GetWorldTrans();
 
+    const Matrix4f& GetVPTrans();
+
+    const Matrix4f& GetViewTrans()
+    {
+        GetVPTrans();
+        return m_viewTrans;
+    }
+
+    // Computes the world and WVP matrices of NumObjects objects at once. The
+    // camera and projection of the pipeline are shared by all objects, so the
+    // view-projection matrix is built only once. pScale and pRotate may be
+    // NULL (unit scale, no rotation). Either of pWorldTrans and pWVPTrans may
+    // be NULL when only the other matrices are needed; without pWVPTrans the
+    // camera and projection are not used. NumThreads > 1 splits the objects
+    // between threads.
+    void GetTransBatch(unsigned int NumObjects,
+                       const Vector3f* pScale,
+                       const Vector3f* pRotate,
+                       const Vector3f* pWorldPos,
+                       Matrix4f* pWorldTrans,
+                       Matrix4f* pWVPTrans,
+                       unsigned int NumThreads = 1);
+
 
 private:
+    // Which inputs changed since the cached matrices were last built
+    enum {
+        DIRTY_SCALE  = 0x01,
+        DIRTY_ROTATE = 0x02,
+        DIRTY_POS    = 0x04,
+        DIRTY_CAMERA = 0x08,
+        DIRTY_PROJ   = 0x10,
+        DIRTY_WVP    = 0x20,
+        DIRTY_WORLD  = DIRTY_SCALE | DIRTY_ROTATE | DIRTY_POS,
+        DIRTY_VP     = DIRTY_CAMERA | DIRTY_PROJ,
+        DIRTY_ALL    = DIRTY_WORLD | DIRTY_VP | DIRTY_WVP
+    };
+
+    static bool IsEqual(const Vector3f& l, const Vector3f& r)
+    {
+        return l.x == r.x && l.y == r.y && l.z == r.z;
+    }
+
+    unsigned int m_dirty;
+
     Vector3f m_scale;
     Vector3f m_worldPos;
     Vector3f m_rotateInfo;
@@ -76,7 +138,11 @@ private:
         Vector3f Up;
     } m_camera;
 
+    Matrix4f m_rotateTrans;
+    Matrix4f m_viewTrans;
+    Matrix4f m_projTrans;
     Matrix4f m_WVPtransformation;
+    Matrix4f m_VPtransformation;
     Matrix4f m_WorldTransformation;
 };
 
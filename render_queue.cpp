@@ -0,0 +1,148 @@
+#include <string.h>
+
+#include "render_queue.h"
+
+#define TECHNIQUE_BITS  12
+#define TEXTURE_BITS    16
+#define MESH_BITS       12
+#define DEPTH_BITS      24
+
+RenderQueue::RenderQueue()
+{
+    m_sorted = true;
+    m_numStateChanges = 0;
+}
+
+void RenderQueue::Clear()
+{
+    m_commands.clear();
+    m_keys.clear();
+    m_sorted = true;
+}
+
+void RenderQueue::Add(Technique* pTechnique, IBindableTexture* pTexture, Mesh* pMesh,
+                      unsigned int NumInstances, const DrawParams& Params, float Depth)
+{
+    DrawCommand Command;
+    Command.pTechnique = pTechnique;
+    Command.pTexture = pTexture;
+    Command.pMesh = pMesh;
+    Command.NumInstances = NumInstances;
+    Command.Params = Params;
+
+    SortKey Key;
+    Key.Key = MakeKey(pTechnique, pTexture, pMesh, Depth);
+    Key.Command = (unsigned int)m_commands.size();
+
+    m_commands.push_back(Command);
+    m_keys.push_back(Key);
+    m_sorted = false;
+}
+
+unsigned long long RenderQueue::MakeKey(const Technique* pTechnique, const IBindableTexture* pTexture,
+                                        const Mesh* pMesh, float Depth)
+{
+    const unsigned long long TechniqueId = pTechnique->GetId() & ((1 << TECHNIQUE_BITS) - 1);
+    const unsigned long long TextureId = (pTexture ? pTexture->GetTextureObj() : 0) & ((1 << TEXTURE_BITS) - 1);
+    const unsigned long long MeshId = pMesh->GetVAO() & ((1 << MESH_BITS) - 1);
+
+    // Non-negative floats order the same as their bit patterns, the top
+    // bits of the pattern are the quantized depth
+    unsigned int DepthBits = 0;
+
+    if (Depth > 0.0f) {
+        memcpy(&DepthBits, &Depth, sizeof(DepthBits));
+        DepthBits >>= 32 - DEPTH_BITS;
+    }
+
+    return (TechniqueId << (TEXTURE_BITS + MESH_BITS + DEPTH_BITS)) |
+           (TextureId << (MESH_BITS + DEPTH_BITS)) |
+           (MeshId << DEPTH_BITS) |
+           DepthBits;
+}
+
+void RenderQueue::Sort()
+{
+    const unsigned int NumKeys = (unsigned int)m_keys.size();
+    m_sortTemp.resize(NumKeys);
+
+    SortKey* pSrc = &m_keys[0];
+    SortKey* pDst = &m_sortTemp[0];
+
+    for (unsigned int Shift = 0 ; Shift < 64 ; Shift += 8) {
+        unsigned int Counts[256];
+        memset(Counts, 0, sizeof(Counts));
+
+        for (unsigned int i = 0 ; i < NumKeys ; i++) {
+            Counts[(pSrc[i].Key >> Shift) & 0xFF]++;
+        }
+
+        // All keys share this byte, the pass would not move anything
+        if (Counts[(pSrc[0].Key >> Shift) & 0xFF] == NumKeys) {
+            continue;
+        }
+
+        unsigned int Offset = 0;
+
+        for (unsigned int i = 0 ; i < 256 ; i++) {
+            const unsigned int Count = Counts[i];
+            Counts[i] = Offset;
+            Offset += Count;
+        }
+
+        for (unsigned int i = 0 ; i < NumKeys ; i++) {
+            pDst[Counts[(pSrc[i].Key >> Shift) & 0xFF]++] = pSrc[i];
+        }
+
+        SortKey* pTemp = pSrc;
+        pSrc = pDst;
+        pDst = pTemp;
+    }
+
+    if (pSrc != &m_keys[0]) {
+        m_keys.swap(m_sortTemp);
+    }
+
+    m_sorted = true;
+}
+
+void RenderQueue::Submit()
+{
+    m_numStateChanges = 0;
+
+    if (m_commands.empty()) {
+        return;
+    }
+
+    if (!m_sorted) {
+        Sort();
+    }
+
+    Technique* pTechnique = NULL;
+    IBindableTexture* pTexture = NULL;
+
+    for (unsigned int i = 0 ; i < m_keys.size() ; i++) {
+        const DrawCommand& Command = m_commands[m_keys[i].Command];
+
+        if (Command.pTechnique != pTechnique) {
+            pTechnique = Command.pTechnique;
+            pTechnique->Enable();
+            m_numStateChanges++;
+        }
+
+        if (Command.pTexture && Command.pTexture != pTexture) {
+            pTexture = Command.pTexture;
+            pTexture->Bind(GL_TEXTURE0);
+            m_numStateChanges++;
+        }
+
+        pTechnique->SetDrawParams(Command.Params);
+
+        if (Command.NumInstances > 0) {
+            Command.pMesh->RenderInstanced(Command.NumInstances);
+        }
+        else {
+            Command.pMesh->Render();
+        }
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef RENDER_QUEUE_H
+#define	RENDER_QUEUE_H
+
+#include <vector>
+
+#include "math_3d.h"
+#include "technique.h"
+#include "bindable_texture.h"
+#include "mesh.h"
+#include "vertex_format.h"
+
+// Per-draw values handed to Technique::SetDrawParams()
+struct DrawParams
+{
+    Matrix4f WVP;
+    Matrix4f World;
+    Vector4f PatternRect;
+    float PatternLayer;
+    // Of the mesh, for techniques reading VERTEX_FORMAT_PACKED
+    VertexQuantization Quantization;
+};
+
+// Draws of a frame recorded first and submitted in state order. Every draw
+// gets a 64 bit key, from the most significant bits down:
+//
+//   technique id (12) | texture object (16) | vertex array (12) | depth (24)
+//
+// so after sorting the keys draws sharing a program are adjacent, within a
+// program those sharing a texture, then a mesh, and equal state is drawn
+// front to back. Submit() switches the program and the texture only where
+// they change; the vertex array switches are filtered by RenderState.
+//
+// Keys are sorted with an LSD radix sort, a byte per pass, skipping the
+// passes over bytes every key has in common.
+class RenderQueue
+{
+public:
+
+    RenderQueue();
+
+    void Clear();
+
+    // pTexture may be NULL; it is bound to unit 0. NumInstances 0 is a
+    // plain draw, otherwise the mesh is drawn instanced. Depth is the view
+    // distance of the draw.
+    void Add(Technique* pTechnique, IBindableTexture* pTexture, Mesh* pMesh,
+             unsigned int NumInstances, const DrawParams& Params, float Depth);
+
+    // Draws everything recorded since Clear(). The queue keeps its
+    // contents, so it can be submitted again.
+    void Submit();
+
+    unsigned int GetNumDraws() const { return (unsigned int)m_commands.size(); }
+
+    // Program and texture binds done by the last Submit()
+    unsigned int GetNumStateChanges() const { return m_numStateChanges; }
+
+private:
+
+    struct DrawCommand {
+        Technique* pTechnique;
+        IBindableTexture* pTexture;
+        Mesh* pMesh;
+        unsigned int NumInstances;
+        DrawParams Params;
+    };
+
+    struct SortKey {
+        unsigned long long Key;
+        unsigned int Command;
+    };
+
+    static unsigned long long MakeKey(const Technique* pTechnique, const IBindableTexture* pTexture,
+                                      const Mesh* pMesh, float Depth);
+
+    void Sort();
+
+    std::vector<DrawCommand> m_commands;
+    std::vector<SortKey> m_keys;
+    std::vector<SortKey> m_sortTemp;
+    bool m_sorted;
+    unsigned int m_numStateChanges;
+};
+
+
+#endif	/* RENDER_QUEUE_H */
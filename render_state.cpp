@@ -0,0 +1,353 @@
+#include <string.h>
+
+#include "render_state.h"
+
+#pragma once
+
+// Value of a binding that has to be issued whatever it is set to
+#define UNKNOWN_BINDING 0xFFFFFFFF
+
+// A fresh context has every binding at zero, which is what the zeroed
+// copy says
+GLuint RenderState::s_program;
+GLuint RenderState::s_VAO;
+GLuint RenderState::s_buffers[NUM_BUFFER_TARGETS];
+RenderState::BufferRange RenderState::s_bufferRanges[NUM_BUFFER_TARGETS][MAX_BUFFER_INDICES];
+GLenum RenderState::s_activeUnit;
+GLuint RenderState::s_textures[MAX_TEXTURE_UNITS][NUM_TEXTURE_TARGETS];
+GLuint RenderState::s_samplers[MAX_TEXTURE_UNITS];
+std::map<GLuint, std::vector<RenderState::UniformValue> > RenderState::s_uniforms;
+std::vector<RenderState::UniformValue>* RenderState::s_pUniforms;
+unsigned int RenderState::s_numIssued;
+unsigned int RenderState::s_numFiltered;
+
+bool RenderState::Filter(bool Redundant)
+{
+    if (Redundant) {
+        s_numFiltered++;
+    }
+    else {
+        s_numIssued++;
+    }
+
+    return Redundant;
+}
+
+int RenderState::GetBufferIndex(GLenum Target)
+{
+    switch (Target) {
+        case GL_ARRAY_BUFFER:           return BUFFER_ARRAY;
+        case GL_UNIFORM_BUFFER:         return BUFFER_UNIFORM;
+        case GL_TEXTURE_BUFFER:         return BUFFER_TEXTURE;
+        case GL_PIXEL_UNPACK_BUFFER:    return BUFFER_PIXEL_UNPACK;
+        case GL_DRAW_INDIRECT_BUFFER:   return BUFFER_DRAW_INDIRECT;
+        case GL_SHADER_STORAGE_BUFFER:  return BUFFER_SHADER_STORAGE;
+        default:                        return -1;
+    }
+}
+
+int RenderState::GetTextureIndex(GLenum Target)
+{
+    switch (Target) {
+        case GL_TEXTURE_2D:             return TEXTURE_2D;
+        case GL_TEXTURE_2D_ARRAY:       return TEXTURE_2D_ARRAY;
+        case GL_TEXTURE_BUFFER:         return TEXTURE_BUFFER;
+        default:                        return -1;
+    }
+}
+
+void RenderState::UseProgram(GLuint Program)
+{
+    if (Filter(Program == s_program)) {
+        return;
+    }
+
+    glUseProgram(Program);
+    s_program = Program;
+    s_pUniforms = (Program != 0) ? &s_uniforms[Program] : NULL;
+}
+
+void RenderState::BindVertexArray(GLuint VAO)
+{
+    if (Filter(VAO == s_VAO)) {
+        return;
+    }
+
+    glBindVertexArray(VAO);
+    s_VAO = VAO;
+}
+
+void RenderState::BindBuffer(GLenum Target, GLuint Buffer)
+{
+    const int i = GetBufferIndex(Target);
+
+    if (Filter(i >= 0 && s_buffers[i] == Buffer)) {
+        return;
+    }
+
+    glBindBuffer(Target, Buffer);
+
+    if (i >= 0) {
+        s_buffers[i] = Buffer;
+    }
+}
+
+void RenderState::BindBufferRange(GLenum Target, GLuint Index, GLuint Buffer, GLintptr Offset, GLsizeiptr Size)
+{
+    const int i = GetBufferIndex(Target);
+    BufferRange* pRange = (i >= 0 && Index < MAX_BUFFER_INDICES) ? &s_bufferRanges[i][Index] : NULL;
+
+    if (Filter(pRange && pRange->Buffer == Buffer && pRange->Offset == Offset && pRange->Size == Size &&
+               s_buffers[i] == Buffer)) {
+        return;
+    }
+
+    glBindBufferRange(Target, Index, Buffer, Offset, Size);
+
+    // The generic binding point changes too
+    if (i >= 0) {
+        s_buffers[i] = Buffer;
+    }
+
+    if (pRange) {
+        pRange->Buffer = Buffer;
+        pRange->Offset = Offset;
+        pRange->Size = Size;
+    }
+}
+
+void RenderState::BindTexture(GLenum Unit, GLenum Target, GLuint Texture)
+{
+    const unsigned int u = Unit - GL_TEXTURE0;
+    const int t = GetTextureIndex(Target);
+    const bool Tracked = u < MAX_TEXTURE_UNITS && t >= 0;
+
+    // The unit is made active even when the binding is already there, since
+    // callers edit the texture through the active unit right after binding
+    if (!Filter(Unit == s_activeUnit)) {
+        glActiveTexture(Unit);
+        s_activeUnit = Unit;
+    }
+
+    if (Filter(Tracked && s_textures[u][t] == Texture)) {
+        return;
+    }
+
+    glBindTexture(Target, Texture);
+
+    if (Tracked) {
+        s_textures[u][t] = Texture;
+    }
+}
+
+void RenderState::BindSampler(GLenum Unit, GLuint Sampler)
+{
+    const unsigned int u = Unit - GL_TEXTURE0;
+
+    if (Filter(u < MAX_TEXTURE_UNITS && s_samplers[u] == Sampler)) {
+        return;
+    }
+
+    glBindSampler(u, Sampler);
+
+    if (u < MAX_TEXTURE_UNITS) {
+        s_samplers[u] = Sampler;
+    }
+}
+
+// Records the value and returns true if it is already set
+bool RenderState::SetUniform(GLint Location, const void* pData, unsigned int Size)
+{
+    if (!s_pUniforms || Location < 0 || Size > MAX_UNIFORM_SIZE) {
+        return Filter(false);
+    }
+
+    if ((unsigned int)Location >= s_pUniforms->size()) {
+        UniformValue Unknown;
+        Unknown.Size = 0;
+        s_pUniforms->resize(Location + 1, Unknown);
+    }
+
+    UniformValue& v = (*s_pUniforms)[Location];
+
+    if (Filter(v.Size == Size && memcmp(v.Data, pData, Size) == 0)) {
+        return true;
+    }
+
+    v.Size = Size;
+    memcpy(v.Data, pData, Size);
+
+    return false;
+}
+
+void RenderState::Uniform1i(GLint Location, GLint v0)
+{
+    if (!SetUniform(Location, &v0, sizeof(v0))) {
+        glUniform1i(Location, v0);
+    }
+}
+
+void RenderState::Uniform3i(GLint Location, GLint v0, GLint v1, GLint v2)
+{
+    const GLint v[3] = { v0, v1, v2 };
+
+    if (!SetUniform(Location, v, sizeof(v))) {
+        glUniform3i(Location, v0, v1, v2);
+    }
+}
+
+void RenderState::Uniform1f(GLint Location, GLfloat v0)
+{
+    if (!SetUniform(Location, &v0, sizeof(v0))) {
+        glUniform1f(Location, v0);
+    }
+}
+
+void RenderState::Uniform2f(GLint Location, GLfloat v0, GLfloat v1)
+{
+    const GLfloat v[2] = { v0, v1 };
+
+    if (!SetUniform(Location, v, sizeof(v))) {
+        glUniform2f(Location, v0, v1);
+    }
+}
+
+void RenderState::Uniform3f(GLint Location, GLfloat v0, GLfloat v1, GLfloat v2)
+{
+    const GLfloat v[3] = { v0, v1, v2 };
+
+    if (!SetUniform(Location, v, sizeof(v))) {
+        glUniform3f(Location, v0, v1, v2);
+    }
+}
+
+void RenderState::Uniform4f(GLint Location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3)
+{
+    const GLfloat v[4] = { v0, v1, v2, v3 };
+
+    if (!SetUniform(Location, v, sizeof(v))) {
+        glUniform4f(Location, v0, v1, v2, v3);
+    }
+}
+
+void RenderState::Uniform4fv(GLint Location, GLsizei Count, const GLfloat* pValue)
+{
+    if (!SetUniform(Location, pValue, sizeof(GLfloat) * 4 * Count)) {
+        glUniform4fv(Location, Count, pValue);
+    }
+}
+
+// Every caller uploads row-major matrices with Transpose set, so the flag
+// is not part of the recorded value
+void RenderState::UniformMatrix4fv(GLint Location, GLsizei Count, GLboolean Transpose, const GLfloat* pValue)
+{
+    if (!SetUniform(Location, pValue, sizeof(GLfloat) * 16 * Count)) {
+        glUniformMatrix4fv(Location, Count, Transpose, pValue);
+    }
+}
+
+void RenderState::DeleteProgram(GLuint Program)
+{
+    glDeleteProgram(Program);
+
+    // A program in use stays alive until it is replaced, but its name can
+    // not come back before that
+    s_uniforms.erase(Program);
+
+    if (s_program == Program) {
+        s_program = UNKNOWN_BINDING;
+        s_pUniforms = NULL;
+    }
+}
+
+void RenderState::DeleteVertexArrays(GLsizei Count, const GLuint* pVAOs)
+{
+    glDeleteVertexArrays(Count, pVAOs);
+
+    for (GLsizei i = 0 ; i < Count ; i++) {
+        if (s_VAO == pVAOs[i]) {
+            s_VAO = 0;
+        }
+    }
+}
+
+void RenderState::DeleteBuffers(GLsizei Count, const GLuint* pBuffers)
+{
+    glDeleteBuffers(Count, pBuffers);
+
+    for (GLsizei i = 0 ; i < Count ; i++) {
+        for (unsigned int t = 0 ; t < NUM_BUFFER_TARGETS ; t++) {
+            if (s_buffers[t] == pBuffers[i]) {
+                s_buffers[t] = 0;
+            }
+
+            for (unsigned int j = 0 ; j < MAX_BUFFER_INDICES ; j++) {
+                if (s_bufferRanges[t][j].Buffer == pBuffers[i]) {
+                    s_bufferRanges[t][j].Buffer = 0;
+                    s_bufferRanges[t][j].Offset = 0;
+                    s_bufferRanges[t][j].Size = 0;
+                }
+            }
+        }
+    }
+}
+
+void RenderState::DeleteTextures(GLsizei Count, const GLuint* pTextures)
+{
+    glDeleteTextures(Count, pTextures);
+
+    for (GLsizei i = 0 ; i < Count ; i++) {
+        for (unsigned int u = 0 ; u < MAX_TEXTURE_UNITS ; u++) {
+            for (unsigned int t = 0 ; t < NUM_TEXTURE_TARGETS ; t++) {
+                if (s_textures[u][t] == pTextures[i]) {
+                    s_textures[u][t] = 0;
+                }
+            }
+        }
+    }
+}
+
+void RenderState::DeleteSamplers(GLsizei Count, const GLuint* pSamplers)
+{
+    glDeleteSamplers(Count, pSamplers);
+
+    for (GLsizei i = 0 ; i < Count ; i++) {
+        for (unsigned int u = 0 ; u < MAX_TEXTURE_UNITS ; u++) {
+            if (s_samplers[u] == pSamplers[i]) {
+                s_samplers[u] = 0;
+            }
+        }
+    }
+}
+
+void RenderState::Invalidate()
+{
+    s_program = UNKNOWN_BINDING;
+    s_pUniforms = NULL;
+    s_VAO = UNKNOWN_BINDING;
+    s_activeUnit = UNKNOWN_BINDING;
+
+    for (unsigned int t = 0 ; t < NUM_BUFFER_TARGETS ; t++) {
+        s_buffers[t] = UNKNOWN_BINDING;
+
+        for (unsigned int j = 0 ; j < MAX_BUFFER_INDICES ; j++) {
+            s_bufferRanges[t][j].Buffer = UNKNOWN_BINDING;
+        }
+    }
+
+    for (unsigned int u = 0 ; u < MAX_TEXTURE_UNITS ; u++) {
+        for (unsigned int t = 0 ; t < NUM_TEXTURE_TARGETS ; t++) {
+            s_textures[u][t] = UNKNOWN_BINDING;
+        }
+
+        s_samplers[u] = UNKNOWN_BINDING;
+    }
+
+    // The uniform values stay valid: they belong to the programs
+}
+
+void RenderState::ResetCounters()
+{
+    s_numIssued = 0;
+    s_numFiltered = 0;
+}
@@ -0,0 +1,103 @@
+#ifndef RENDER_STATE_H
+#define	RENDER_STATE_H
+
+#include <map>
+#include <vector>
+#include <GL/glew.h>
+
+// Shadow copy of the GL state the renderer changes all the time: the
+// program, the vertex array, buffer and texture bindings, samplers and the
+// uniform values of every program. Each setter compares with the copy and
+// skips the GL call when it would change nothing; GetNumIssued() and
+// GetNumFiltered() count both outcomes.
+//
+// The copy is only right while the state goes through this class. Objects
+// are deleted with the Delete*() functions, which forget them the way GL
+// unbinds them, and code changing the state directly must call
+// Invalidate() afterwards.
+//
+// The element array binding belongs to the vertex array object, so
+// BindBuffer() always issues it.
+class RenderState
+{
+public:
+
+    static void UseProgram(GLuint Program);
+    static void BindVertexArray(GLuint VAO);
+    static void BindBuffer(GLenum Target, GLuint Buffer);
+    static void BindBufferRange(GLenum Target, GLuint Index, GLuint Buffer, GLintptr Offset, GLsizeiptr Size);
+
+    // Units are given as GL_TEXTURE0 + i. BindTexture() always leaves Unit
+    // active, so the texture can be edited right after binding it.
+    static void BindTexture(GLenum Unit, GLenum Target, GLuint Texture);
+    static void BindSampler(GLenum Unit, GLuint Sampler);
+
+    // Uniforms of the current program
+    static void Uniform1i(GLint Location, GLint v0);
+    static void Uniform3i(GLint Location, GLint v0, GLint v1, GLint v2);
+    static void Uniform1f(GLint Location, GLfloat v0);
+    static void Uniform2f(GLint Location, GLfloat v0, GLfloat v1);
+    static void Uniform3f(GLint Location, GLfloat v0, GLfloat v1, GLfloat v2);
+    static void Uniform4f(GLint Location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3);
+    static void Uniform4fv(GLint Location, GLsizei Count, const GLfloat* pValue);
+    static void UniformMatrix4fv(GLint Location, GLsizei Count, GLboolean Transpose, const GLfloat* pValue);
+
+    static void DeleteProgram(GLuint Program);
+    static void DeleteVertexArrays(GLsizei Count, const GLuint* pVAOs);
+    static void DeleteBuffers(GLsizei Count, const GLuint* pBuffers);
+    static void DeleteTextures(GLsizei Count, const GLuint* pTextures);
+    static void DeleteSamplers(GLsizei Count, const GLuint* pSamplers);
+
+    // Forgets everything, so the next call of every setter is issued
+    static void Invalidate();
+
+    static unsigned int GetNumIssued() { return s_numIssued; }
+    static unsigned int GetNumFiltered() { return s_numFiltered; }
+    static void ResetCounters();
+
+private:
+
+    static const unsigned int MAX_TEXTURE_UNITS = 32;
+    static const unsigned int MAX_BUFFER_INDICES = 16;
+    static const unsigned int MAX_UNIFORM_SIZE = 64;
+
+    // Tracked targets, unknown ones are always issued
+    enum { BUFFER_ARRAY, BUFFER_UNIFORM, BUFFER_TEXTURE, BUFFER_PIXEL_UNPACK,
+           BUFFER_DRAW_INDIRECT, BUFFER_SHADER_STORAGE, NUM_BUFFER_TARGETS };
+
+    enum { TEXTURE_2D, TEXTURE_2D_ARRAY, TEXTURE_BUFFER, NUM_TEXTURE_TARGETS };
+
+    struct BufferRange {
+        GLuint Buffer;
+        GLintptr Offset;
+        GLsizeiptr Size;
+    };
+
+    // Last value set at a uniform location, Size 0 until known
+    struct UniformValue {
+        unsigned int Size;
+        unsigned char Data[MAX_UNIFORM_SIZE];
+    };
+
+    static int GetBufferIndex(GLenum Target);
+    static int GetTextureIndex(GLenum Target);
+    static bool SetUniform(GLint Location, const void* pData, unsigned int Size);
+    static bool Filter(bool Redundant);
+
+    static GLuint s_program;
+    static GLuint s_VAO;
+    static GLuint s_buffers[NUM_BUFFER_TARGETS];
+    static BufferRange s_bufferRanges[NUM_BUFFER_TARGETS][MAX_BUFFER_INDICES];
+    static GLenum s_activeUnit;
+    static GLuint s_textures[MAX_TEXTURE_UNITS][NUM_TEXTURE_TARGETS];
+    static GLuint s_samplers[MAX_TEXTURE_UNITS];
+
+    static std::map<GLuint, std::vector<UniformValue> > s_uniforms;
+    static std::vector<UniformValue>* s_pUniforms;
+
+    static unsigned int s_numIssued;
+    static unsigned int s_numFiltered;
+};
+
+
+#endif	/* RENDER_STATE_H */
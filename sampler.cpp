@@ -0,0 +1,87 @@
+#include <stdio.h>
+
+#include "sampler.h"
+#include "render_state.h"
+
+Sampler::Sampler()
+{
+    m_samplerObj = 0;
+    m_filter = FILTER_BILINEAR;
+    m_anisotropy = 1.0f;
+}
+
+Sampler::~Sampler()
+{
+    if (m_samplerObj != 0) {
+        RenderState::DeleteSamplers(1, &m_samplerObj);
+    }
+}
+
+bool Sampler::Init(FILTER Filter, float MaxAnisotropy, GLenum Wrap)
+{
+    glGenSamplers(1, &m_samplerObj);
+
+    if (m_samplerObj == 0) {
+        fprintf(stderr, "Error creating sampler object\n");
+        return false;
+    }
+
+    glSamplerParameteri(m_samplerObj, GL_TEXTURE_WRAP_S, Wrap);
+    glSamplerParameteri(m_samplerObj, GL_TEXTURE_WRAP_T, Wrap);
+
+    SetFilter(Filter, MaxAnisotropy);
+
+    return true;
+}
+
+void Sampler::SetFilter(FILTER Filter, float MaxAnisotropy)
+{
+    GLint MinFilter = GL_LINEAR;
+    GLint MagFilter = GL_LINEAR;
+
+    switch (Filter) {
+    case FILTER_NEAREST:
+        MinFilter = GL_NEAREST;
+        MagFilter = GL_NEAREST;
+        break;
+    case FILTER_BILINEAR:
+        break;
+    case FILTER_TRILINEAR:
+        MinFilter = GL_LINEAR_MIPMAP_LINEAR;
+        break;
+    }
+
+    glSamplerParameteri(m_samplerObj, GL_TEXTURE_MIN_FILTER, MinFilter);
+    glSamplerParameteri(m_samplerObj, GL_TEXTURE_MAG_FILTER, MagFilter);
+
+    const float MaxSupported = GetMaxSupportedAnisotropy();
+    m_anisotropy = MaxAnisotropy < 1.0f ? 1.0f : (MaxAnisotropy > MaxSupported ? MaxSupported : MaxAnisotropy);
+
+    if (GLEW_EXT_texture_filter_anisotropic) {
+        glSamplerParameterf(m_samplerObj, GL_TEXTURE_MAX_ANISOTROPY_EXT, m_anisotropy);
+    }
+
+    m_filter = Filter;
+}
+
+void Sampler::Bind(GLenum TextureUnit) const
+{
+    RenderState::BindSampler(TextureUnit, m_samplerObj);
+}
+
+void Sampler::Unbind(GLenum TextureUnit)
+{
+    RenderState::BindSampler(TextureUnit, 0);
+}
+
+float Sampler::GetMaxSupportedAnisotropy()
+{
+    if (!GLEW_EXT_texture_filter_anisotropic) {
+        return 1.0f;
+    }
+
+    GLfloat MaxAnisotropy = 1.0f;
+    glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &MaxAnisotropy);
+
+    return MaxAnisotropy;
+}
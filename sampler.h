@@ -0,0 +1,51 @@
+#ifndef SAMPLER_H
+#define	SAMPLER_H
+
+#include <GL/glew.h>
+
+// Sampler object: filtering and wrapping kept apart from the texture, so
+// one texture can be read with different settings and one setting shared
+// by many textures. Bound to a texture unit, it overrides the parameters
+// of whatever texture is bound there.
+class Sampler
+{
+public:
+
+    enum FILTER {
+        FILTER_NEAREST,
+        FILTER_BILINEAR,
+        // Blends the two nearest mip levels; needs a mip chain
+        FILTER_TRILINEAR
+    };
+
+    Sampler();
+
+    ~Sampler();
+
+    // MaxAnisotropy above 1 enables anisotropic filtering, where
+    // supported, clamped to what the driver allows
+    bool Init(FILTER Filter, float MaxAnisotropy = 1.0f, GLenum Wrap = GL_REPEAT);
+
+    void SetFilter(FILTER Filter, float MaxAnisotropy = 1.0f);
+
+    FILTER GetFilter() const { return m_filter; }
+
+    float GetAnisotropy() const { return m_anisotropy; }
+
+    void Bind(GLenum TextureUnit) const;
+
+    // Restores the parameters of the texture itself on the unit
+    static void Unbind(GLenum TextureUnit);
+
+    // 1 when anisotropic filtering is not supported
+    static float GetMaxSupportedAnisotropy();
+
+private:
+
+    GLuint m_samplerObj;
+    FILTER m_filter;
+    float m_anisotropy;
+};
+
+
+#endif	/* SAMPLER_H */
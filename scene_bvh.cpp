@@ -0,0 +1,230 @@
+#include <algorithm>
+
+#include "scene_bvh.h"
+
+SceneBVH::SceneBVH()
+{
+    m_moved = false;
+}
+
+unsigned int SceneBVH::AddObject(const BoundingBox& LocalBox, const Matrix4f& World)
+{
+    Object o;
+    o.LocalBox = LocalBox;
+    o.WorldBox = LocalBox.Transform(World);
+    o.Node = EMPTY;
+    o.Slot = 0;
+    o.Moved = false;
+
+    m_objects.push_back(o);
+
+    return m_objects.size() - 1;
+}
+
+void SceneBVH::SetWorldTransform(unsigned int Object, const Matrix4f& World)
+{
+    m_objects[Object].WorldBox = m_objects[Object].LocalBox.Transform(World);
+    m_objects[Object].Moved = true;
+    m_moved = true;
+}
+
+void SceneBVH::Build()
+{
+    m_nodes.clear();
+
+    for (unsigned int i = 0 ; i < m_objects.size() ; i++) {
+        m_objects[i].Moved = false;
+    }
+
+    m_moved = false;
+
+    if (m_objects.empty()) {
+        return;
+    }
+
+    std::vector<unsigned int> Objects(m_objects.size());
+
+    for (unsigned int i = 0 ; i < Objects.size() ; i++) {
+        Objects[i] = i;
+    }
+
+    BuildNode(&Objects[0], Objects.size(), EMPTY, 0);
+}
+
+unsigned int SceneBVH::BuildNode(unsigned int* pObjects, unsigned int NumObjects, unsigned int Parent, unsigned int ParentSlot)
+{
+    const unsigned int NodeIndex = m_nodes.size();
+
+    Node n;
+    n.Parent = Parent;
+    n.ParentSlot = ParentSlot;
+    n.Dirty = false;
+
+    for (unsigned int i = 0 ; i < 4 ; i++) {
+        n.Children[i] = EMPTY;
+    }
+
+    m_nodes.push_back(n);
+
+    // Empty children keep an inverted box, which every plane rejects
+    for (unsigned int i = 0 ; i < 4 ; i++) {
+        SetChildBox(NodeIndex, i, BoundingBox());
+    }
+
+    // Up to four objects go straight into the node, more are split in two
+    // at the median of the longest axis of their centers, and both halves
+    // in two again
+    unsigned int Begin[5];
+
+    if (NumObjects <= 4) {
+        for (unsigned int i = 0 ; i <= 4 ; i++) {
+            Begin[i] = std::min(i, NumObjects);
+        }
+    }
+    else {
+        Begin[0] = 0;
+        Begin[4] = NumObjects;
+        Begin[2] = SplitObjects(pObjects, 0, NumObjects);
+        Begin[1] = SplitObjects(pObjects, 0, Begin[2]);
+        Begin[3] = SplitObjects(pObjects, Begin[2], NumObjects);
+    }
+
+    for (unsigned int i = 0 ; i < 4 ; i++) {
+        const unsigned int Count = Begin[i + 1] - Begin[i];
+
+        if (Count == 0) {
+            continue;
+        }
+
+        if (Count == 1) {
+            const unsigned int o = pObjects[Begin[i]];
+            m_objects[o].Node = NodeIndex;
+            m_objects[o].Slot = i;
+            m_nodes[NodeIndex].Children[i] = o | LEAF_BIT;
+            SetChildBox(NodeIndex, i, m_objects[o].WorldBox);
+        }
+        else {
+            const unsigned int Child = BuildNode(pObjects + Begin[i], Count, NodeIndex, i);
+            m_nodes[NodeIndex].Children[i] = Child;
+            SetChildBox(NodeIndex, i, GetNodeBox(Child));
+        }
+    }
+
+    return NodeIndex;
+}
+
+unsigned int SceneBVH::SplitObjects(unsigned int* pObjects, unsigned int First, unsigned int Last) const
+{
+    BoundingBox Centers;
+
+    for (unsigned int i = First ; i < Last ; i++) {
+        Centers.Expand(m_objects[pObjects[i]].WorldBox.GetCenter());
+    }
+
+    const Vector3f Extent = Centers.Max - Centers.Min;
+    const unsigned int Axis = (Extent.x > Extent.y && Extent.x > Extent.z) ? 0 : (Extent.y > Extent.z ? 1 : 2);
+    const unsigned int Middle = (First + Last) / 2;
+
+    std::nth_element(pObjects + First, pObjects + Middle, pObjects + Last,
+                     [this, Axis](unsigned int l, unsigned int r) {
+                         const Vector3f lc = m_objects[l].WorldBox.GetCenter();
+                         const Vector3f rc = m_objects[r].WorldBox.GetCenter();
+                         return (&lc.x)[Axis] < (&rc.x)[Axis];
+                     });
+
+    return Middle;
+}
+
+void SceneBVH::SetChildBox(unsigned int NodeIndex, unsigned int Slot, const BoundingBox& Box)
+{
+    float* pBoxes = m_nodes[NodeIndex].Boxes;
+    pBoxes[0 + Slot] = Box.Min.x;
+    pBoxes[4 + Slot] = Box.Min.y;
+    pBoxes[8 + Slot] = Box.Min.z;
+    pBoxes[12 + Slot] = Box.Max.x;
+    pBoxes[16 + Slot] = Box.Max.y;
+    pBoxes[20 + Slot] = Box.Max.z;
+}
+
+BoundingBox SceneBVH::GetNodeBox(unsigned int NodeIndex) const
+{
+    const Node& n = m_nodes[NodeIndex];
+    BoundingBox Box;
+
+    for (unsigned int i = 0 ; i < 4 ; i++) {
+        if (n.Children[i] != EMPTY) {
+            Box.Expand(Vector3f(n.Boxes[0 + i], n.Boxes[4 + i], n.Boxes[8 + i]));
+            Box.Expand(Vector3f(n.Boxes[12 + i], n.Boxes[16 + i], n.Boxes[20 + i]));
+        }
+    }
+
+    return Box;
+}
+
+void SceneBVH::Refit()
+{
+    if (!m_moved || m_nodes.empty()) {
+        return;
+    }
+
+    for (unsigned int i = 0 ; i < m_objects.size() ; i++) {
+        Object& o = m_objects[i];
+
+        if (o.Moved) {
+            SetChildBox(o.Node, o.Slot, o.WorldBox);
+            m_nodes[o.Node].Dirty = true;
+            o.Moved = false;
+        }
+    }
+
+    // Children always come after their parent, so walking backwards
+    // finishes every node before the one above it
+    for (unsigned int i = m_nodes.size() ; i-- > 0 ; ) {
+        Node& n = m_nodes[i];
+
+        if (!n.Dirty) {
+            continue;
+        }
+
+        n.Dirty = false;
+
+        if (n.Parent != EMPTY) {
+            SetChildBox(n.Parent, n.ParentSlot, GetNodeBox(i));
+            m_nodes[n.Parent].Dirty = true;
+        }
+    }
+
+    m_moved = false;
+}
+
+void SceneBVH::Cull(const Frustum& f, std::vector<unsigned int>& Visible) const
+{
+    Visible.clear();
+
+    if (m_nodes.empty()) {
+        return;
+    }
+
+    std::vector<unsigned int> Stack;
+    Stack.push_back(0);
+
+    while (!Stack.empty()) {
+        const Node& n = m_nodes[Stack.back()];
+        Stack.pop_back();
+
+        const unsigned int Mask = Box4FrustumTest(n.Boxes, &f.Planes[0].x);
+
+        for (unsigned int i = 0 ; i < 4 ; i++) {
+            if (!(Mask & (1 << i)) || n.Children[i] == EMPTY) {
+                continue;
+            }
+
+            if (n.Children[i] & LEAF_BIT) {
+                Visible.push_back(n.Children[i] & ~LEAF_BIT);
+            }
+            else {
+                Stack.push_back(n.Children[i]);
+            }
+        }
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef SCENE_BVH_H
+#define	SCENE_BVH_H
+
+#include <vector>
+
+#include "math_3d.h"
+
+// Bounding volume hierarchy over the world space boxes of the scene
+// objects, for frustum culling on the CPU. Every node has four children
+// whose boxes are stored as a structure of arrays, so a node is tested
+// against the frustum with one Box4FrustumTest().
+//
+// Objects are added with their local box and world matrix and the tree is
+// made with Build(). Moving objects get a new matrix through
+// SetWorldTransform(); Refit() then updates their boxes and the boxes of
+// the nodes above them without changing the shape of the tree, so a full
+// Build() is only worth it once objects have moved far.
+class SceneBVH
+{
+public:
+
+    SceneBVH();
+
+    // Returns the index of the object
+    unsigned int AddObject(const BoundingBox& LocalBox, const Matrix4f& World);
+
+    void SetWorldTransform(unsigned int Object, const Matrix4f& World);
+
+    void Build();
+
+    void Refit();
+
+    // Fills Visible with the objects whose boxes are at least partly inside
+    void Cull(const Frustum& f, std::vector<unsigned int>& Visible) const;
+
+    unsigned int GetNumObjects() const { return (unsigned int)m_objects.size(); }
+
+    unsigned int GetNumNodes() const { return (unsigned int)m_nodes.size(); }
+
+private:
+
+    // A child is a node index, an object index with LEAF_BIT set or EMPTY
+    static const unsigned int LEAF_BIT = 0x80000000;
+    static const unsigned int EMPTY = 0xFFFFFFFF;
+
+    struct Object {
+        BoundingBox LocalBox;
+        BoundingBox WorldBox;
+        unsigned int Node;
+        unsigned int Slot;
+        bool Moved;
+    };
+
+    struct Node {
+        // MinX[4], MinY[4], MinZ[4], MaxX[4], MaxY[4], MaxZ[4]
+        float Boxes[24];
+        unsigned int Children[4];
+        unsigned int Parent;
+        unsigned int ParentSlot;
+        bool Dirty;
+    };
+
+    unsigned int BuildNode(unsigned int* pObjects, unsigned int NumObjects, unsigned int Parent, unsigned int ParentSlot);
+
+    // Reorders the objects in [First, Last) around the median of the longest
+    // axis of their centers and returns the index of the median
+    unsigned int SplitObjects(unsigned int* pObjects, unsigned int First, unsigned int Last) const;
+
+    void SetChildBox(unsigned int NodeIndex, unsigned int Slot, const BoundingBox& Box);
+
+    BoundingBox GetNodeBox(unsigned int NodeIndex) const;
+
+    std::vector<Object> m_objects;
+    std::vector<Node> m_nodes;
+    bool m_moved;
+};
+
+
+#endif	/* SCENE_BVH_H */
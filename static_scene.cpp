@@ -0,0 +1,300 @@
+#include <math.h>
+#include <stdio.h>
+
+#include "static_scene.h"
+#include "render_state.h"
+
+StaticScene::StaticScene()
+{
+    m_pMesh = NULL;
+    m_drawIdBuffer = 0;
+    m_objectBuffer = 0;
+    m_commandBuffer = 0;
+    m_listCommandBuffer = 0;
+    m_pCullTech = NULL;
+    m_compact = false;
+    m_boundsBuffer = 0;
+    m_visibleBuffer = 0;
+    m_drawCountBuffer = 0;
+}
+
+StaticScene::~StaticScene()
+{
+    delete m_pMesh;
+    delete m_pCullTech;
+
+    if (m_drawIdBuffer != 0) {
+        RenderState::DeleteBuffers(1, &m_drawIdBuffer);
+    }
+
+    if (m_objectBuffer != 0) {
+        RenderState::DeleteBuffers(1, &m_objectBuffer);
+    }
+
+    if (m_commandBuffer != 0) {
+        RenderState::DeleteBuffers(1, &m_commandBuffer);
+    }
+
+    if (m_listCommandBuffer != 0) {
+        RenderState::DeleteBuffers(1, &m_listCommandBuffer);
+    }
+
+    if (m_boundsBuffer != 0) {
+        RenderState::DeleteBuffers(1, &m_boundsBuffer);
+    }
+
+    if (m_visibleBuffer != 0) {
+        RenderState::DeleteBuffers(1, &m_visibleBuffer);
+    }
+
+    if (m_drawCountBuffer != 0) {
+        RenderState::DeleteBuffers(1, &m_drawCountBuffer);
+    }
+}
+
+unsigned int StaticScene::AddMesh(const Vertex* pVertices, unsigned int NumVertices,
+                                  const unsigned int* pIndices, unsigned int NumIndices)
+{
+    MeshRange Range;
+    Range.FirstIndex = m_indices.size();
+    Range.NumIndices = NumIndices;
+    Range.BaseVertex = m_vertices.size();
+
+    // The sphere around the bounding box is loose but cheap
+    Vector3f Min = pVertices[0].m_pos;
+    Vector3f Max = pVertices[0].m_pos;
+
+    for (unsigned int i = 1 ; i < NumVertices ; i++) {
+        const Vector3f& p = pVertices[i].m_pos;
+        Min = Vector3f(fminf(Min.x, p.x), fminf(Min.y, p.y), fminf(Min.z, p.z));
+        Max = Vector3f(fmaxf(Max.x, p.x), fmaxf(Max.y, p.y), fmaxf(Max.z, p.z));
+    }
+
+    const Vector3f Extent = Max - Min;
+    Range.Center = Vector3f((Min.x + Max.x) * 0.5f, (Min.y + Max.y) * 0.5f, (Min.z + Max.z) * 0.5f);
+    Range.Radius = 0.5f * sqrtf(Extent.x * Extent.x + Extent.y * Extent.y + Extent.z * Extent.z);
+
+    // Indices stay relative to the mesh, the command adds the base vertex
+    m_vertices.insert(m_vertices.end(), pVertices, pVertices + NumVertices);
+    m_indices.insert(m_indices.end(), pIndices, pIndices + NumIndices);
+    m_meshes.push_back(Range);
+
+    return m_meshes.size() - 1;
+}
+
+unsigned int StaticScene::AddObject(unsigned int MeshIndex, const Matrix4f& World,
+                                    const Vector4f& PatternRect, float PatternLayer)
+{
+    const MeshRange& Range = m_meshes[MeshIndex];
+
+    ObjectData Object;
+    Object.World = World;
+    Object.PatternRect = PatternRect;
+    Object.PatternLayer = PatternLayer;
+    Object.Padding[0] = Object.Padding[1] = Object.Padding[2] = 0.0f;
+
+    DrawElementsIndirectCommand Command;
+    Command.Count = Range.NumIndices;
+    Command.InstanceCount = 1;
+    Command.FirstIndex = Range.FirstIndex;
+    Command.BaseVertex = Range.BaseVertex;
+    Command.BaseInstance = m_objects.size();
+
+    // The radius grows with the largest scale of the world matrix
+    const Vector4f Center = World * Vector4f(Range.Center, 1.0f);
+    float MaxScale = 0.0f;
+
+    for (unsigned int i = 0 ; i < 3 ; i++) {
+        const float Scale = sqrtf(World.m[0][i] * World.m[0][i] + World.m[1][i] * World.m[1][i] + World.m[2][i] * World.m[2][i]);
+        MaxScale = fmaxf(MaxScale, Scale);
+    }
+
+    m_objects.push_back(Object);
+    m_commands.push_back(Command);
+    m_bounds.push_back(Vector4f(Center.x, Center.y, Center.z, Range.Radius * MaxScale));
+
+    return m_objects.size() - 1;
+}
+
+bool StaticScene::Finalize()
+{
+    if (!GLEW_ARB_multi_draw_indirect || !GLEW_ARB_shader_storage_buffer_object ||
+        !GLEW_ARB_base_instance) {
+        fprintf(stderr, "Multi-draw indirect is not supported\n");
+        return false;
+    }
+
+    if (m_objects.empty()) {
+        return false;
+    }
+
+    m_pMesh = new Mesh();
+
+    if (!m_pMesh->Init(&m_vertices[0], m_vertices.size(), &m_indices[0], m_indices.size())) {
+        return false;
+    }
+
+    std::vector<GLuint> DrawIds(m_objects.size());
+
+    for (unsigned int i = 0 ; i < DrawIds.size() ; i++) {
+        DrawIds[i] = i;
+    }
+
+    glGenBuffers(1, &m_drawIdBuffer);
+    RenderState::BindBuffer(GL_ARRAY_BUFFER, m_drawIdBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLuint) * DrawIds.size(), &DrawIds[0], GL_STATIC_DRAW);
+
+    GLuint Binding = m_pMesh->AddInstanceBuffer(m_drawIdBuffer, sizeof(GLuint));
+    m_pMesh->AddInstanceAttributeI(Binding, DRAW_ID_LOCATION, 1, 0);
+
+    glGenBuffers(1, &m_objectBuffer);
+    RenderState::BindBuffer(GL_SHADER_STORAGE_BUFFER, m_objectBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(ObjectData) * m_objects.size(), &m_objects[0], GL_STATIC_DRAW);
+
+    glGenBuffers(1, &m_commandBuffer);
+    RenderState::BindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) * m_commands.size(), &m_commands[0], GL_STATIC_DRAW);
+
+    // Everything is in GL memory now
+    std::vector<Vertex>().swap(m_vertices);
+    std::vector<unsigned int>().swap(m_indices);
+
+    return true;
+}
+
+void StaticScene::Render()
+{
+    Render(0, m_commands.size());
+}
+
+void StaticScene::Render(unsigned int FirstObject, unsigned int NumObjects)
+{
+    if (!m_pMesh || NumObjects == 0) {
+        return;
+    }
+
+    RenderState::BindVertexArray(m_pMesh->GetVAO());
+    RenderState::BindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+    RenderState::BindBufferRange(GL_SHADER_STORAGE_BUFFER, OBJECTS_BINDING, m_objectBuffer,
+                                 0, sizeof(ObjectData) * m_objects.size());
+
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                (const GLvoid*)(sizeof(DrawElementsIndirectCommand) * FirstObject),
+                                NumObjects, 0);
+}
+
+void StaticScene::RenderList(const unsigned int* pObjects, unsigned int NumObjects)
+{
+    if (!m_pMesh || NumObjects == 0) {
+        return;
+    }
+
+    m_listCommands.resize(NumObjects);
+
+    for (unsigned int i = 0 ; i < NumObjects ; i++) {
+        m_listCommands[i] = m_commands[pObjects[i]];
+    }
+
+    if (m_listCommandBuffer == 0) {
+        glGenBuffers(1, &m_listCommandBuffer);
+    }
+
+    RenderState::BindVertexArray(m_pMesh->GetVAO());
+    RenderState::BindBuffer(GL_DRAW_INDIRECT_BUFFER, m_listCommandBuffer);
+    RenderState::BindBufferRange(GL_SHADER_STORAGE_BUFFER, OBJECTS_BINDING, m_objectBuffer,
+                                 0, sizeof(ObjectData) * m_objects.size());
+
+    // Orphaned every frame, so the driver does not wait for the last draw
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) * m_commands.size(), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(DrawElementsIndirectCommand) * NumObjects, &m_listCommands[0]);
+
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, NumObjects, 0);
+}
+
+bool StaticScene::InitCulling()
+{
+    if (!GLEW_ARB_compute_shader || !m_pMesh) {
+        fprintf(stderr, "GPU culling is not supported\n");
+        return false;
+    }
+
+    m_compact = GLEW_ARB_indirect_parameters;
+    m_pCullTech = new CullTechnique(m_compact);
+
+    if (!m_pCullTech->Init()) {
+        delete m_pCullTech;
+        m_pCullTech = NULL;
+        return false;
+    }
+
+    glGenBuffers(1, &m_boundsBuffer);
+    RenderState::BindBuffer(GL_SHADER_STORAGE_BUFFER, m_boundsBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(Vector4f) * m_bounds.size(), &m_bounds[0], GL_STATIC_DRAW);
+
+    glGenBuffers(1, &m_visibleBuffer);
+    RenderState::BindBuffer(GL_SHADER_STORAGE_BUFFER, m_visibleBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(DrawElementsIndirectCommand) * m_commands.size(), NULL, GL_DYNAMIC_DRAW);
+
+    glGenBuffers(1, &m_drawCountBuffer);
+    RenderState::BindBuffer(GL_SHADER_STORAGE_BUFFER, m_drawCountBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+
+    return true;
+}
+
+void StaticScene::Cull(const Matrix4f& VP)
+{
+    if (!m_pCullTech) {
+        return;
+    }
+
+    Frustum f;
+    f.Init(VP);
+
+    const GLuint NumObjects = m_commands.size();
+
+    if (m_compact) {
+        const GLuint Zero = 0;
+        RenderState::BindBuffer(GL_SHADER_STORAGE_BUFFER, m_drawCountBuffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(Zero), &Zero);
+    }
+
+    m_pCullTech->Enable();
+    m_pCullTech->SetFrustum(f);
+    m_pCullTech->SetNumObjects(NumObjects);
+
+    RenderState::BindBufferRange(GL_SHADER_STORAGE_BUFFER, CullTechnique::COMMANDS_BINDING, m_commandBuffer,
+                                 0, sizeof(DrawElementsIndirectCommand) * NumObjects);
+    RenderState::BindBufferRange(GL_SHADER_STORAGE_BUFFER, CullTechnique::BOUNDS_BINDING, m_boundsBuffer,
+                                 0, sizeof(Vector4f) * NumObjects);
+    RenderState::BindBufferRange(GL_SHADER_STORAGE_BUFFER, CullTechnique::VISIBLE_BINDING, m_visibleBuffer,
+                                 0, sizeof(DrawElementsIndirectCommand) * NumObjects);
+    RenderState::BindBufferRange(GL_SHADER_STORAGE_BUFFER, CullTechnique::DRAW_COUNT_BINDING, m_drawCountBuffer,
+                                 0, sizeof(GLuint));
+
+    glDispatchCompute((NumObjects + CullTechnique::GROUP_SIZE - 1) / CullTechnique::GROUP_SIZE, 1, 1);
+
+    // The draw reads the commands (and the count) the shader wrote
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+}
+
+void StaticScene::RenderVisible()
+{
+    if (!m_pCullTech) {
+        Render();
+        return;
+    }
+
+    RenderState::BindVertexArray(m_pMesh->GetVAO());
+    RenderState::BindBuffer(GL_DRAW_INDIRECT_BUFFER, m_visibleBuffer);
+    RenderState::BindBufferRange(GL_SHADER_STORAGE_BUFFER, OBJECTS_BINDING, m_objectBuffer,
+                                 0, sizeof(ObjectData) * m_objects.size());
+
+    if (m_compact) {
+        RenderState::BindBuffer(GL_PARAMETER_BUFFER_ARB, m_drawCountBuffer);
+        glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_INT, 0, 0, m_commands.size(), 0);
+    }
+    else {
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, m_commands.size(), 0);
+    }
+}
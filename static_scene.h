@@ -0,0 +1,123 @@
+#ifndef STATIC_SCENE_H
+#define	STATIC_SCENE_H
+
+#include <vector>
+#include <GL/glew.h>
+
+#include "math_3d.h"
+#include "mesh.h"
+#include "cull_technique.h"
+
+// Static geometry drawn with glMultiDrawElementsIndirect. The vertices and
+// indices of every mesh are packed into one shared Mesh, every object is a
+// DrawElementsIndirectCommand in a GL_DRAW_INDIRECT_BUFFER and its world
+// matrix and pattern region sit in a shader storage buffer, so any range
+// of objects is drawn with a single call.
+//
+// Shaders find their object through the DRAW_ID_LOCATION attribute: each
+// command draws one instance with the object index as its base instance,
+// and the attribute reads that index from a buffer of 0, 1, 2, ... The
+// object buffer is bound to OBJECTS_BINDING as std430 ObjectData[].
+//
+// Meshes and objects are added first, Finalize() uploads everything and
+// nothing can be added afterwards.
+//
+// With InitCulling() the objects can be culled on the GPU: Cull() runs a
+// CullTechnique over the bounding spheres of all objects and writes the
+// commands of the visible ones, RenderVisible() draws them without the
+// CPU reading anything back. With ARB_indirect_parameters the visible
+// commands are packed and their count is read by the draw itself,
+// otherwise every command is kept with 0 instances when culled.
+class StaticScene
+{
+public:
+
+    static const GLuint DRAW_ID_LOCATION = 9;
+    static const GLuint OBJECTS_BINDING = 0;
+
+    StaticScene();
+
+    ~StaticScene();
+
+    // Returns the index of the mesh for AddObject()
+    unsigned int AddMesh(const Vertex* pVertices, unsigned int NumVertices,
+                         const unsigned int* pIndices, unsigned int NumIndices);
+
+    // Returns the index of the object, the order of Render() ranges
+    unsigned int AddObject(unsigned int MeshIndex, const Matrix4f& World,
+                           const Vector4f& PatternRect, float PatternLayer);
+
+    // Fails without GL 4.3 multi-draw indirect and storage buffers
+    bool Finalize();
+
+    void Render();
+
+    void Render(unsigned int FirstObject, unsigned int NumObjects);
+
+    // Draws a list of objects, e.g. the ones found visible on the CPU. The
+    // commands are gathered into a stream buffer, still one draw call.
+    void RenderList(const unsigned int* pObjects, unsigned int NumObjects);
+
+    // Fails without compute shaders, call after Finalize()
+    bool InitCulling();
+
+    bool IsCullingEnabled() const { return m_pCullTech != NULL; }
+
+    void Cull(const Matrix4f& VP);
+
+    // Draws the objects the last Cull() found visible
+    void RenderVisible();
+
+    unsigned int GetNumObjects() const { return (unsigned int)m_objects.size(); }
+
+private:
+
+    // Layout fixed by GL
+    struct DrawElementsIndirectCommand {
+        GLuint Count;
+        GLuint InstanceCount;
+        GLuint FirstIndex;
+        GLint BaseVertex;
+        GLuint BaseInstance;
+    };
+
+    // std430 layout of the shader side ObjectData
+    struct ObjectData {
+        Matrix4f World;
+        Vector4f PatternRect;
+        float PatternLayer;
+        float Padding[3];
+    };
+
+    struct MeshRange {
+        unsigned int FirstIndex;
+        unsigned int NumIndices;
+        unsigned int BaseVertex;
+        Vector3f Center;
+        float Radius;
+    };
+
+    std::vector<Vertex> m_vertices;
+    std::vector<unsigned int> m_indices;
+    std::vector<MeshRange> m_meshes;
+    std::vector<ObjectData> m_objects;
+    std::vector<DrawElementsIndirectCommand> m_commands;
+    // World space bounding sphere of every object, (center, radius)
+    std::vector<Vector4f> m_bounds;
+    std::vector<DrawElementsIndirectCommand> m_listCommands;
+
+    Mesh* m_pMesh;
+    GLuint m_drawIdBuffer;
+    GLuint m_objectBuffer;
+    GLuint m_commandBuffer;
+    GLuint m_listCommandBuffer;
+
+    CullTechnique* m_pCullTech;
+    bool m_compact;
+    GLuint m_boundsBuffer;
+    GLuint m_visibleBuffer;
+    GLuint m_drawCountBuffer;
+};
+
+
+#endif	/* STATIC_SCENE_H */
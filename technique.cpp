@@ -1,10 +1,35 @@
 #include <stdio.h>
 #include <string.h>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
 
 #include "technique.h"
+#include "render_state.h"
+
+// Заголовок файла с двоичным кодом программы в кэше
+#define PROGRAM_BINARY_MAGIC 0x42505247 // "GRPB"
+
+struct ProgramBinaryHeader {
+    unsigned int Magic;
+    unsigned int Format;
+    unsigned long long Key;
+    unsigned int Length;
+};
+
+std::string Technique::s_binaryCacheDir;
+unsigned int Technique::s_numTechniques = 0;
 
 Technique::Technique(){
     m_shaderProg = 0;
+    m_programKey = 0;
+    m_async = false;
+    m_ready = false;
+    m_id = s_numTechniques++;
 }
 
 Technique::~Technique(){
@@ -13,7 +38,7 @@ Technique::~Technique(){
     }
 
     if (m_shaderProg != 0){
-        glDeleteProgram(m_shaderProg);
+        RenderState::DeleteProgram(m_shaderProg);
         m_shaderProg = 0;
     }
 }
@@ -31,54 +56,172 @@ bool Technique::Init(){
 
 //Используем этот метод для добавления шейдеров в программу. Когда заканчиваем - вызываем finalize()
 bool Technique::AddShader(GLenum ShaderType, const char* pShaderText){
-    GLuint ShaderObj = glCreateShader(ShaderType);
+    return AddShader(ShaderType, &pShaderText, 1);
+}
+
+// Шейдер, собранный из нескольких фрагментов исходного кода, идущих друг за другом
+bool Technique::AddShader(GLenum ShaderType, const char** ppShaderTexts, unsigned int NumTexts){
+    // Компиляция откладывается до Finalize(): если программа найдется в
+    // кэше, исходники вообще не понадобятся
+    ShaderSource Source;
+    Source.Type = ShaderType;
+
+    for (unsigned int i = 0; i < NumTexts; i++){
+        Source.Text += ppShaderTexts[i];
+    }
+
+    // #version должна идти первой, поэтому определения вставляются после нее
+    if (!m_defines.empty()){
+        size_t Pos = Source.Text.find("#version");
+
+        if (Pos == std::string::npos){
+            Pos = 0;
+        }
+        else {
+            Pos = Source.Text.find('\n', Pos);
+            Pos = (Pos == std::string::npos) ? Source.Text.size() : Pos + 1;
+        }
+
+        Source.Text.insert(Pos, m_defines);
+    }
+
+    m_shaderSources.push_back(Source);
+
+    return true;
+}
+
+void Technique::AddDefine(const char* pName){
+    m_defines += "#define ";
+    m_defines += pName;
+    m_defines += "\n";
+}
+
+void Technique::AddDefine(const char* pName, int Value){
+    char Text[16];
+    snprintf(Text, sizeof(Text), " %d", Value);
+
+    m_defines += "#define ";
+    m_defines += pName;
+    m_defines += Text;
+    m_defines += "\n";
+}
+
+// Отправляем добавленные шейдеры на компиляцию и прикрепляем их к программе.
+// Статус не запрашивается: запрос заставил бы ждать окончания компиляции
+bool Technique::CompileShaders(){
+    for (std::list<ShaderSource>::iterator it = m_shaderSources.begin(); it != m_shaderSources.end(); it++){
+        GLuint ShaderObj = glCreateShader(it->Type);
+
+        if (ShaderObj == 0){
+            fprintf(stderr, "Error creating shader type %d\n", it->Type);
+            return false;
+        }
+
+        // Сохраним объект шейдера - он будет удален в деструкторе
+        m_shaderObjList.push_back(ShaderObj);
+
+        const GLchar* pText = it->Text.c_str();
+        const GLint Length = it->Text.size();
+        glShaderSource(ShaderObj, 1, &pText, &Length);
+
+        glCompileShader(ShaderObj);
+
+        glAttachShader(m_shaderProg, ShaderObj);
+    }
+
+    return true;
+}
+
+// Ошибки компиляции проверяются только когда линковка не удалась
+void Technique::PrintCompileErrors(){
+    for (ShaderObjList::iterator it = m_shaderObjList.begin(); it != m_shaderObjList.end(); it++){
+        GLint success;
+        glGetShaderiv(*it, GL_COMPILE_STATUS, &success);
+
+        if (!success){
+            GLint Type;
+            glGetShaderiv(*it, GL_SHADER_TYPE, &Type);
 
-    if (ShaderObj == 0){
-        fprintf(stderr, "Error creating shader type %d\n", ShaderType);
+            GLchar InfoLog[1024];
+            glGetShaderInfoLog(*it, 1024, NULL, InfoLog);
+            fprintf(stderr, "Error compiling shader type %d: '%s'\n", Type, InfoLog);
+        }
+    }
+}
+
+// После добавления всех шейдеров в программу вызываем эту функцию
+// для линковки и проверки программы на ошибки. Технику, добавленную в
+// TechniqueRegistry, функция только отправляет на сборку, а проверку и
+// ResolveUniforms() выполняет реестр, когда драйвер закончит
+bool Technique::Finalize(){
+    if (!SubmitProgram()){
         return false;
     }
 
-    // Сохраним объект шейдера - он будет удален в декструкторе
-    m_shaderObjList.push_back(ShaderObj);
+    if (m_async){
+        return true;
+    }
 
-    const GLchar* p[1];
-    p[0] = pShaderText;
-    GLint Lengths[1];
-    Lengths[0] = strlen(pShaderText);
-    glShaderSource(ShaderObj, 1, p, Lengths);
+    return CompleteProgram();
+}
 
-    glCompileShader(ShaderObj);
+bool Technique::SubmitProgram(){
+    m_programKey = CalcProgramKey();
 
-    GLint success;
-    glGetShaderiv(ShaderObj, GL_COMPILE_STATUS, &success);
+    // Программа из кэша уже слинкована
+    if (LoadBinary(m_programKey)){
+        m_shaderSources.clear();
+        return true;
+    }
 
-    if (!success){
-        GLchar InfoLog[1024];
-        glGetShaderInfoLog(ShaderObj, 1024, NULL, InfoLog);
-        fprintf(stderr, "Error compiling shader type %d: '%s'\n", ShaderType, InfoLog);
+    if (!CompileShaders()){
         return false;
     }
 
-    glAttachShader(m_shaderProg, ShaderObj);
+    m_shaderSources.clear();
+
+    if (!s_binaryCacheDir.empty()){
+        glProgramParameteri(m_shaderProg, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    glLinkProgram(m_shaderProg);
 
     return true;
 }
 
-// После добавления всех шейдеров в программу вызываем эту функцию
-// для линковки и проверки программу на ошибки
-bool Technique::Finalize(){
+// С GL_KHR_parallel_shader_compile драйвер собирает программу в своих
+// потоках, и готовность можно узнать без ожидания. Без расширения
+// программа считается готовой - ожидание произойдет в CompleteProgram()
+bool Technique::IsProgramDone(){
+    if (m_shaderObjList.empty() || !GLEW_KHR_parallel_shader_compile){
+        return true;
+    }
+
+    GLint Done = GL_TRUE;
+    glGetProgramiv(m_shaderProg, GL_COMPLETION_STATUS_KHR, &Done);
+
+    return Done != GL_FALSE;
+}
+
+bool Technique::CompleteProgram(){
     GLint Success = 0;
     GLchar ErrorLog[1024] = {0};
 
-    glLinkProgram(m_shaderProg);
-
-    glGetProgramiv(m_shaderProg, GL_LINK_STATUS, &Success);
-    if (Success == 0){
-        glGetProgramInfoLog(m_shaderProg, sizeof(ErrorLog), NULL, ErrorLog);
-        fprintf(stderr, "Error linking shader program: '%s'\n", ErrorLog);
-        return false;
+    // Объекты шейдеров есть только у программы, собранной из исходников
+    if (!m_shaderObjList.empty()){
+        glGetProgramiv(m_shaderProg, GL_LINK_STATUS, &Success);
+        if (Success == 0){
+            PrintCompileErrors();
+            glGetProgramInfoLog(m_shaderProg, sizeof(ErrorLog), NULL, ErrorLog);
+            fprintf(stderr, "Error linking shader program: '%s'\n", ErrorLog);
+            return false;
+        }
+
+        SaveBinary(m_programKey);
     }
 
+    // Проверка зависит от текущего состояния GL и нужна только при отладке
+#ifndef NDEBUG
     glValidateProgram(m_shaderProg);
     glGetProgramiv(m_shaderProg, GL_VALIDATE_STATUS, &Success);
     if (Success == 0){
@@ -86,6 +229,7 @@ bool Technique::Finalize(){
         fprintf(stderr, "Invalid shader program: '%s'\n", ErrorLog);
         return false;
     }
+#endif
 
     // Удаляем промежуточные объекты шейдеров, которые были добавлены в программу
     for (ShaderObjList::iterator it = m_shaderObjList.begin(); it != m_shaderObjList.end(); it++){
@@ -94,11 +238,159 @@ bool Technique::Finalize(){
 
     m_shaderObjList.clear();
 
+    if (!ResolveUniforms()){
+        return false;
+    }
+
+    m_ready = true;
+
     return true;
 }
 
+bool Technique::ResolveUniforms(){
+    return true;
+}
+
+void Technique::SetDrawParams(const DrawParams& /* Params */){
+}
+
+void Technique::EnableBinaryCache(const char* pDirectory){
+    if (!GLEW_ARB_get_program_binary){
+        return;
+    }
+
+    GLint NumFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &NumFormats);
+
+    if (NumFormats == 0){
+        return;
+    }
+
+#ifdef _WIN32
+    _mkdir(pDirectory);
+#else
+    mkdir(pDirectory, 0755);
+#endif
+
+    s_binaryCacheDir = pDirectory;
+}
+
+// Ключ программы - хэш FNV-1a от исходников всех шейдеров (вместе с
+// #define) и строк драйвера: новый драйвер может не принять старый код
+unsigned long long Technique::CalcProgramKey(){
+    std::string Data;
+
+    for (std::list<ShaderSource>::iterator it = m_shaderSources.begin(); it != m_shaderSources.end(); it++){
+        char Type[16];
+        snprintf(Type, sizeof(Type), "%x:", it->Type);
+        Data += Type;
+        Data += it->Text;
+    }
+
+    const GLenum DriverStrings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+
+    for (unsigned int i = 0; i < sizeof(DriverStrings) / sizeof(DriverStrings[0]); i++){
+        const GLubyte* pString = glGetString(DriverStrings[i]);
+
+        if (pString){
+            Data += (const char*)pString;
+        }
+    }
+
+    unsigned long long Hash = 14695981039346656037ULL;
+
+    for (unsigned int i = 0; i < Data.size(); i++){
+        Hash ^= (unsigned char)Data[i];
+        Hash *= 1099511628211ULL;
+    }
+
+    return Hash;
+}
+
+std::string Technique::GetBinaryFileName(unsigned long long Key){
+    char Name[32];
+    snprintf(Name, sizeof(Name), "/%016llx.bin", Key);
+
+    return s_binaryCacheDir + Name;
+}
+
+// Загружаем программу из кэша. Если файла нет или драйвер его не принял,
+// программа будет собрана из исходников
+bool Technique::LoadBinary(unsigned long long Key){
+    if (s_binaryCacheDir.empty()){
+        return false;
+    }
+
+    FILE* f = fopen(GetBinaryFileName(Key).c_str(), "rb");
+
+    if (!f){
+        return false;
+    }
+
+    ProgramBinaryHeader Header;
+    std::vector<char> Binary;
+    bool Ok = fread(&Header, sizeof(Header), 1, f) == 1 &&
+              Header.Magic == PROGRAM_BINARY_MAGIC &&
+              Header.Key == Key &&
+              Header.Length > 0;
+
+    if (Ok){
+        Binary.resize(Header.Length);
+        Ok = fread(&Binary[0], 1, Header.Length, f) == Header.Length;
+    }
+
+    fclose(f);
+
+    if (!Ok){
+        return false;
+    }
+
+    glProgramBinary(m_shaderProg, Header.Format, &Binary[0], Header.Length);
+
+    GLint Success = 0;
+    glGetProgramiv(m_shaderProg, GL_LINK_STATUS, &Success);
+
+    return Success != 0;
+}
+
+void Technique::SaveBinary(unsigned long long Key){
+    if (s_binaryCacheDir.empty()){
+        return;
+    }
+
+    GLint Length = 0;
+    glGetProgramiv(m_shaderProg, GL_PROGRAM_BINARY_LENGTH, &Length);
+
+    if (Length <= 0){
+        return;
+    }
+
+    std::vector<char> Binary(Length);
+    ProgramBinaryHeader Header;
+    Header.Magic = PROGRAM_BINARY_MAGIC;
+    Header.Key = Key;
+    Header.Length = 0;
+
+    glGetProgramBinary(m_shaderProg, Length, (GLsizei*)&Header.Length, (GLenum*)&Header.Format, &Binary[0]);
+
+    if (Header.Length == 0){
+        return;
+    }
+
+    FILE* f = fopen(GetBinaryFileName(Key).c_str(), "wb");
+
+    if (!f){
+        fprintf(stderr, "Warning! Unable to write the program binary to '%s'\n", s_binaryCacheDir.c_str());
+        return;
+    }
+
+    fwrite(&Header, sizeof(Header), 1, f);
+    fwrite(&Binary[0], 1, Header.Length, f);
+    fclose(f);
+}
+
 void Technique::Enable(){
-    glUseProgram(m_shaderProg);
+    RenderState::UseProgram(m_shaderProg);
 }
 
 GLint Technique::GetUniformLocation(const char* pUniformName){
@@ -111,6 +403,20 @@ GLint Technique::GetUniformLocation(const char* pUniformName){
     return Location;
 }
 
+// Связывает uniform-блок программы с точкой привязки, к которой подключен буфер
+bool Technique::BindUniformBlock(const char* pBlockName, GLuint BindingIndex){
+    GLuint BlockIndex = glGetUniformBlockIndex(m_shaderProg, pBlockName);
+
+    if (BlockIndex == GL_INVALID_INDEX){
+        fprintf(stderr, "Warning! Unable to get the index of uniform block '%s'\n", pBlockName);
+        return false;
+    }
+
+    glUniformBlockBinding(m_shaderProg, BlockIndex, BindingIndex);
+
+    return true;
+}
+
 
 
 
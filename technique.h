@@ -3,9 +3,12 @@
 
 #include <GL/glew.h>
 #include <list>
+#include <string>
 
 #define INVALID_UNIFORM_LOCATION 0xFFFFFFFF
 
+struct DrawParams;
+
 class Technique
 {
     public:
@@ -14,15 +17,65 @@ class Technique
         virtual bool Init();
         void Enable();
 
+        // The program is linked and its uniforms are resolved
+        bool IsReady() const { return m_ready; }
+
+        // Small number unique to the technique, used to sort draws
+        unsigned int GetId() const { return m_id; }
+
+        // Sets the per-draw values of a draw submitted by RenderQueue
+        virtual void SetDrawParams(const DrawParams& Params);
+
+        // Linked programs are stored in this directory and loaded from it on
+        // the next start when the shader sources and the driver are the same
+        static void EnableBinaryCache(const char* pDirectory);
+
     protected:
         bool AddShader(GLenum ShaderType, const char* pShaderText);
+        bool AddShader(GLenum ShaderType, const char** ppShaderTexts, unsigned int NumTexts);
+
+        // Defines inserted after the #version line of the shaders added
+        // afterwards, to build permutations of the same source
+        void AddDefine(const char* pName);
+        void AddDefine(const char* pName, int Value);
         bool Finalize();
+
+        // Called once the program is linked, to look up the uniforms
+        virtual bool ResolveUniforms();
+
         GLint GetUniformLocation(const char* pUniformName);
+        bool BindUniformBlock(const char* pBlockName, GLuint BindingIndex);
 
     private:
+        friend class TechniqueRegistry;
+
+        struct ShaderSource {
+            GLenum Type;
+            std::string Text;
+        };
+
+        unsigned long long CalcProgramKey();
+        std::string GetBinaryFileName(unsigned long long Key);
+        bool LoadBinary(unsigned long long Key);
+        void SaveBinary(unsigned long long Key);
+        bool CompileShaders();
+        void PrintCompileErrors();
+        bool SubmitProgram();
+        bool IsProgramDone();
+        bool CompleteProgram();
+
         GLuint m_shaderProg;
         typedef std::list<GLuint> ShaderObjList;
         ShaderObjList m_shaderObjList;
+        std::list<ShaderSource> m_shaderSources;
+        std::string m_defines;
+        unsigned long long m_programKey;
+        bool m_async;
+        bool m_ready;
+        unsigned int m_id;
+
+        static std::string s_binaryCacheDir;
+        static unsigned int s_numTechniques;
 };
 
 #endif /* TEXHNIQUE_H */
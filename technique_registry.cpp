@@ -0,0 +1,96 @@
+#include <stdio.h>
+
+#include "technique_registry.h"
+
+#pragma once
+
+TechniqueRegistry::TechniqueRegistry()
+{
+    m_numFailed = 0;
+
+    // Let the driver pick the number of compiler threads
+    if (GLEW_KHR_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    }
+}
+
+bool TechniqueRegistry::Add(Technique* pTechnique)
+{
+    pTechnique->m_async = true;
+
+    if (!pTechnique->Init()) {
+        pTechnique->m_async = false;
+        m_numFailed++;
+        return false;
+    }
+
+    m_pending.push_back(pTechnique);
+
+    return true;
+}
+
+unsigned int TechniqueRegistry::Update()
+{
+    const bool Parallel = GLEW_KHR_parallel_shader_compile != 0;
+
+    for (unsigned int i = 0 ; i < m_pending.size() ; ) {
+        Technique* pTechnique = m_pending[i];
+
+        if (!pTechnique->IsProgramDone()) {
+            i++;
+            continue;
+        }
+
+        m_pending[i] = m_pending.back();
+        m_pending.pop_back();
+
+        Complete(pTechnique);
+
+        if (!Parallel) {
+            break;
+        }
+    }
+
+    return (unsigned int)m_pending.size();
+}
+
+bool TechniqueRegistry::Finish(Technique* pTechnique)
+{
+    for (unsigned int i = 0 ; i < m_pending.size() ; i++) {
+        if (m_pending[i] == pTechnique) {
+            m_pending[i] = m_pending.back();
+            m_pending.pop_back();
+            return Complete(pTechnique);
+        }
+    }
+
+    // Already completed (or never added)
+    return pTechnique->IsReady();
+}
+
+bool TechniqueRegistry::FinishAll()
+{
+    bool Ok = true;
+
+    while (!m_pending.empty()) {
+        Technique* pTechnique = m_pending.back();
+        m_pending.pop_back();
+
+        Ok = Complete(pTechnique) && Ok;
+    }
+
+    return Ok;
+}
+
+bool TechniqueRegistry::Complete(Technique* pTechnique)
+{
+    pTechnique->m_async = false;
+
+    if (!pTechnique->CompleteProgram()) {
+        fprintf(stderr, "Error building a registered technique\n");
+        m_numFailed++;
+        return false;
+    }
+
+    return true;
+}
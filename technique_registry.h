@@ -0,0 +1,44 @@
+#ifndef TECHNIQUE_REGISTRY_H
+#define	TECHNIQUE_REGISTRY_H
+
+#include <vector>
+
+#include "technique.h"
+
+// Builds techniques without waiting on each compile. Add() runs Init() of a
+// technique with the status checks deferred, so the shaders and the link of
+// every technique are submitted up front, and Update() completes (checks and
+// resolves the uniforms of) the programs the driver has finished.
+//
+// With GL_KHR_parallel_shader_compile the driver compiles on its own threads
+// and Update() never blocks. Without it Update() completes one program per
+// call, so the waiting is at least spread over frames.
+//
+// The registry does not own the techniques; a technique is usable once its
+// IsReady() returns true.
+class TechniqueRegistry
+{
+public:
+    TechniqueRegistry();
+
+    bool Add(Technique* pTechnique);
+
+    // Returns the number of techniques still building
+    unsigned int Update();
+
+    // Blocks until the technique (or every one) is complete, returns false
+    // if it failed to build
+    bool Finish(Technique* pTechnique);
+    bool FinishAll();
+
+    unsigned int GetNumPending() const { return (unsigned int)m_pending.size(); }
+    unsigned int GetNumFailed() const { return m_numFailed; }
+
+private:
+    bool Complete(Technique* pTechnique);
+
+    std::vector<Technique*> m_pending;
+    unsigned int m_numFailed;
+};
+
+#endif	/* TECHNIQUE_REGISTRY_H */
@@ -1,35 +1,141 @@
 #include <iostream>
 #include "texture.h"
+#include "render_state.h"
 
 Texture::Texture(GLenum TextureTarget, const std::string& FileName)
 {
     m_textureTarget = TextureTarget;
     m_fileName      = FileName;
-    m_pImage        = NULL;
+    m_textureObj    = 0;
+    m_loaded        = false;
+    m_sizeInBytes   = 0;
+    m_pSampler      = NULL;
+}
+
+Texture::~Texture()
+{
+    Unload();
 }
 
 bool Texture::Load()
+{
+    if (TextureFile::IsTextureFile(m_fileName)) {
+        TextureFile File;
+
+        if (!File.Open(m_fileName)) {
+            return false;
+        }
+
+        Upload(File);
+
+        return true;
+    }
+
+    Magick::Blob Blob;
+    unsigned int Width = 0;
+    unsigned int Height = 0;
+
+    if (!Decode(m_fileName, Blob, Width, Height)) {
+        return false;
+    }
+
+    Upload(Width, Height, Blob.data());
+
+    return true;
+}
+
+bool Texture::Decode(const std::string& FileName, Magick::Blob& Blob, unsigned int& Width, unsigned int& Height)
 {
     try {
-        m_pImage = new Magick::Image(m_fileName);
-        m_pImage->write(&m_blob, "RGBA");
+        Magick::Image Image(FileName);
+        Image.write(&Blob, "RGBA");
+        Width = Image.columns();
+        Height = Image.rows();
     }
     catch (Magick::Error& Error) {
-        std::cout << "Error loading texture '" << m_fileName << "': " << Error.what() << std::endl;
+        std::cout << "Error loading texture '" << FileName << "': " << Error.what() << std::endl;
         return false;
     }
 
-    glGenTextures(1, &m_textureObj);
-    glBindTexture(m_textureTarget, m_textureObj);
-    glTexImage2D(m_textureTarget, 0, GL_RGB, m_pImage->columns(), m_pImage->rows(), -0.5, GL_RGBA, GL_UNSIGNED_BYTE, m_blob.data());
+    return true;
+}
+
+void Texture::CreatePlaceholder()
+{
+    const unsigned char Grey[4] = { 128, 128, 128, 255 };
+
+    if (m_textureObj == 0) {
+        glGenTextures(1, &m_textureObj);
+    }
+
+    RenderState::BindTexture(GL_TEXTURE0, m_textureTarget, m_textureObj);
+    glTexImage2D(m_textureTarget, 0, GL_RGB, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, Grey);
     glTexParameterf(m_textureTarget, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameterf(m_textureTarget, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+void Texture::Upload(unsigned int Width, unsigned int Height, const void* pPixels)
+{
+    if (m_textureObj == 0) {
+        glGenTextures(1, &m_textureObj);
+    }
+
+    RenderState::BindTexture(GL_TEXTURE0, m_textureTarget, m_textureObj);
+    glTexImage2D(m_textureTarget, 0, GL_RGB, Width, Height, -0.5, GL_RGBA, GL_UNSIGNED_BYTE, pPixels);
+    glGenerateMipmap(m_textureTarget);
+    glTexParameterf(m_textureTarget, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 	glTexParameterf(m_textureTarget, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    return true;
+    // The mip chain adds a third
+    m_sizeInBytes = Width * Height * 4 * 4 / 3;
+    m_loaded = true;
+}
+
+void Texture::Upload(const TextureFile& File)
+{
+    if (m_textureObj == 0) {
+        glGenTextures(1, &m_textureObj);
+    }
+
+    RenderState::BindTexture(GL_TEXTURE0, m_textureTarget, m_textureObj);
+
+    for (unsigned int i = 0 ; i < File.GetNumMips() ; i++) {
+        const TextureFileMip& Mip = File.GetMip(i);
+
+        if (TextureFile::IsCompressedFormat(File.GetFormat())) {
+            glCompressedTexImage2D(m_textureTarget, i, File.GetFormat(), Mip.Width, Mip.Height, 0, Mip.Size, File.GetMipData(i));
+        }
+        else {
+            glTexImage2D(m_textureTarget, i, GL_RGBA8, Mip.Width, Mip.Height, 0, GL_RGBA, GL_UNSIGNED_BYTE, File.GetMipData(i));
+        }
+    }
+
+    glTexParameteri(m_textureTarget, GL_TEXTURE_MAX_LEVEL, File.GetNumMips() - 1);
+    glTexParameteri(m_textureTarget, GL_TEXTURE_MIN_FILTER, File.GetNumMips() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(m_textureTarget, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    m_sizeInBytes = File.GetDataSize();
+    m_loaded = true;
+}
+
+void Texture::Unload()
+{
+    if (m_textureObj != 0) {
+        RenderState::DeleteTextures(1, &m_textureObj);
+        m_textureObj = 0;
+    }
+
+    m_loaded = false;
 }
 
 void Texture::Bind(GLenum TextureUnit)
 {
-    glActiveTexture(TextureUnit);
-    glBindTexture(m_textureTarget, m_textureObj);
+    RenderState::BindTexture(TextureUnit, m_textureTarget, m_textureObj);
+
+    if (m_pSampler) {
+        m_pSampler->Bind(TextureUnit);
+    }
+    else {
+        Sampler::Unbind(TextureUnit);
+    }
 }
@@ -6,21 +6,63 @@
 #include <GL/glew.h>
 #include <Magick++.h>
 
-class Texture
+#include "bindable_texture.h"
+#include "texture_file.h"
+#include "sampler.h"
+
+class Texture : public IBindableTexture
 {
 public:
     Texture(GLenum TextureTarget, const std::string& FileName);
 
+    ~Texture();
+
+    // Decodes and uploads the image, or maps and uploads it as is when it
+    // is a precompiled texture file. The pixels are released once they are
+    // in GL memory.
     bool Load();
 
+    // Decodes the file into tightly packed RGBA rows. Touches no GL state,
+    // so it may run on any thread.
+    static bool Decode(const std::string& FileName, Magick::Blob& Blob, unsigned int& Width, unsigned int& Height);
+
+    // Creates the texture object with a single grey texel, so the texture
+    // can be bound while the image is still being loaded
+    void CreatePlaceholder();
+
+    // pPixels is an offset into the bound GL_PIXEL_UNPACK_BUFFER, if any.
+    // The mip chain is generated on the GPU.
+    void Upload(unsigned int Width, unsigned int Height, const void* pPixels);
+
+    // Uploads every level of a precompiled texture
+    void Upload(const TextureFile& File);
+
+    // Releases the GL texture object; Load() or Upload() bring it back
+    void Unload();
+
+    bool IsLoaded() const { return m_loaded; }
+
+    // GL memory taken by the loaded image and its mips, assuming four
+    // bytes per texel for decoded images
+    unsigned int GetSizeInBytes() const { return m_loaded ? m_sizeInBytes : 0; }
+
+    const std::string& GetFileName() const { return m_fileName; }
+
+    // Without a sampler the texture is read with its own parameters,
+    // trilinear filtering. The sampler is not owned by the texture.
+    void SetSampler(const Sampler* pSampler) { m_pSampler = pSampler; }
+
     void Bind(GLenum TextureUnit);
 
+    GLuint GetTextureObj() const { return m_textureObj; }
+
 private:
     std::string m_fileName;
     GLenum m_textureTarget;
     GLuint m_textureObj;
-    Magick::Image* m_pImage;
-    Magick::Blob m_blob;
+    bool m_loaded;
+    unsigned int m_sizeInBytes;
+    const Sampler* m_pSampler;
 };
 
 
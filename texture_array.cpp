@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+
+#include "texture_array.h"
+#include "render_state.h"
+#include "texture.h"
+
+struct PackedImage
+{
+    std::string FileName;
+    Magick::Blob Blob;
+    unsigned int Width;
+    unsigned int Height;
+    bool Ok;
+    unsigned int x;
+    unsigned int y;
+    unsigned int Layer;
+};
+
+// Texels of edge replication around every image. Bilinear taps at the edge
+// of a region and the first mip levels then only see copies of the edge
+// instead of neighbouring images.
+#define TEXTURE_ARRAY_GUTTER 4
+
+static bool CompareHeight(const PackedImage* a, const PackedImage* b)
+{
+    return a->Height > b->Height;
+}
+
+// Copies the image into Padded with TEXTURE_ARRAY_GUTTER texels on every
+// side, filled by repeating the nearest edge texel
+static void PadImage(const PackedImage& Image, std::vector<unsigned char>& Padded)
+{
+    const unsigned int PaddedWidth = Image.Width + 2 * TEXTURE_ARRAY_GUTTER;
+    const unsigned int PaddedHeight = Image.Height + 2 * TEXTURE_ARRAY_GUTTER;
+    const unsigned char* pSrc = (const unsigned char*)Image.Blob.data();
+
+    Padded.resize(PaddedWidth * PaddedHeight * 4);
+
+    for (unsigned int y = 0 ; y < PaddedHeight ; y++) {
+        const int SrcY = std::min(std::max((int)y - TEXTURE_ARRAY_GUTTER, 0), (int)Image.Height - 1);
+
+        for (unsigned int x = 0 ; x < PaddedWidth ; x++) {
+            const int SrcX = std::min(std::max((int)x - TEXTURE_ARRAY_GUTTER, 0), (int)Image.Width - 1);
+            memcpy(&Padded[(y * PaddedWidth + x) * 4], &pSrc[(SrcY * Image.Width + SrcX) * 4], 4);
+        }
+    }
+}
+
+TextureArray::TextureArray()
+{
+    m_textureObj = 0;
+    m_numLayers = 0;
+    m_pSampler = NULL;
+}
+
+TextureArray::~TextureArray()
+{
+    if (m_textureObj != 0) {
+        RenderState::DeleteTextures(1, &m_textureObj);
+    }
+}
+
+bool TextureArray::Load(const std::vector<std::string>& FileNames, unsigned int MaxLayerSize)
+{
+    std::vector<PackedImage> Images(FileNames.size());
+
+    // Decode on all cores, each thread takes every n-th file
+    unsigned int NumThreads = std::thread::hardware_concurrency();
+    NumThreads = std::max(1u, std::min(NumThreads, (unsigned int)Images.size()));
+
+    std::vector<std::thread> Threads;
+
+    for (unsigned int t = 0 ; t < NumThreads ; t++) {
+        Threads.push_back(std::thread([&Images, &FileNames, t, NumThreads]() {
+            for (unsigned int i = t ; i < Images.size() ; i += NumThreads) {
+                Images[i].FileName = FileNames[i];
+                Images[i].Width = 0;
+                Images[i].Height = 0;
+                Images[i].Ok = Texture::Decode(FileNames[i], Images[i].Blob, Images[i].Width, Images[i].Height);
+            }
+        }));
+    }
+
+    for (unsigned int t = 0 ; t < Threads.size() ; t++) {
+        Threads[t].join();
+    }
+
+    unsigned int LayerWidth = 0;
+    unsigned int LayerHeight = 0;
+    std::vector<PackedImage*> Accepted;
+
+    for (unsigned int i = 0 ; i < Images.size() ; i++) {
+        if (!Images[i].Ok) {
+            continue;
+        }
+
+        if (Images[i].Width > MaxLayerSize || Images[i].Height > MaxLayerSize) {
+            fprintf(stderr, "'%s' is %dx%d, too large for a texture array layer\n",
+                    Images[i].FileName.c_str(), Images[i].Width, Images[i].Height);
+            continue;
+        }
+
+        LayerWidth = std::max(LayerWidth, Images[i].Width + 2 * TEXTURE_ARRAY_GUTTER);
+        LayerHeight = std::max(LayerHeight, Images[i].Height + 2 * TEXTURE_ARRAY_GUTTER);
+        Accepted.push_back(&Images[i]);
+    }
+
+    if (Accepted.empty()) {
+        fprintf(stderr, "No images to put in the texture array\n");
+        return false;
+    }
+
+    // Images are placed with their gutter. Full size ones get their own
+    // layers, the rest are packed in rows of decreasing height.
+    std::stable_sort(Accepted.begin(), Accepted.end(), CompareHeight);
+
+    unsigned int NumLayers = 0;
+    unsigned int RowX = 0;
+    unsigned int RowY = 0;
+    unsigned int RowHeight = 0;
+    int SharedLayer = -1;
+
+    for (unsigned int i = 0 ; i < Accepted.size() ; i++) {
+        PackedImage* p = Accepted[i];
+        const unsigned int Width = p->Width + 2 * TEXTURE_ARRAY_GUTTER;
+        const unsigned int Height = p->Height + 2 * TEXTURE_ARRAY_GUTTER;
+
+        if (Width == LayerWidth && Height == LayerHeight) {
+            p->x = 0;
+            p->y = 0;
+            p->Layer = NumLayers++;
+            continue;
+        }
+
+        if (SharedLayer >= 0 && RowX + Width > LayerWidth) {
+            RowX = 0;
+            RowY += RowHeight;
+            RowHeight = 0;
+        }
+
+        if (SharedLayer < 0 || RowY + Height > LayerHeight) {
+            SharedLayer = NumLayers++;
+            RowX = 0;
+            RowY = 0;
+            RowHeight = 0;
+        }
+
+        p->x = RowX;
+        p->y = RowY;
+        p->Layer = SharedLayer;
+
+        RowX += Width;
+        RowHeight = std::max(RowHeight, Height);
+    }
+
+    if (m_textureObj == 0) {
+        glGenTextures(1, &m_textureObj);
+    }
+
+    // The space no image covers is cleared, so the mips built from it are
+    // defined as well
+    const std::vector<unsigned char> Clear(LayerWidth * LayerHeight * NumLayers * 4, 0);
+
+    RenderState::BindTexture(GL_TEXTURE0, GL_TEXTURE_2D_ARRAY, m_textureObj);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, LayerWidth, LayerHeight, NumLayers, 0, GL_RGBA, GL_UNSIGNED_BYTE, &Clear[0]);
+
+    m_regions.clear();
+    m_indices.clear();
+
+    std::vector<unsigned char> Padded;
+
+    for (unsigned int i = 0 ; i < Images.size() ; i++) {
+        const PackedImage& Image = Images[i];
+
+        if (!Image.Ok || Image.Width > MaxLayerSize || Image.Height > MaxLayerSize) {
+            continue;
+        }
+
+        PadImage(Image, Padded);
+
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, Image.x, Image.y, Image.Layer,
+                        Image.Width + 2 * TEXTURE_ARRAY_GUTTER, Image.Height + 2 * TEXTURE_ARRAY_GUTTER, 1,
+                        GL_RGBA, GL_UNSIGNED_BYTE, &Padded[0]);
+
+        TextureRegion Region;
+        Region.Rect = Vector4f((float)(Image.x + TEXTURE_ARRAY_GUTTER) / LayerWidth,
+                               (float)(Image.y + TEXTURE_ARRAY_GUTTER) / LayerHeight,
+                               (float)Image.Width / LayerWidth, (float)Image.Height / LayerHeight);
+        Region.Layer = (float)Image.Layer;
+
+        m_indices[Image.FileName] = m_regions.size();
+        m_regions.push_back(Region);
+    }
+
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+    m_numLayers = NumLayers;
+
+    return true;
+}
+
+void TextureArray::Bind(GLenum TextureUnit)
+{
+    RenderState::BindTexture(TextureUnit, GL_TEXTURE_2D_ARRAY, m_textureObj);
+
+    if (m_pSampler) {
+        m_pSampler->Bind(TextureUnit);
+    }
+    else {
+        Sampler::Unbind(TextureUnit);
+    }
+}
+
+int TextureArray::GetIndex(const std::string& FileName) const
+{
+    std::unordered_map<std::string, unsigned int>::const_iterator it = m_indices.find(FileName);
+
+    return it != m_indices.end() ? (int)it->second : -1;
+}
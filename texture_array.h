@@ -0,0 +1,67 @@
+#ifndef TEXTURE_ARRAY_H
+#define	TEXTURE_ARRAY_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "bindable_texture.h"
+#include "math_3d.h"
+#include "sampler.h"
+
+// Place of one image inside a TextureArray: the layer and the rectangle it
+// covers there, as (u offset, v offset, u scale, v scale). The layout
+// matches the per-instance pattern attributes of LightingTechnique.
+struct TextureRegion
+{
+    Vector4f Rect;
+    float Layer;
+};
+
+// Packs a set of small images into a single GL_TEXTURE_2D_ARRAY, so objects
+// using different images can be drawn without rebinding textures. Every
+// image is surrounded by a few texels of its own edge, so filtering at the
+// edge of a region never reads a neighbour. Layers are as large as the
+// largest image with this border; images of exactly that size take a layer
+// each, smaller ones are packed into shared layers row by row. Images are
+// addressed through their region rectangle.
+class TextureArray : public IBindableTexture
+{
+public:
+
+    TextureArray();
+
+    ~TextureArray();
+
+    // Images larger than MaxLayerSize in either direction are skipped
+    bool Load(const std::vector<std::string>& FileNames, unsigned int MaxLayerSize);
+
+    // Without a sampler the array is read trilinearly with repeat
+    void SetSampler(const Sampler* pSampler) { m_pSampler = pSampler; }
+
+    void Bind(GLenum TextureUnit);
+
+    GLuint GetTextureObj() const { return m_textureObj; }
+
+    // -1 when the file is not in the array
+    int GetIndex(const std::string& FileName) const;
+
+    const TextureRegion& GetRegion(unsigned int Index) const { return m_regions[Index]; }
+
+    unsigned int GetNumRegions() const { return m_regions.size(); }
+
+    unsigned int GetNumLayers() const { return m_numLayers; }
+
+private:
+
+    GLuint m_textureObj;
+    unsigned int m_numLayers;
+    const Sampler* m_pSampler;
+    std::vector<TextureRegion> m_regions;
+    std::unordered_map<std::string, unsigned int> m_indices;
+};
+
+
+#endif	/* TEXTURE_ARRAY_H */
@@ -0,0 +1,164 @@
+#include <stdio.h>
+
+#include "texture_file.h"
+
+#pragma once
+
+// Not every GL header defines the S3TC formats
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT  0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+TextureFile::TextureFile()
+{
+    m_pHeader = NULL;
+    m_pMips = NULL;
+}
+
+bool TextureFile::IsTextureFile(const std::string& FileName)
+{
+    const std::string Ext = TEXTURE_FILE_EXT;
+
+    return FileName.size() > Ext.size() &&
+           FileName.compare(FileName.size() - Ext.size(), Ext.size(), Ext) == 0;
+}
+
+bool TextureFile::IsCompressedFormat(GLenum Format)
+{
+    return Format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || Format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+}
+
+uint64_t TextureFile::CalcMipSize(GLenum Format, unsigned int Width, unsigned int Height)
+{
+    if (IsCompressedFormat(Format)) {
+        const uint64_t BlockSize = (Format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) ? 8 : 16;
+        return ((Width + 3ull) / 4) * ((Height + 3ull) / 4) * BlockSize;
+    }
+
+    return (uint64_t)Width * Height * 4;
+}
+
+bool TextureFile::Open(const std::string& FileName)
+{
+    if (!m_file.Open(FileName)) {
+        return false;
+    }
+
+    const size_t Size = m_file.GetSize();
+    const unsigned char* pData = (const unsigned char*)m_file.GetData();
+
+    m_pHeader = (const TextureFileHeader*)pData;
+    m_pMips = (const TextureFileMip*)(pData + sizeof(TextureFileHeader));
+
+    if (Size < sizeof(TextureFileHeader) ||
+        m_pHeader->Magic != TEXTURE_FILE_MAGIC ||
+        m_pHeader->Version != TEXTURE_FILE_VERSION) {
+        fprintf(stderr, "'%s' is not a texture file of version %d\n", FileName.c_str(), TEXTURE_FILE_VERSION);
+        m_file.Close();
+        return false;
+    }
+
+    if (m_pHeader->Format != GL_RGBA8 && !IsCompressedFormat(m_pHeader->Format)) {
+        fprintf(stderr, "'%s' has unknown format 0x%x\n", FileName.c_str(), m_pHeader->Format);
+        m_file.Close();
+        return false;
+    }
+
+    if (m_pHeader->NumMips == 0 || m_pHeader->NumMips > 32 ||
+        Size < sizeof(TextureFileHeader) + sizeof(TextureFileMip) * m_pHeader->NumMips) {
+        fprintf(stderr, "'%s' has a broken mip table\n", FileName.c_str());
+        m_file.Close();
+        return false;
+    }
+
+    for (unsigned int i = 0 ; i < m_pHeader->NumMips ; i++) {
+        // The upload reads as many bytes as the level dimensions call for,
+        // whatever the table says
+        if (m_pMips[i].Size != CalcMipSize(m_pHeader->Format, m_pMips[i].Width, m_pMips[i].Height)) {
+            fprintf(stderr, "'%s' has a level %d of the wrong size\n", FileName.c_str(), i);
+            m_file.Close();
+            return false;
+        }
+
+        if ((size_t)m_pMips[i].Offset + m_pMips[i].Size > Size) {
+            fprintf(stderr, "'%s' is truncated\n", FileName.c_str());
+            m_file.Close();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+const void* TextureFile::GetMipData(unsigned int Level) const
+{
+    return (const unsigned char*)m_file.GetData() + m_pMips[Level].Offset;
+}
+
+unsigned int TextureFile::GetDataSize() const
+{
+    unsigned int Size = 0;
+
+    for (unsigned int i = 0 ; i < m_pHeader->NumMips ; i++) {
+        Size += m_pMips[i].Size;
+    }
+
+    return Size;
+}
+
+bool TextureFile::Write(const std::string& FileName, GLenum Format, unsigned int Width, unsigned int Height,
+                        const std::vector<std::vector<unsigned char> >& Mips)
+{
+    if (Mips.empty()) {
+        fprintf(stderr, "No levels to write to '%s'\n", FileName.c_str());
+        return false;
+    }
+
+    FILE* f = fopen(FileName.c_str(), "wb");
+
+    if (!f) {
+        fprintf(stderr, "Error creating '%s'\n", FileName.c_str());
+        return false;
+    }
+
+    TextureFileHeader Header;
+    Header.Magic = TEXTURE_FILE_MAGIC;
+    Header.Version = TEXTURE_FILE_VERSION;
+    Header.Format = Format;
+    Header.Width = Width;
+    Header.Height = Height;
+    Header.NumMips = Mips.size();
+
+    std::vector<TextureFileMip> Table(Mips.size());
+    uint32_t Offset = sizeof(TextureFileHeader) + sizeof(TextureFileMip) * Mips.size();
+
+    for (unsigned int i = 0 ; i < Mips.size() ; i++) {
+        Table[i].Width = (Width >> i) > 0 ? (Width >> i) : 1;
+        Table[i].Height = (Height >> i) > 0 ? (Height >> i) : 1;
+        Table[i].Offset = Offset;
+        Table[i].Size = Mips[i].size();
+
+        // Keep every level 16 byte aligned
+        Offset += (Table[i].Size + 15) & ~15u;
+    }
+
+    bool Ok = fwrite(&Header, sizeof(Header), 1, f) == 1 &&
+              fwrite(&Table[0], sizeof(TextureFileMip), Table.size(), f) == Table.size();
+
+    // Seeking past the end fills the alignment gaps with zeros
+    for (unsigned int i = 0 ; Ok && i < Mips.size() ; i++) {
+        Ok = fseek(f, Table[i].Offset, SEEK_SET) == 0 &&
+             fwrite(&Mips[i][0], 1, Mips[i].size(), f) == Mips[i].size();
+    }
+
+    fclose(f);
+
+    if (!Ok) {
+        fprintf(stderr, "Error writing '%s'\n", FileName.c_str());
+    }
+
+    return Ok;
+}
@@ -0,0 +1,75 @@
+#ifndef TEXTURE_FILE_H
+#define	TEXTURE_FILE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "mapped_file.h"
+
+// Precompiled texture: a header, a table of mip levels and the level data,
+// laid out exactly as glTexImage2D / glCompressedTexImage2D take it. The
+// file is memory mapped and uploaded with no decode step. Files are made
+// by tools/texture_converter.cpp.
+#define TEXTURE_FILE_MAGIC   0x58455447 // "GTEX"
+#define TEXTURE_FILE_VERSION 1
+#define TEXTURE_FILE_EXT     ".tex"
+
+struct TextureFileHeader
+{
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t Format;    // GL_RGBA8 or an S3TC compressed internal format
+    uint32_t Width;
+    uint32_t Height;
+    uint32_t NumMips;
+};
+
+struct TextureFileMip
+{
+    uint32_t Width;
+    uint32_t Height;
+    uint32_t Offset;    // From the start of the file
+    uint32_t Size;
+};
+
+class TextureFile
+{
+public:
+
+    TextureFile();
+
+    static bool IsTextureFile(const std::string& FileName);
+
+    bool Open(const std::string& FileName);
+
+    // Levels are given largest first. Uncompressed levels are RGBA rows.
+    static bool Write(const std::string& FileName, GLenum Format, unsigned int Width, unsigned int Height,
+                      const std::vector<std::vector<unsigned char> >& Mips);
+
+    static bool IsCompressedFormat(GLenum Format);
+
+    // Bytes of a level of the given dimensions
+    static uint64_t CalcMipSize(GLenum Format, unsigned int Width, unsigned int Height);
+
+    GLenum GetFormat() const { return m_pHeader->Format; }
+    unsigned int GetNumMips() const { return m_pHeader->NumMips; }
+    const TextureFileMip& GetMip(unsigned int Level) const { return m_pMips[Level]; }
+    const void* GetMipData(unsigned int Level) const;
+
+    // Bytes taken by all levels
+    unsigned int GetDataSize() const;
+
+    void Prefetch() const { m_file.Prefetch(); }
+
+private:
+
+    MappedFile m_file;
+    const TextureFileHeader* m_pHeader;
+    const TextureFileMip* m_pMips;
+};
+
+
+#endif	/* TEXTURE_FILE_H */
@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "texture_loader.h"
+#include "render_state.h"
+
+TextureLoader::TextureLoader()
+{
+    m_quit = false;
+    m_pDecoded = NULL;
+    m_pbo = 0;
+    m_uploadBudget = 0;
+    m_numPending = 0;
+}
+
+TextureLoader::~TextureLoader()
+{
+    {
+        std::lock_guard<std::mutex> Lock(m_jobMutex);
+        m_quit = true;
+    }
+
+    m_jobCondition.notify_all();
+
+    for (unsigned int i = 0 ; i < m_workers.size() ; i++) {
+        m_workers[i].join();
+    }
+
+    DecodedImage* pImage = m_pDecoded.exchange(NULL);
+
+    while (pImage) {
+        DecodedImage* pNext = pImage->pNext;
+        delete pImage->pFile;
+        delete pImage;
+        pImage = pNext;
+    }
+
+    for (unsigned int i = 0 ; i < m_uploads.size() ; i++) {
+        delete m_uploads[i]->pFile;
+        delete m_uploads[i];
+    }
+
+    if (m_pbo != 0) {
+        RenderState::DeleteBuffers(1, &m_pbo);
+    }
+}
+
+bool TextureLoader::Init(unsigned int NumThreads, unsigned int UploadBudget)
+{
+    m_uploadBudget = UploadBudget;
+
+    glGenBuffers(1, &m_pbo);
+
+    if (m_pbo == 0) {
+        fprintf(stderr, "Error creating the texture upload buffer\n");
+        return false;
+    }
+
+    // The decoder must be set up before it is used from several threads
+    Magick::InitializeMagick(NULL);
+
+    if (NumThreads == 0) {
+        NumThreads = 1;
+    }
+
+    for (unsigned int i = 0 ; i < NumThreads ; i++) {
+        m_workers.push_back(std::thread(&TextureLoader::WorkerThread, this));
+    }
+
+    return true;
+}
+
+void TextureLoader::LoadAsync(Texture* pTexture)
+{
+    pTexture->CreatePlaceholder();
+
+    {
+        std::lock_guard<std::mutex> Lock(m_jobMutex);
+        m_jobs.push_back(pTexture);
+    }
+
+    m_numPending++;
+    m_jobCondition.notify_one();
+}
+
+void TextureLoader::WorkerThread()
+{
+    for (;;) {
+        Texture* pTexture = NULL;
+
+        {
+            std::unique_lock<std::mutex> Lock(m_jobMutex);
+            m_jobCondition.wait(Lock, [this] { return m_quit || !m_jobs.empty(); });
+
+            if (m_quit) {
+                return;
+            }
+
+            pTexture = m_jobs.front();
+            m_jobs.pop_front();
+        }
+
+        DecodedImage* pImage = new DecodedImage;
+        pImage->pTexture = pTexture;
+        pImage->Width = 0;
+        pImage->Height = 0;
+        pImage->pFile = NULL;
+
+        if (TextureFile::IsTextureFile(pTexture->GetFileName())) {
+            pImage->pFile = new TextureFile();
+            pImage->Ok = pImage->pFile->Open(pTexture->GetFileName());
+
+            if (pImage->Ok) {
+                pImage->pFile->Prefetch();
+            }
+        }
+        else {
+            pImage->Ok = Texture::Decode(pTexture->GetFileName(), pImage->Blob, pImage->Width, pImage->Height);
+        }
+
+        // Push onto the list; the release pairs with the acquire in Update()
+        // so the decoded pixels are visible to the GL thread
+        pImage->pNext = m_pDecoded.load(std::memory_order_relaxed);
+
+        while (!m_pDecoded.compare_exchange_weak(pImage->pNext, pImage,
+                                                 std::memory_order_release,
+                                                 std::memory_order_relaxed)) {
+        }
+    }
+}
+
+void TextureLoader::Update()
+{
+    // The list comes out newest first, reverse it to keep request order
+    DecodedImage* pImage = m_pDecoded.exchange(NULL, std::memory_order_acquire);
+    std::deque<DecodedImage*> Decoded;
+
+    while (pImage) {
+        Decoded.push_front(pImage);
+        pImage = pImage->pNext;
+    }
+
+    m_uploads.insert(m_uploads.end(), Decoded.begin(), Decoded.end());
+
+    unsigned int Uploaded = 0;
+
+    while (!m_uploads.empty() && (Uploaded == 0 || Uploaded + GetUploadSize(*m_uploads.front()) <= m_uploadBudget)) {
+        DecodedImage* pFront = m_uploads.front();
+        m_uploads.pop_front();
+
+        if (pFront->Ok) {
+            Upload(*pFront);
+            Uploaded += GetUploadSize(*pFront);
+        }
+
+        m_numPending--;
+        delete pFront->pFile;
+        delete pFront;
+    }
+}
+
+unsigned int TextureLoader::GetUploadSize(const DecodedImage& Image)
+{
+    if (!Image.Ok) {
+        return 0;
+    }
+
+    return Image.pFile ? Image.pFile->GetDataSize() : Image.Blob.length();
+}
+
+void TextureLoader::Upload(const DecodedImage& Image)
+{
+    // Precompiled levels are already in their final layout, the mapped
+    // file is handed to GL directly
+    if (Image.pFile) {
+        Image.pTexture->Upload(*Image.pFile);
+        return;
+    }
+
+    const GLsizeiptr Size = Image.Blob.length();
+
+    // Orphan the previous contents, so the copy does not wait for the
+    // driver to finish reading the last upload
+    RenderState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, Size, NULL, GL_STREAM_DRAW);
+
+    void* p = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, Size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+    if (p) {
+        memcpy(p, Image.Blob.data(), Size);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        Image.pTexture->Upload(Image.Width, Image.Height, 0);
+    }
+    else {
+        RenderState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        Image.pTexture->Upload(Image.Width, Image.Height, Image.Blob.data());
+    }
+
+    RenderState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
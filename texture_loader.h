@@ -0,0 +1,78 @@
+#ifndef TEXTURE_LOADER_H
+#define	TEXTURE_LOADER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+#include <Magick++.h>
+
+#include "texture.h"
+#include "texture_file.h"
+
+// Loads textures without stalling the render thread. Images are decoded by
+// a pool of worker threads (precompiled texture files are only mapped) and handed back to the GL thread through a
+// lock-free list; Update() then uploads them through a pixel buffer object,
+// no more than a given number of bytes per frame. Until its image is
+// uploaded a texture holds a placeholder texel, so it can be bound at once.
+//
+// Requested textures must stay alive until they are loaded or the loader
+// is destroyed.
+class TextureLoader
+{
+public:
+
+    TextureLoader();
+
+    ~TextureLoader();
+
+    bool Init(unsigned int NumThreads, unsigned int UploadBudget);
+
+    void LoadAsync(Texture* pTexture);
+
+    // Called once per frame on the GL thread. At least one texture is
+    // uploaded per call, so images larger than the budget still get through.
+    void Update();
+
+    unsigned int GetNumPending() const { return m_numPending; }
+
+private:
+
+    struct DecodedImage
+    {
+        Texture* pTexture;
+        Magick::Blob Blob;
+        TextureFile* pFile;
+        unsigned int Width;
+        unsigned int Height;
+        bool Ok;
+        DecodedImage* pNext;
+    };
+
+    void WorkerThread();
+    void Upload(const DecodedImage& Image);
+    static unsigned int GetUploadSize(const DecodedImage& Image);
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_jobMutex;
+    std::condition_variable m_jobCondition;
+    std::deque<Texture*> m_jobs;
+    bool m_quit;
+
+    // Decoded images, pushed by the workers and taken all at once by Update()
+    std::atomic<DecodedImage*> m_pDecoded;
+
+    // Images waiting for upload, oldest first
+    std::deque<DecodedImage*> m_uploads;
+
+    GLuint m_pbo;
+    unsigned int m_uploadBudget;
+    unsigned int m_numPending;
+};
+
+
+#endif	/* TEXTURE_LOADER_H */
@@ -0,0 +1,182 @@
+#include "texture_manager.h"
+
+TextureHandle::TextureHandle()
+{
+    m_pManager = NULL;
+    m_pEntry = NULL;
+}
+
+TextureHandle::TextureHandle(TextureManager* pManager, TextureManager::Entry* pEntry)
+{
+    m_pManager = pManager;
+    m_pEntry = pEntry;
+    m_pEntry->RefCount++;
+}
+
+TextureHandle::TextureHandle(const TextureHandle& Other)
+{
+    m_pManager = Other.m_pManager;
+    m_pEntry = Other.m_pEntry;
+
+    if (m_pEntry) {
+        m_pEntry->RefCount++;
+    }
+}
+
+TextureHandle::~TextureHandle()
+{
+    Reset();
+}
+
+TextureHandle& TextureHandle::operator=(const TextureHandle& Other)
+{
+    // Take the new reference first, in case both refer to the same entry
+    if (Other.m_pEntry) {
+        Other.m_pEntry->RefCount++;
+    }
+
+    Reset();
+
+    m_pManager = Other.m_pManager;
+    m_pEntry = Other.m_pEntry;
+
+    return *this;
+}
+
+void TextureHandle::Reset()
+{
+    if (m_pEntry) {
+        m_pManager->Release(m_pEntry);
+    }
+
+    m_pManager = NULL;
+    m_pEntry = NULL;
+}
+
+void TextureHandle::Bind(GLenum TextureUnit)
+{
+    m_pManager->Touch(m_pEntry);
+    m_pEntry->pTexture->Bind(TextureUnit);
+}
+
+GLuint TextureHandle::GetTextureObj() const
+{
+    return m_pEntry ? m_pEntry->pTexture->GetTextureObj() : 0;
+}
+
+void TextureHandle::SetSampler(const Sampler* pSampler)
+{
+    m_pEntry->pTexture->SetSampler(pSampler);
+}
+
+
+TextureManager::TextureManager(TextureLoader* pLoader, unsigned int MemoryBudget)
+{
+    m_pLoader = pLoader;
+    m_memoryBudget = MemoryBudget;
+    m_frame = 0;
+}
+
+TextureManager::~TextureManager()
+{
+    for (std::unordered_map<std::string, Entry*>::iterator it = m_entries.begin() ; it != m_entries.end() ; it++) {
+        delete it->second->pTexture;
+        delete it->second;
+    }
+}
+
+TextureHandle TextureManager::Get(const std::string& FileName)
+{
+    std::unordered_map<std::string, Entry*>::iterator it = m_entries.find(FileName);
+
+    if (it != m_entries.end()) {
+        return TextureHandle(this, it->second);
+    }
+
+    Entry* pEntry = new Entry;
+    pEntry->FileName = FileName;
+    pEntry->pTexture = new Texture(GL_TEXTURE_2D, FileName);
+    pEntry->RefCount = 0;
+    pEntry->LastUsedFrame = m_frame;
+    pEntry->Resident = true;
+    pEntry->LRUPos = m_lru.insert(m_lru.begin(), pEntry);
+
+    m_entries[FileName] = pEntry;
+    m_pLoader->LoadAsync(pEntry->pTexture);
+
+    return TextureHandle(this, pEntry);
+}
+
+void TextureManager::BeginFrame()
+{
+    // Textures bound in the frame that just ended are kept
+    Evict();
+    m_frame++;
+}
+
+unsigned int TextureManager::GetResidentBytes() const
+{
+    unsigned int Bytes = 0;
+
+    for (std::list<Entry*>::const_iterator it = m_lru.begin() ; it != m_lru.end() ; it++) {
+        Bytes += (*it)->pTexture->GetSizeInBytes();
+    }
+
+    return Bytes;
+}
+
+void TextureManager::Release(Entry* pEntry)
+{
+    // Unused textures are kept until the budget runs out, so a file that is
+    // requested again soon costs nothing
+    pEntry->RefCount--;
+}
+
+void TextureManager::Touch(Entry* pEntry)
+{
+    pEntry->LastUsedFrame = m_frame;
+
+    if (pEntry->LRUPos != m_lru.begin()) {
+        m_lru.splice(m_lru.begin(), m_lru, pEntry->LRUPos);
+    }
+
+    if (!pEntry->Resident) {
+        pEntry->Resident = true;
+        m_pLoader->LoadAsync(pEntry->pTexture);
+    }
+}
+
+void TextureManager::Evict()
+{
+    unsigned int Bytes = GetResidentBytes();
+
+    std::list<Entry*>::iterator it = m_lru.end();
+
+    while (Bytes > m_memoryBudget && it != m_lru.begin()) {
+        Entry* pEntry = *--it;
+
+        // Textures still being loaded cannot be dropped, and the ones used
+        // in the last frame would only be loaded again
+        if (pEntry->LastUsedFrame == m_frame || !pEntry->Resident || !pEntry->pTexture->IsLoaded()) {
+            continue;
+        }
+
+        Bytes -= pEntry->pTexture->GetSizeInBytes();
+
+        if (pEntry->RefCount == 0) {
+            it = m_lru.erase(it);
+            Remove(pEntry);
+        }
+        else {
+            pEntry->pTexture->Unload();
+            pEntry->Resident = false;
+        }
+    }
+}
+
+void TextureManager::Remove(Entry* pEntry)
+{
+    m_entries.erase(pEntry->FileName);
+    delete pEntry->pTexture;
+    delete pEntry;
+}
@@ -0,0 +1,109 @@
+#ifndef TEXTURE_MANAGER_H
+#define	TEXTURE_MANAGER_H
+
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#include <GL/glew.h>
+
+#include "texture.h"
+#include "texture_loader.h"
+
+class TextureHandle;
+
+// Loads every file once and shares the GL texture between all handles to
+// it. Textures no longer referenced stay cached until evicted. When the
+// textures in GL memory exceed the budget, the least recently bound ones
+// that were not used in the last frame are released, whether still
+// referenced or not.
+class TextureManager
+{
+public:
+
+    TextureManager(TextureLoader* pLoader, unsigned int MemoryBudget);
+
+    ~TextureManager();
+
+    TextureHandle Get(const std::string& FileName);
+
+    // Called once per frame, after TextureLoader::Update(). The loader
+    // must be destroyed before the manager.
+    void BeginFrame();
+
+    void SetMemoryBudget(unsigned int MemoryBudget) { m_memoryBudget = MemoryBudget; }
+
+    unsigned int GetResidentBytes() const;
+
+    unsigned int GetNumTextures() const { return m_entries.size(); }
+
+private:
+
+    friend class TextureHandle;
+
+    struct Entry
+    {
+        std::string FileName;
+        Texture* pTexture;
+        unsigned int RefCount;
+        unsigned int LastUsedFrame;
+        bool Resident;
+        std::list<Entry*>::iterator LRUPos;
+    };
+
+    void Release(Entry* pEntry);
+    void Touch(Entry* pEntry);
+    void Evict();
+    void Remove(Entry* pEntry);
+
+    TextureLoader* m_pLoader;
+    unsigned int m_memoryBudget;
+    unsigned int m_frame;
+
+    std::unordered_map<std::string, Entry*> m_entries;
+
+    // Most recently bound first
+    std::list<Entry*> m_lru;
+};
+
+// Reference to a texture owned by a TextureManager. Copies share the
+// texture; the manager may drop it once no handle refers to it. Handles
+// are used on the GL thread only and must not outlive their manager.
+class TextureHandle : public IBindableTexture
+{
+public:
+
+    TextureHandle();
+
+    TextureHandle(const TextureHandle& Other);
+
+    ~TextureHandle();
+
+    TextureHandle& operator=(const TextureHandle& Other);
+
+    void Reset();
+
+    bool IsValid() const { return m_pEntry != NULL; }
+
+    // Binds the texture and marks it as used in the current frame. An
+    // evicted texture is bound as a placeholder and loaded again.
+    void Bind(GLenum TextureUnit);
+
+    // 0 while the texture is evicted
+    GLuint GetTextureObj() const;
+
+    // Shared by every handle to the texture, see Texture::SetSampler()
+    void SetSampler(const Sampler* pSampler);
+
+private:
+
+    friend class TextureManager;
+
+    TextureHandle(TextureManager* pManager, TextureManager::Entry* pEntry);
+
+    TextureManager* m_pManager;
+    TextureManager::Entry* m_pEntry;
+};
+
+
+#endif	/* TEXTURE_MANAGER_H */
@@ -0,0 +1,355 @@
+/*
+    Offline mesh baker.
+
+    Parses a Wavefront OBJ file (v, vt, vn and polygonal f; o, g and usemtl
+    start a new submesh), welds the corners that share position, texture
+    coordinate and normal into one vertex, triangulates the polygons as fans
+    and writes the result as a baked mesh file (see mesh_file.h) that the
+    renderer maps and uploads as it is. Smooth normals are generated for the
+    corners the file gives none; authored normals are kept.
+
+    The triangles of every submesh are reordered for the post-transform
+    vertex cache, and with -overdraw also front to back by cluster, and the
+    vertices are then renumbered in order of first use (see
+    mesh_optimizer.h). The ACMR before and after is printed. With -packed the
+    vertices are stored in the 16 byte VERTEX_FORMAT_PACKED layout (see
+    vertex_format.h).
+
+    Usage: mesh_baker [-overdraw] [-packed] <input.obj> <output.mesh>
+
+    Build as a console program with the same include paths as the main
+    project; it needs the GL headers, but no GL context.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "../mesh_file.h"
+#include "../mesh_optimizer.h"
+#include "../normal_generator.h"
+#include "../vertex_format.h"
+#include "../math_3d.cpp"
+#include "../mapped_file.cpp"
+#include "../vertex_format.cpp"
+#include "../mesh_file.cpp"
+#include "../mesh_optimizer.cpp"
+#include "../normal_generator.cpp"
+
+struct ObjMesh
+{
+    std::vector<Vector3f> Positions;
+    std::vector<Vector2f> TexCoords;
+    std::vector<Vector3f> Normals;
+
+    std::vector<Vertex> Vertices;
+    std::vector<unsigned int> Indices;
+    std::vector<MeshFileSubmesh> Submeshes;
+
+    bool HasNormals;
+
+    // Vertices made from a corner without vn
+    std::vector<bool> MissingNormals;
+
+    // Vertex of every (v, vt, vn) triple seen so far
+    std::unordered_map<unsigned long long, unsigned int> Welded;
+};
+
+// Returns the next whitespace separated token of a line, terminated in
+// place, and moves p past it. NULL at the end of the line.
+static char* NextToken(char*& p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+        p++;
+    }
+
+    if (*p == '\0') {
+        return NULL;
+    }
+
+    char* pToken = p;
+
+    while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') {
+        p++;
+    }
+
+    if (*p != '\0') {
+        *p++ = '\0';
+    }
+
+    return pToken;
+}
+
+// Turns an OBJ index (1 based, negative counts back from the last element)
+// into a 0 based one. Returns -1 for a missing or bad reference.
+static int ResolveIndex(const char* p, unsigned int Count)
+{
+    if (*p == '\0') {
+        return -1;
+    }
+
+    const int i = atoi(p);
+
+    if (i > 0 && i <= (int)Count) {
+        return i - 1;
+    }
+
+    if (i < 0 && -i <= (int)Count) {
+        return Count + i;
+    }
+
+    return -1;
+}
+
+// Welding keys hold 21 bits per reference, the missing ones as all ones
+#define MAX_ELEMENTS 0x1FFFFF
+
+// Parses one "v", "v/vt", "v//vn" or "v/vt/vn" corner and returns its vertex
+static bool AddCorner(ObjMesh& Obj, char* pCorner, unsigned int& Index)
+{
+    char* pTex = strchr(pCorner, '/');
+    char* pNormal = NULL;
+
+    if (pTex) {
+        *pTex++ = '\0';
+        pNormal = strchr(pTex, '/');
+
+        if (pNormal) {
+            *pNormal++ = '\0';
+        }
+    }
+
+    const int v = ResolveIndex(pCorner, Obj.Positions.size());
+    const int vt = pTex ? ResolveIndex(pTex, Obj.TexCoords.size()) : -1;
+    const int vn = pNormal ? ResolveIndex(pNormal, Obj.Normals.size()) : -1;
+
+    if (v < 0) {
+        return false;
+    }
+
+    const unsigned long long Key = ((unsigned long long)(v & 0x1FFFFF) << 42) |
+                                   ((unsigned long long)(vt & 0x1FFFFF) << 21) |
+                                   (unsigned long long)(vn & 0x1FFFFF);
+
+    std::unordered_map<unsigned long long, unsigned int>::const_iterator it = Obj.Welded.find(Key);
+
+    if (it != Obj.Welded.end()) {
+        Index = it->second;
+        return true;
+    }
+
+    Vertex Vert(Obj.Positions[v], vt >= 0 ? Obj.TexCoords[vt] : Vector2f(0.0f, 0.0f));
+
+    if (vn >= 0) {
+        Vert.m_normal = Obj.Normals[vn];
+    }
+    else {
+        Obj.HasNormals = false;
+    }
+
+    Index = Obj.Vertices.size();
+    Obj.Vertices.push_back(Vert);
+    Obj.MissingNormals.push_back(vn < 0);
+    Obj.Welded[Key] = Index;
+
+    return true;
+}
+
+// Closes the current submesh, if it has any triangles
+static void EndSubmesh(ObjMesh& Obj)
+{
+    const unsigned int First = Obj.Submeshes.empty() ? 0 :
+                               Obj.Submeshes.back().FirstIndex + Obj.Submeshes.back().NumIndices;
+
+    if (Obj.Indices.size() > First) {
+        MeshFileSubmesh s;
+        s.FirstIndex = First;
+        s.NumIndices = Obj.Indices.size() - First;
+        Obj.Submeshes.push_back(s);
+    }
+}
+
+static bool LoadObj(const char* pFileName, ObjMesh& Obj)
+{
+    FILE* f = fopen(pFileName, "r");
+
+    if (!f) {
+        fprintf(stderr, "Error opening '%s'\n", pFileName);
+        return false;
+    }
+
+    Obj.HasNormals = true;
+
+    char Line[4096];
+    unsigned int LineNum = 0;
+    bool Ok = true;
+
+    while (Ok && fgets(Line, sizeof(Line), f)) {
+        LineNum++;
+
+        char* p = Line;
+        const char* pCmd = NextToken(p);
+
+        if (!pCmd || pCmd[0] == '#') {
+            continue;
+        }
+
+        if (strcmp(pCmd, "v") == 0 || strcmp(pCmd, "vn") == 0) {
+            Vector3f v(0.0f, 0.0f, 0.0f);
+            const char* pValue;
+
+            if ((pValue = NextToken(p))) v.x = (float)atof(pValue);
+            if ((pValue = NextToken(p))) v.y = (float)atof(pValue);
+            if ((pValue = NextToken(p))) v.z = (float)atof(pValue);
+
+            if (Obj.Positions.size() >= MAX_ELEMENTS || Obj.Normals.size() >= MAX_ELEMENTS) {
+                fprintf(stderr, "%s:%d: too many elements\n", pFileName, LineNum);
+                Ok = false;
+                break;
+            }
+
+            if (pCmd[1] == 'n') {
+                Obj.Normals.push_back(v);
+            }
+            else {
+                Obj.Positions.push_back(v);
+            }
+        }
+        else if (strcmp(pCmd, "vt") == 0) {
+            if (Obj.TexCoords.size() >= MAX_ELEMENTS) {
+                fprintf(stderr, "%s:%d: too many elements\n", pFileName, LineNum);
+                Ok = false;
+                break;
+            }
+
+            Vector2f t(0.0f, 0.0f);
+            const char* pValue;
+
+            if ((pValue = NextToken(p))) t.x = (float)atof(pValue);
+            if ((pValue = NextToken(p))) t.y = (float)atof(pValue);
+
+            Obj.TexCoords.push_back(t);
+        }
+        else if (strcmp(pCmd, "f") == 0) {
+            std::vector<unsigned int> Polygon;
+            char* pCorner;
+
+            while (Ok && (pCorner = NextToken(p))) {
+                unsigned int Index;
+                Ok = AddCorner(Obj, pCorner, Index);
+                Polygon.push_back(Index);
+            }
+
+            if (!Ok || Polygon.size() < 3) {
+                fprintf(stderr, "%s:%d: bad face\n", pFileName, LineNum);
+                Ok = false;
+                break;
+            }
+
+            for (unsigned int i = 2 ; i < Polygon.size() ; i++) {
+                Obj.Indices.push_back(Polygon[0]);
+                Obj.Indices.push_back(Polygon[i - 1]);
+                Obj.Indices.push_back(Polygon[i]);
+            }
+        }
+        else if (strcmp(pCmd, "o") == 0 || strcmp(pCmd, "g") == 0 || strcmp(pCmd, "usemtl") == 0) {
+            EndSubmesh(Obj);
+        }
+    }
+
+    fclose(f);
+
+    if (!Ok) {
+        return false;
+    }
+
+    EndSubmesh(Obj);
+
+    if (Obj.Indices.empty()) {
+        fprintf(stderr, "'%s' has no faces\n", pFileName);
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    bool Overdraw = false;
+    VertexFormat Format = VERTEX_FORMAT_FLOAT;
+    int Arg = 1;
+
+    for (; Arg < argc && argv[Arg][0] == '-' ; Arg++) {
+        if (strcmp(argv[Arg], "-overdraw") == 0) {
+            Overdraw = true;
+        }
+        else if (strcmp(argv[Arg], "-packed") == 0) {
+            Format = VERTEX_FORMAT_PACKED;
+        }
+        else {
+            break;
+        }
+    }
+
+    if (argc - Arg != 2) {
+        fprintf(stderr, "Usage: %s [-overdraw] [-packed] <input.obj> <output%s>\n", argv[0], MESH_FILE_EXT);
+        return 1;
+    }
+
+    ObjMesh Obj;
+
+    if (!LoadObj(argv[Arg], Obj)) {
+        return 1;
+    }
+
+    // The generator overwrites every normal, so it works on a copy and only
+    // the missing ones are taken from it
+    if (!Obj.HasNormals) {
+        std::vector<Vertex> Generated = Obj.Vertices;
+
+        NormalGenerator Generator;
+        Generator.Run(&Obj.Indices[0], Obj.Indices.size(), &Generated[0], Generated.size(),
+                      std::thread::hardware_concurrency());
+
+        for (unsigned int i = 0 ; i < Obj.Vertices.size() ; i++) {
+            if (Obj.MissingNormals[i]) {
+                Obj.Vertices[i].m_normal = Generated[i].m_normal;
+            }
+        }
+    }
+
+    MeshOptimizer Optimizer;
+    const float OldACMR = Optimizer.CalcACMR(&Obj.Indices[0], Obj.Indices.size(), Obj.Vertices.size());
+
+    // Submeshes are drawn on their own, so each is ordered on its own
+    for (unsigned int i = 0 ; i < Obj.Submeshes.size() ; i++) {
+        unsigned int* pIndices = &Obj.Indices[Obj.Submeshes[i].FirstIndex];
+        const unsigned int NumIndices = Obj.Submeshes[i].NumIndices;
+
+        Optimizer.OptimizeVertexCache(pIndices, NumIndices, Obj.Vertices.size());
+
+        if (Overdraw) {
+            Optimizer.OptimizeOverdraw(pIndices, NumIndices, &Obj.Vertices[0], Obj.Vertices.size());
+        }
+    }
+
+    Obj.Vertices.resize(Optimizer.OptimizeVertexFetch(&Obj.Vertices[0], Obj.Vertices.size(),
+                                                      &Obj.Indices[0], Obj.Indices.size()));
+
+    const float NewACMR = Optimizer.CalcACMR(&Obj.Indices[0], Obj.Indices.size(), Obj.Vertices.size());
+
+    if (!MeshFile::Write(argv[Arg + 1], Obj.Vertices, Obj.Indices, Obj.Submeshes, Format)) {
+        return 1;
+    }
+
+    printf("%s: %d vertices, %d triangles, %d submeshes, ACMR %.3f -> %.3f\n", argv[Arg + 1],
+           (int)Obj.Vertices.size(), (int)Obj.Indices.size() / 3, (int)Obj.Submeshes.size(), OldACMR, NewACMR);
+
+    return 0;
+}
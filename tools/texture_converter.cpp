@@ -0,0 +1,280 @@
+/*
+    Offline texture converter.
+
+    Decodes an image with Magick++, builds the full mip chain with a box
+    filter and writes it as a precompiled texture file (see texture_file.h),
+    optionally compressed to BC1 (DXT1, no alpha) or BC3 (DXT5).
+
+    Usage: texture_converter [-bc1 | -bc3] <input image> <output.tex>
+
+    Build as a console program with the same include paths and libraries
+    as the main project; it needs Magick++ and the GL headers, but no GL
+    context.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#include <Magick++.h>
+
+#include "../texture_file.h"
+#include "../mapped_file.cpp"
+#include "../texture_file.cpp"
+
+typedef std::vector<unsigned char> Level;
+
+// Halves an RGBA level, averaging 2x2 texels. An odd last row or column is
+// folded into its neighbour.
+static Level Downsample(const Level& Src, unsigned int Width, unsigned int Height)
+{
+    const unsigned int DstWidth = Width > 1 ? Width / 2 : 1;
+    const unsigned int DstHeight = Height > 1 ? Height / 2 : 1;
+
+    Level Dst(DstWidth * DstHeight * 4);
+
+    for (unsigned int y = 0 ; y < DstHeight ; y++) {
+        const unsigned int y0 = (y * 2 < Height) ? y * 2 : Height - 1;
+        const unsigned int y1 = (y * 2 + 1 < Height) ? y * 2 + 1 : Height - 1;
+
+        for (unsigned int x = 0 ; x < DstWidth ; x++) {
+            const unsigned int x0 = (x * 2 < Width) ? x * 2 : Width - 1;
+            const unsigned int x1 = (x * 2 + 1 < Width) ? x * 2 + 1 : Width - 1;
+
+            for (unsigned int c = 0 ; c < 4 ; c++) {
+                const unsigned int Sum = Src[(y0 * Width + x0) * 4 + c] + Src[(y0 * Width + x1) * 4 + c] +
+                                         Src[(y1 * Width + x0) * 4 + c] + Src[(y1 * Width + x1) * 4 + c];
+                Dst[(y * DstWidth + x) * 4 + c] = (unsigned char)((Sum + 2) / 4);
+            }
+        }
+    }
+
+    return Dst;
+}
+
+static unsigned short To565(const unsigned char* c)
+{
+    return (unsigned short)(((c[0] * 31 + 127) / 255) << 11 | ((c[1] * 63 + 127) / 255) << 5 | ((c[2] * 31 + 127) / 255));
+}
+
+static void From565(unsigned short v, int* c)
+{
+    c[0] = ((v >> 11) & 31) * 255 / 31;
+    c[1] = ((v >> 5) & 63) * 255 / 63;
+    c[2] = (v & 31) * 255 / 31;
+}
+
+// Color part of a BC1/BC3 block. The end points are the corners of the
+// bounding box of the block colors, which is fast and good enough for the
+// flat patterns we ship.
+static void CompressColorBlock(const unsigned char Block[16][4], unsigned char* pOut)
+{
+    unsigned char Min[3] = { 255, 255, 255 };
+    unsigned char Max[3] = { 0, 0, 0 };
+
+    for (unsigned int i = 0 ; i < 16 ; i++) {
+        for (unsigned int c = 0 ; c < 3 ; c++) {
+            Min[c] = Block[i][c] < Min[c] ? Block[i][c] : Min[c];
+            Max[c] = Block[i][c] > Max[c] ? Block[i][c] : Max[c];
+        }
+    }
+
+    unsigned short c0 = To565(Max);
+    unsigned short c1 = To565(Min);
+
+    // c0 > c1 selects the four color mode
+    if (c0 < c1) {
+        unsigned short t = c0;
+        c0 = c1;
+        c1 = t;
+    }
+
+    int Palette[4][3];
+    From565(c0, Palette[0]);
+    From565(c1, Palette[1]);
+
+    for (unsigned int c = 0 ; c < 3 ; c++) {
+        Palette[2][c] = (2 * Palette[0][c] + Palette[1][c]) / 3;
+        Palette[3][c] = (Palette[0][c] + 2 * Palette[1][c]) / 3;
+    }
+
+    unsigned int Indices = 0;
+
+    if (c0 != c1) {
+        for (unsigned int i = 0 ; i < 16 ; i++) {
+            unsigned int Best = 0;
+            int BestDist = 0x7FFFFFFF;
+
+            for (unsigned int p = 0 ; p < 4 ; p++) {
+                int Dist = 0;
+
+                for (unsigned int c = 0 ; c < 3 ; c++) {
+                    const int d = Block[i][c] - Palette[p][c];
+                    Dist += d * d;
+                }
+
+                if (Dist < BestDist) {
+                    BestDist = Dist;
+                    Best = p;
+                }
+            }
+
+            Indices |= Best << (i * 2);
+        }
+    }
+
+    pOut[0] = c0 & 0xFF;
+    pOut[1] = c0 >> 8;
+    pOut[2] = c1 & 0xFF;
+    pOut[3] = c1 >> 8;
+    memcpy(pOut + 4, &Indices, 4);
+}
+
+// Alpha part of a BC3 block, in the eight value mode between min and max
+static void CompressAlphaBlock(const unsigned char Block[16][4], unsigned char* pOut)
+{
+    int a0 = 0;
+    int a1 = 255;
+
+    for (unsigned int i = 0 ; i < 16 ; i++) {
+        a0 = Block[i][3] > a0 ? Block[i][3] : a0;
+        a1 = Block[i][3] < a1 ? Block[i][3] : a1;
+    }
+
+    int Palette[8] = { a0, a1 };
+
+    for (unsigned int p = 1 ; p < 7 ; p++) {
+        Palette[p + 1] = ((7 - p) * a0 + p * a1) / 7;
+    }
+
+    unsigned long long Indices = 0;
+
+    for (unsigned int i = 0 ; i < 16 && a0 != a1 ; i++) {
+        unsigned int Best = 0;
+        int BestDist = 256;
+
+        for (unsigned int p = 0 ; p < 8 ; p++) {
+            const int Dist = abs(Block[i][3] - Palette[p]);
+
+            if (Dist < BestDist) {
+                BestDist = Dist;
+                Best = p;
+            }
+        }
+
+        Indices |= (unsigned long long)Best << (i * 3);
+    }
+
+    pOut[0] = (unsigned char)a0;
+    pOut[1] = (unsigned char)a1;
+
+    for (unsigned int i = 0 ; i < 6 ; i++) {
+        pOut[2 + i] = (Indices >> (i * 8)) & 0xFF;
+    }
+}
+
+static Level Compress(const Level& Src, unsigned int Width, unsigned int Height, GLenum Format)
+{
+    const unsigned int BlocksX = (Width + 3) / 4;
+    const unsigned int BlocksY = (Height + 3) / 4;
+    const unsigned int BlockSize = (Format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) ? 8 : 16;
+
+    Level Dst(BlocksX * BlocksY * BlockSize);
+
+    for (unsigned int by = 0 ; by < BlocksY ; by++) {
+        for (unsigned int bx = 0 ; bx < BlocksX ; bx++) {
+            // Texels outside a level smaller than a block repeat the edge
+            unsigned char Block[16][4];
+
+            for (unsigned int i = 0 ; i < 16 ; i++) {
+                unsigned int x = bx * 4 + i % 4;
+                unsigned int y = by * 4 + i / 4;
+                x = x < Width ? x : Width - 1;
+                y = y < Height ? y : Height - 1;
+                memcpy(Block[i], &Src[(y * Width + x) * 4], 4);
+            }
+
+            unsigned char* pOut = &Dst[(by * BlocksX + bx) * BlockSize];
+
+            if (BlockSize == 16) {
+                CompressAlphaBlock(Block, pOut);
+                pOut += 8;
+            }
+
+            CompressColorBlock(Block, pOut);
+        }
+    }
+
+    return Dst;
+}
+
+int main(int argc, char** argv)
+{
+    GLenum Format = GL_RGBA8;
+    int Arg = 1;
+
+    if (Arg < argc && strcmp(argv[Arg], "-bc1") == 0) {
+        Format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        Arg++;
+    }
+    else if (Arg < argc && strcmp(argv[Arg], "-bc3") == 0) {
+        Format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        Arg++;
+    }
+
+    if (argc - Arg != 2) {
+        fprintf(stderr, "Usage: %s [-bc1 | -bc3] <input image> <output%s>\n", argv[0], TEXTURE_FILE_EXT);
+        return 1;
+    }
+
+    Magick::InitializeMagick(*argv);
+
+    unsigned int Width = 0;
+    unsigned int Height = 0;
+    Level Pixels;
+
+    try {
+        Magick::Image Image(argv[Arg]);
+        Magick::Blob Blob;
+        Image.write(&Blob, "RGBA");
+        Width = Image.columns();
+        Height = Image.rows();
+        Pixels.assign((const unsigned char*)Blob.data(), (const unsigned char*)Blob.data() + Blob.length());
+    }
+    catch (Magick::Error& Error) {
+        fprintf(stderr, "Error loading '%s': %s\n", argv[Arg], Error.what());
+        return 1;
+    }
+
+    if (Width == 0 || Height == 0 || Pixels.size() != Width * Height * 4) {
+        fprintf(stderr, "Error decoding '%s'\n", argv[Arg]);
+        return 1;
+    }
+
+    std::vector<Level> Mips;
+    unsigned int w = Width;
+    unsigned int h = Height;
+
+    for (;;) {
+        Mips.push_back(Format == GL_RGBA8 ? Pixels : Compress(Pixels, w, h, Format));
+
+        if (w == 1 && h == 1) {
+            break;
+        }
+
+        Pixels = Downsample(Pixels, w, h);
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+
+    if (!TextureFile::Write(argv[Arg + 1], Format, Width, Height, Mips)) {
+        return 1;
+    }
+
+    printf("%s: %dx%d, %d levels\n", argv[Arg + 1], Width, Height, (int)Mips.size());
+
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "uniform_buffer.h"
+#include "render_state.h"
+#pragma once
+
+UniformBuffer::UniformBuffer()
+{
+    m_buffer       = 0;
+    m_bindingIndex = 0;
+    m_size         = 0;
+    m_stride       = 0;
+    m_region       = 0;
+    m_pMapped      = NULL;
+
+    for (unsigned int i = 0 ; i < NUM_REGIONS ; i++) {
+        m_fences[i] = 0;
+    }
+}
+
+UniformBuffer::~UniformBuffer()
+{
+    for (unsigned int i = 0 ; i < NUM_REGIONS ; i++) {
+        if (m_fences[i]) {
+            glDeleteSync(m_fences[i]);
+        }
+    }
+
+    if (m_pMapped) {
+        RenderState::BindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+    }
+
+    if (m_buffer != 0) {
+        RenderState::DeleteBuffers(1, &m_buffer);
+    }
+}
+
+bool UniformBuffer::Init(GLuint BindingIndex, unsigned int Size)
+{
+    m_bindingIndex = BindingIndex;
+    m_size         = Size;
+
+    // Every region has to start at an offset glBindBufferRange accepts
+    GLint Alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &Alignment);
+    m_stride = (Size + Alignment - 1) / Alignment * Alignment;
+
+    glGenBuffers(1, &m_buffer);
+    RenderState::BindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+
+    if (GLEW_ARB_buffer_storage) {
+        const GLbitfield Flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_UNIFORM_BUFFER, m_stride * NUM_REGIONS, NULL, Flags);
+        m_pMapped = glMapBufferRange(GL_UNIFORM_BUFFER, 0, m_stride * NUM_REGIONS, Flags);
+    }
+
+    if (!m_pMapped) {
+        glBufferData(GL_UNIFORM_BUFFER, m_size, NULL, GL_STREAM_DRAW);
+    }
+
+    RenderState::BindBufferRange(GL_UNIFORM_BUFFER, m_bindingIndex, m_buffer, 0, m_size);
+
+    if (glGetError() != GL_NO_ERROR) {
+        fprintf(stderr, "Error creating uniform buffer for binding %d\n", BindingIndex);
+        return false;
+    }
+
+    return true;
+}
+
+void UniformBuffer::Update(const void* pData)
+{
+    if (!m_pMapped) {
+        RenderState::BindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+        glBufferData(GL_UNIFORM_BUFFER, m_size, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, m_size, pData);
+        return;
+    }
+
+    // The draws issued since the last update read the current region, so
+    // fence it before moving on to the next one
+    if (m_fences[m_region]) {
+        glDeleteSync(m_fences[m_region]);
+    }
+
+    m_fences[m_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    m_region = (m_region + 1) % NUM_REGIONS;
+
+    if (m_fences[m_region]) {
+        glClientWaitSync(m_fences[m_region], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(m_fences[m_region]);
+        m_fences[m_region] = 0;
+    }
+
+    memcpy((char*)m_pMapped + m_region * m_stride, pData, m_size);
+
+    RenderState::BindBufferRange(GL_UNIFORM_BUFFER, m_bindingIndex, m_buffer, m_region * m_stride, m_size);
+}
@@ -0,0 +1,35 @@
+#ifndef UNIFORM_BUFFER_H
+#define	UNIFORM_BUFFER_H
+
+#include <GL/glew.h>
+
+// Buffer backing one uniform block, bound to a fixed binding index so that
+// every program using the block reads the same data. Update() is meant to be
+// called once per frame (or whenever the data changes) and never stalls on
+// draws still reading the previous contents: with ARB_buffer_storage the
+// buffer is persistently mapped and used as a ring of regions guarded by
+// fences, otherwise the storage is orphaned before each write.
+class UniformBuffer
+{
+public:
+    UniformBuffer();
+
+    ~UniformBuffer();
+
+    bool Init(GLuint BindingIndex, unsigned int Size);
+
+    void Update(const void* pData);
+
+private:
+    static const unsigned int NUM_REGIONS = 3;
+
+    GLuint m_buffer;
+    GLuint m_bindingIndex;
+    unsigned int m_size;
+    unsigned int m_stride;
+    unsigned int m_region;
+    void* m_pMapped;
+    GLsync m_fences[NUM_REGIONS];
+};
+
+#endif	/* UNIFORM_BUFFER_H */
@@ -0,0 +1,173 @@
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "vertex_format.h"
+#include "mesh.h"
+
+#pragma once
+
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex must stay 16 bytes");
+
+static VertexLayout BuildLayout(VertexFormat Format)
+{
+    VertexLayout Layout;
+    Layout.NumAttributes = 3;
+
+    VertexAttribute& Pos = Layout.Attributes[0];
+    VertexAttribute& Tex = Layout.Attributes[1];
+    VertexAttribute& Normal = Layout.Attributes[2];
+
+    Pos.Location = Mesh::POSITION_LOCATION;
+    Tex.Location = Mesh::TEX_COORD_LOCATION;
+    Normal.Location = Mesh::NORMAL_LOCATION;
+
+    Pos.Size = 3;
+    Tex.Size = 2;
+
+    if (Format == VERTEX_FORMAT_PACKED) {
+        Layout.Stride = sizeof(PackedVertex);
+
+        Pos.Type = GL_UNSIGNED_SHORT;
+        Pos.Normalized = GL_TRUE;
+        Pos.Offset = offsetof(PackedVertex, m_pos);
+
+        Tex.Type = GL_HALF_FLOAT;
+        Tex.Normalized = GL_FALSE;
+        Tex.Offset = offsetof(PackedVertex, m_tex);
+
+        Normal.Size = 2;
+        Normal.Type = GL_SHORT;
+        Normal.Normalized = GL_TRUE;
+        Normal.Offset = offsetof(PackedVertex, m_normal);
+    }
+    else {
+        Layout.Stride = sizeof(Vertex);
+
+        Pos.Type = GL_FLOAT;
+        Pos.Normalized = GL_FALSE;
+        Pos.Offset = offsetof(Vertex, m_pos);
+
+        Tex.Type = GL_FLOAT;
+        Tex.Normalized = GL_FALSE;
+        Tex.Offset = offsetof(Vertex, m_tex);
+
+        Normal.Size = 3;
+        Normal.Type = GL_FLOAT;
+        Normal.Normalized = GL_FALSE;
+        Normal.Offset = offsetof(Vertex, m_normal);
+    }
+
+    return Layout;
+}
+
+const VertexLayout& GetVertexLayout(VertexFormat Format)
+{
+    static const VertexLayout Layouts[NUM_VERTEX_FORMATS] = {
+        BuildLayout(VERTEX_FORMAT_FLOAT),
+        BuildLayout(VERTEX_FORMAT_PACKED)
+    };
+
+    return Layouts[Format];
+}
+
+VertexQuantization CalcVertexQuantization(const BoundingBox& Bounds)
+{
+    VertexQuantization q;
+    q.Bias = Bounds.Min;
+    q.Scale = Bounds.Max - Bounds.Min;
+
+    return q;
+}
+
+// Round to nearest; values too large become infinity, too small zero
+static uint16_t FloatToHalf(float f)
+{
+    uint32_t Bits;
+    memcpy(&Bits, &f, sizeof(Bits));
+
+    const uint16_t Sign = (Bits >> 16) & 0x8000;
+    const uint32_t FloatExp = (Bits >> 23) & 0xFF;
+    uint32_t Mantissa = Bits & 0x7FFFFF;
+
+    if (FloatExp == 0xFF) {
+        return Sign | 0x7C00 | (Mantissa ? 0x200 : 0);
+    }
+
+    const int Exp = (int)FloatExp - 127 + 15;
+
+    if (Exp >= 31) {
+        return Sign | 0x7C00;
+    }
+
+    // Denormal halves keep the implicit bit in the mantissa
+    if (Exp <= 0) {
+        if (Exp < -10) {
+            return Sign;
+        }
+
+        Mantissa |= 0x800000;
+        const unsigned int Shift = 14 - Exp;
+
+        return Sign | (uint16_t)((Mantissa >> Shift) + ((Mantissa >> (Shift - 1)) & 1));
+    }
+
+    // A carry out of the mantissa correctly moves on to the exponent
+    return Sign | (uint16_t)(((Exp << 10) | (Mantissa >> 13)) + ((Mantissa >> 12) & 1));
+}
+
+static uint16_t QuantizeUnorm16(float v, float Bias, float Scale)
+{
+    float u = Scale > 0.0f ? (v - Bias) / Scale : 0.0f;
+    u = u < 0.0f ? 0.0f : (u > 1.0f ? 1.0f : u);
+
+    return (uint16_t)(u * 65535.0f + 0.5f);
+}
+
+static int16_t QuantizeSnorm16(float v)
+{
+    v = v < -1.0f ? -1.0f : (v > 1.0f ? 1.0f : v);
+
+    return (int16_t)floorf(v * 32767.0f + 0.5f);
+}
+
+// Projects the unit normal onto the octahedron |x| + |y| + |z| = 1 and
+// folds the lower half over the diagonals into the square [-1, 1]^2
+static void EncodeOctahedral(const Vector3f& n, int16_t* pOut)
+{
+    const float Sum = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+    float x = Sum > 0.0f ? n.x / Sum : 0.0f;
+    float y = Sum > 0.0f ? n.y / Sum : 0.0f;
+
+    if (n.z < 0.0f) {
+        const float FoldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        const float FoldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = FoldedX;
+        y = FoldedY;
+    }
+
+    pOut[0] = QuantizeSnorm16(x);
+    pOut[1] = QuantizeSnorm16(y);
+}
+
+void PackVertices(const Vertex* pVertices, unsigned int NumVertices,
+                  const VertexQuantization& Quantization, PackedVertex* pPacked)
+{
+    const Vector3f& Bias = Quantization.Bias;
+    const Vector3f& Scale = Quantization.Scale;
+
+    for (unsigned int i = 0 ; i < NumVertices ; i++) {
+        const Vertex& v = pVertices[i];
+        PackedVertex& p = pPacked[i];
+
+        p.m_pos[0] = QuantizeUnorm16(v.m_pos.x, Bias.x, Scale.x);
+        p.m_pos[1] = QuantizeUnorm16(v.m_pos.y, Bias.y, Scale.y);
+        p.m_pos[2] = QuantizeUnorm16(v.m_pos.z, Bias.z, Scale.z);
+        p.m_pos[3] = 0;
+
+        EncodeOctahedral(v.m_normal, p.m_normal);
+
+        p.m_tex[0] = FloatToHalf(v.m_tex.x);
+        p.m_tex[1] = FloatToHalf(v.m_tex.y);
+    }
+}
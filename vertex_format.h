@@ -0,0 +1,78 @@
+#ifndef VERTEX_FORMAT_H
+#define	VERTEX_FORMAT_H
+
+#include <stdint.h>
+#include <GL/glew.h>
+
+#include "math_3d.h"
+
+struct Vertex;
+
+// Vertex layouts a Mesh can store. FLOAT is the Vertex struct as it is, 32
+// bytes. PACKED is PackedVertex, 16 bytes:
+//
+//  - the position as 16 bit unsigned normalized values across the bounds
+//    of the mesh, mapped back with the mesh's VertexQuantization;
+//  - the normal octahedral encoded into two 16 bit signed normalized
+//    values, unfolded in the vertex shader;
+//  - the texture coordinates as half floats.
+//
+// Shaders read both layouts at the same attribute locations; the lighting
+// shaders decode PACKED with the PACKED_VERTICES option.
+enum VertexFormat
+{
+    VERTEX_FORMAT_FLOAT,
+    VERTEX_FORMAT_PACKED,
+    NUM_VERTEX_FORMATS
+};
+
+struct PackedVertex
+{
+    uint16_t m_pos[4];  // The last one pads to 8 bytes
+    int16_t m_normal[2];
+    uint16_t m_tex[2];
+};
+
+// One attribute as glVertexAttribFormat / glVertexAttribPointer take it
+struct VertexAttribute
+{
+    GLuint Location;
+    GLint Size;
+    GLenum Type;
+    GLboolean Normalized;
+    GLuint Offset;
+};
+
+// Everything needed to set up the vertex buffer binding of a format,
+// derived from the member offsets of its struct
+struct VertexLayout
+{
+    static const unsigned int MAX_ATTRIBUTES = 4;
+
+    GLsizei Stride;
+    unsigned int NumAttributes;
+    VertexAttribute Attributes[MAX_ATTRIBUTES];
+};
+
+const VertexLayout& GetVertexLayout(VertexFormat Format);
+
+// Position = Bias + Scale * Packed, with Packed in [0, 1]
+struct VertexQuantization
+{
+    Vector3f Scale;
+    Vector3f Bias;
+
+    VertexQuantization()
+    {
+        Scale = Vector3f(1.0f, 1.0f, 1.0f);
+        Bias = Vector3f(0.0f, 0.0f, 0.0f);
+    }
+};
+
+VertexQuantization CalcVertexQuantization(const BoundingBox& Bounds);
+
+void PackVertices(const Vertex* pVertices, unsigned int NumVertices,
+                  const VertexQuantization& Quantization, PackedVertex* pPacked);
+
+
+#endif	/* VERTEX_FORMAT_H */